@@ -1,12 +1,78 @@
 #include "DxLibPp.hpp"
-#include "DxLib.h"
+#ifdef DXLIBPP_HEADLESS
+#    include "Headless.hpp"
+#else
+#    include "DxLib.h"
+#endif
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstdio>
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
+
+#ifndef DXLIBPP_CALL_STATS
+#    define DXLIBPP_CALL_STATS 1
+#endif
+
+// Build with DXLIBPP_SIMD=0 to force the scalar particle kernel.
+#ifndef DXLIBPP_SIMD
+#    define DXLIBPP_SIMD 1
+#endif
+#if DXLIBPP_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#    define DXLIBPP_PARTICLE_SSE2 1
+#    include <emmintrin.h>
+#else
+#    define DXLIBPP_PARTICLE_SSE2 0
+#endif
 
 namespace {
     int system_initializer_counter = 0;
 
+struct call_counter_t;
+std::array<call_counter_t *, 64> call_counters{};
+std::size_t call_counter_count = 0;
+bool call_stats_enabled = false;
+
+struct call_counter_t {
+    const char * name;
+    std::uint32_t calls = 0;
+    std::chrono::steady_clock::duration time{};
+    explicit call_counter_t(const char * name) : name{name} {
+        if (call_counter_count < call_counters.size())
+            call_counters[call_counter_count++] = this;
+    }
+};
+
+// Times one wrapped call into its counter while call stats are enabled.
+struct call_timer_t {
+#if DXLIBPP_CALL_STATS
+    explicit call_timer_t(call_counter_t & counter) noexcept
+        : counter{call_stats_enabled ? &counter : nullptr}
+    {
+        if (this->counter)
+            begin = std::chrono::steady_clock::now();
+    }
+    ~call_timer_t() {
+        if (counter) {
+            counter->time += std::chrono::steady_clock::now() - begin;
+            ++counter->calls;
+        }
+    }
+    call_counter_t * counter;
+    std::chrono::steady_clock::time_point begin;
+#else
+    explicit call_timer_t(call_counter_t &) noexcept {}
+#endif
+};
+
 #define DEFINE_THROW_FUNCTION(function_name) \
+    call_counter_t function_name##_counter{#function_name}; \
     template<typename ... Args> \
     static auto function_name##_s(Args && ... args) { \
+        call_timer_t timer{function_name##_counter}; \
         auto result = function_name(args ...); \
         if (result == -1) \
             throw std::runtime_error(#function_name " failed."); \
@@ -20,6 +86,7 @@ DEFINE_THROW_FUNCTION(LoadGraph)
 DEFINE_THROW_FUNCTION(LoadDivGraph)
 DEFINE_THROW_FUNCTION(GetGraphSize)
 DEFINE_THROW_FUNCTION(DeleteGraph)
+DEFINE_THROW_FUNCTION(DeleteSharingGraph)
 // DEFINE_THROW_FUNCTION(ScreenFlip)
 // DEFINE_THROW_FUNCTION(ProcessMessage)
 // DEFINE_THROW_FUNCTION(ClearDrawScreen)
@@ -38,28 +105,229 @@ DEFINE_THROW_FUNCTION(GetHitKeyStateAll)
 #undef DEFINE_THROW_FUNCTION
 
 #define DEFINE_NOTHROW_FUNCTION(function_name) \
+    call_counter_t function_name##_counter{#function_name}; \
     template<typename ... Args> \
     static auto function_name##_s(Args && ... args) { \
+        call_timer_t timer{function_name##_counter}; \
         return function_name(args ...); \
     }
 DEFINE_NOTHROW_FUNCTION(DrawRotaGraph3)
+DEFINE_NOTHROW_FUNCTION(DrawRectRotaGraph3)
+DEFINE_NOTHROW_FUNCTION(DrawRectGraph)
+DEFINE_NOTHROW_FUNCTION(DrawPrimitive2D)
+DEFINE_NOTHROW_FUNCTION(SetDrawBlendMode)
+DEFINE_NOTHROW_FUNCTION(SetDrawMode)
+DEFINE_NOTHROW_FUNCTION(SetDrawArea)
 DEFINE_NOTHROW_FUNCTION(DrawStringToHandle)
+// Polled every frame; a missing pad or mouse is not an error.
+DEFINE_NOTHROW_FUNCTION(GetJoypadNum)
+DEFINE_NOTHROW_FUNCTION(GetJoypadAnalogInput)
+DEFINE_NOTHROW_FUNCTION(GetJoypadInputState)
+DEFINE_NOTHROW_FUNCTION(GetMousePoint)
+DEFINE_NOTHROW_FUNCTION(GetMouseInput)
 #undef DEFINE_NOTHROW_FUNCTION
 
+// word must not be 0.
+static int count_trailing_zeros(std::uint64_t word) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    // _BitScanForward64 only exists on 64-bit targets; scan the halves on Win32.
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+        return static_cast<int>(index);
+    _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+static DxLibPp::InputSnapshot::bits_type pack_key_state(const char * key_state) noexcept {
+    DxLibPp::InputSnapshot::bits_type bits{};
+    for (std::size_t group = 0; group < 32; ++group) {
+        std::uint64_t bytes;
+        std::memcpy(&bytes, key_state + group * 8, sizeof(bytes));
+        constexpr std::uint64_t low = 0x7f7f7f7f7f7f7f7full;
+        bytes = (((bytes & low) + low) | bytes) >> 7 & 0x0101010101010101ull;
+        bits[group >> 3] |= ((bytes * 0x0102040810204080ull) >> 56) << ((group & 7) * 8);
+    }
+    return bits;
+}
+
 static char key_state[256];
-static int key_timer[256];
+static DxLibPp::InputSnapshot key_snapshots[2];
+static int current_key_snapshot = 0;
 static void init_key_timer() {
-    for (std::size_t i = 0; i < std::size(key_timer); ++i)
-        key_timer[i] = 0;
+    key_snapshots[0] = key_snapshots[1] = DxLibPp::InputSnapshot{};
+}
+
+// Input stream layout: magic "DXIR", version byte, then records of
+// [varint unchanged frames][varint toggled key count][varint key code gaps...].
+// A record with zero toggled keys terminates the stream.
+constexpr std::uint8_t input_stream_magic[] = {'D', 'X', 'I', 'R', 1};
+
+static void write_varint(std::vector<std::uint8_t> & data, std::uint64_t value) {
+    for (; value >= 0x80; value >>= 7)
+        data.push_back(static_cast<std::uint8_t>(value | 0x80));
+    data.push_back(static_cast<std::uint8_t>(value));
+}
+
+static bool read_varint(const std::vector<std::uint8_t> & data, std::size_t & position, std::uint32_t & value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && position < data.size(); shift += 7) {
+        std::uint8_t byte = data[position++];
+        value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+struct input_recorder_t {
+    bool active = false;
+    std::vector<std::uint8_t> data;
+    DxLibPp::InputSnapshot::bits_type last{};
+    std::uint32_t unchanged = 0;
+    std::uint32_t frames = 0;
+
+    void record(const DxLibPp::InputSnapshot::bits_type & down) {
+        ++frames;
+        DxLibPp::InputSnapshot::bits_type toggled;
+        std::uint32_t count = 0;
+        for (std::size_t i = 0; i < down.size(); ++i) {
+            toggled[i] = down[i] ^ last[i];
+            for (std::uint64_t word = toggled[i]; word != 0; word &= word - 1)
+                ++count;
+        }
+        if (count == 0) {
+            ++unchanged;
+            return;
+        }
+        write_varint(data, unchanged);
+        write_varint(data, count);
+        std::uint32_t previous = 0;
+        for (std::size_t i = 0; i < toggled.size(); ++i) {
+            for (std::uint64_t word = toggled[i]; word != 0; word &= word - 1) {
+                std::uint32_t key_code = static_cast<std::uint32_t>(i * 64 + count_trailing_zeros(word));
+                write_varint(data, key_code - previous);
+                previous = key_code;
+            }
+        }
+        unchanged = 0;
+        last = down;
+    }
+} input_recorder;
+
+struct input_replayer_t {
+    bool active = false;
+    std::vector<std::uint8_t> data;
+    std::size_t position = 0;
+    DxLibPp::InputSnapshot::bits_type down{};
+    std::uint32_t unchanged = 0;
+    std::uint32_t count = 0;
+
+    bool read_record() {
+        return read_varint(data, position, unchanged) && read_varint(data, position, count);
+    }
+
+    bool next(DxLibPp::InputSnapshot::bits_type & result) {
+        if (unchanged > 0) {
+            --unchanged;
+        }
+        else {
+            if (count == 0)
+                return active = false;
+            std::uint32_t key_code = 0, gap = 0;
+            for (std::uint32_t i = 0; i < count; ++i) {
+                if (!read_varint(data, position, gap) || (key_code += gap) > 255)
+                    return active = false;
+                down[key_code >> 6] ^= std::uint64_t{1} << (key_code & 63);
+            }
+            if (!read_record())
+                return active = false;
+        }
+        result = down;
+        return true;
+    }
+} input_replayer;
+
+struct input_events_t {
+    DxLibPp::SpscQueue<DxLibPp::InputEvent, DxLibPp::InputEvents::CAPACITY> queue;
+    DxLibPp::InputSnapshot::bits_type down{};
+    std::atomic<std::uint64_t> dropped{};
+    std::atomic<bool> polling{};
+    std::thread poller;
+
+    // Only one thread emits at a time: the poller while it runs, the game thread otherwise.
+    void emit(const DxLibPp::InputSnapshot::bits_type & next, std::int64_t timestamp) noexcept {
+        for (std::size_t i = 0; i < next.size(); ++i) {
+            for (std::uint64_t word = next[i] ^ down[i]; word != 0; word &= word - 1) {
+                int bit = count_trailing_zeros(word);
+                DxLibPp::InputEvent event{static_cast<int>(i * 64 + bit), ((next[i] >> bit) & 1) != 0, timestamp};
+                if (!queue.Push(event))
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        down = next;
+    }
+
+    void poll(int interval_microseconds) {
+        char state[256];
+        while (polling.load(std::memory_order_acquire)) {
+            if (GetHitKeyStateAll(state) != -1)
+                emit(pack_key_state(state), GetNowHiPerformanceCount());
+            std::this_thread::sleep_for(std::chrono::microseconds{interval_microseconds});
+        }
+    }
+} input_events;
+
+float joypad_dead_zone = 0.2f;
+int joypad_count = 0;
+
+// Maps the raw [-1000, 1000] stick to [-1, 1] with a radial dead zone, rescaled so output starts at 0 at its edge.
+static void normalize_stick(int raw_x, int raw_y, float & x, float & y) noexcept {
+    float fx = static_cast<float>(raw_x) / 1000.0f, fy = static_cast<float>(raw_y) / 1000.0f;
+    float length = std::sqrt(fx * fx + fy * fy);
+    if (length <= joypad_dead_zone) {
+        x = y = 0.0f;
+        return;
+    }
+    float scale = (std::min)((length - joypad_dead_zone) / (1.0f - joypad_dead_zone), 1.0f) / length;
+    x = fx * scale;
+    y = fy * scale;
+}
+
+static void poll_devices(DxLibPp::InputSnapshot & snapshot, const DxLibPp::InputSnapshot & previous) {
+    joypad_count = (std::min)((std::max)(GetJoypadNum_s(), 0), DxLibPp::InputSnapshot::PAD_COUNT);
+    for (int pad = 0; pad < joypad_count; ++pad) {
+        int raw_x = 0, raw_y = 0;
+        GetJoypadAnalogInput_s(&raw_x, &raw_y, DX_INPUT_PAD1 + pad);
+        float x, y;
+        normalize_stick(raw_x, raw_y, x, y);
+        snapshot.SetPad(previous, pad, static_cast<std::uint32_t>(GetJoypadInputState_s(DX_INPUT_PAD1 + pad)), x, y);
+    }
+    int mouse_x = 0, mouse_y = 0;
+    GetMousePoint_s(&mouse_x, &mouse_y);
+    snapshot.SetMouse(previous, mouse_x, mouse_y, static_cast<std::uint32_t>(GetMouseInput_s()));
 }
+
 static void update_key_state() {
-    GetHitKeyStateAll_s(key_state);
-    for (std::size_t i = 0; i < std::size(key_state); ++i) {
-        if (key_state[i])
-            ++key_timer[i];
-        else
-            key_timer[i] = 0;
+    DxLibPp::InputSnapshot::bits_type down;
+    if (!input_replayer.active || !input_replayer.next(down)) {
+        GetHitKeyStateAll_s(key_state);
+        down = pack_key_state(key_state);
     }
+    if (!input_events.polling.load(std::memory_order_relaxed))
+        input_events.emit(down, GetNowHiPerformanceCount());
+    if (input_recorder.active)
+        input_recorder.record(down);
+    int previous = current_key_snapshot;
+    current_key_snapshot ^= 1;
+    key_snapshots[current_key_snapshot] = DxLibPp::InputSnapshot{key_snapshots[previous], down};
+    poll_devices(key_snapshots[current_key_snapshot], key_snapshots[previous]);
 }
 
 }
@@ -75,16 +343,466 @@ DxLibPp::SystemInitializer::SystemInitializer() {
 }
 
 DxLibPp::SystemInitializer::~SystemInitializer() {
-    if (--system_initializer_counter == 0)
+    if (--system_initializer_counter == 0) {
+        DxLibPp::InputEvents::StopPolling();
         DxLib_End();
+    }
+}
+
+namespace {
+
+struct camera_state_t {
+    DxLibPp::Camera camera;
+    DxLibPp::Rect view;
+    bool culling{};
+    std::uint64_t drawn{}, culled{}; // immediate draws and flushed commands of the current frame
+    DxLibPp::CullStats last;
+} camera_state;
+
+// Whether a source rectangle of width x height, drawn with its point (center_x, center_y) on the world point
+// (x, y), scaled and turned by angle, may meet the view. Turned rectangles are tested by their bounding square.
+bool rota_visible(double x, double y, double width, double height, double center_x, double center_y, double scale_x, double scale_y, double angle) {
+    if (!camera_state.culling)
+        return true;
+    double left = -center_x * scale_x, right = (width - center_x) * scale_x;
+    double top = -center_y * scale_y, bottom = (height - center_y) * scale_y;
+    if (left > right)
+        std::swap(left, right);
+    if (top > bottom)
+        std::swap(top, bottom);
+    if (angle != 0.0) {
+        double radius = std::hypot((std::max)(-left, right), (std::max)(-top, bottom));
+        left = top = -radius;
+        right = bottom = radius;
+    }
+    return camera_state.view.intersects(DxLibPp::Rect{x + left, y + top, right - left, bottom - top});
+}
+
+// Counts an immediate draw. Main thread only.
+bool count_visible(bool visible) {
+    ++(visible ? camera_state.drawn : camera_state.culled);
+    return visible;
+}
+
+}
+
+DxLibPp::Camera::Camera(const Point & position, double zoom, double rotation, const Point & origin)
+    : position{position}
+    , origin{origin}
+    , rotation{rotation}
+{
+    SetZoom(zoom);
+}
+
+void DxLibPp::Camera::SetZoom(double zoom) {
+    if (!(zoom > 0.0))
+        throw std::invalid_argument("Camera zoom must be positive.");
+    this->zoom = zoom;
+    update();
+}
+
+void DxLibPp::Camera::update() {
+    cos_rotation = std::cos(rotation);
+    sin_rotation = std::sin(rotation);
+    identity = position.x == 0.0 && position.y == 0.0 && origin.x == 0.0 && origin.y == 0.0 && zoom == 1.0 && rotation == 0.0;
+}
+
+DxLibPp::Point DxLibPp::Camera::ToScreen(const Point & world) const {
+    if (identity)
+        return world;
+    double dx = world.x - position.x, dy = world.y - position.y;
+    return Point{
+        origin.x + zoom * (cos_rotation * dx + sin_rotation * dy),
+        origin.y + zoom * (cos_rotation * dy - sin_rotation * dx)
+    };
+}
+
+DxLibPp::Point DxLibPp::Camera::ToWorld(const Point & screen) const {
+    if (identity)
+        return screen;
+    double dx = (screen.x - origin.x) / zoom, dy = (screen.y - origin.y) / zoom;
+    return Point{
+        position.x + cos_rotation * dx - sin_rotation * dy,
+        position.y + sin_rotation * dx + cos_rotation * dy
+    };
+}
+
+DxLibPp::Rect DxLibPp::Camera::GetView(double width, double height) const {
+    Point corners[] = {ToWorld(Point{0, 0}), ToWorld(Point{width, 0}), ToWorld(Point{0, height}), ToWorld(Point{width, height})};
+    double left = corners[0].x, right = corners[0].x, top = corners[0].y, bottom = corners[0].y;
+    for (const Point & corner : corners) {
+        left = (std::min)(left, corner.x);
+        right = (std::max)(right, corner.x);
+        top = (std::min)(top, corner.y);
+        bottom = (std::max)(bottom, corner.y);
+    }
+    return Rect{left, top, right - left, bottom - top};
+}
+
+void DxLibPp::Drawable::Submit(DrawCommandBuffer & buffer) const {
+    buffer.DrawDrawable(*this);
+}
+
+void DxLibPp::DrawCommandBuffer::SetBlendMode(BlendMode mode, int param) {
+    blend_mode = mode;
+    blend_param = static_cast<std::uint8_t>((std::clamp)(param, 0, 255));
+}
+
+void DxLibPp::DrawCommandBuffer::SetDrawArea(int x1, int y1, int x2, int y2) {
+    area = find_area(area_t{x1, y1, x2, y2});
+}
+
+std::uint8_t DxLibPp::DrawCommandBuffer::find_area(const area_t & a) {
+    for (std::size_t i = 1; i < areas.size(); ++i) {
+        const area_t & b = areas[i];
+        if (a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2)
+            return static_cast<std::uint8_t>(i);
+    }
+    if (areas.size() == MAX_AREAS)
+        throw std::length_error("DrawCommandBuffer holds at most 255 draw areas per frame.");
+    areas.push_back(a);
+    return static_cast<std::uint8_t>(areas.size() - 1);
+}
+
+void DxLibPp::DrawCommandBuffer::push(Command command) {
+    command.blend_mode = blend_mode;
+    command.blend_param = blend_param;
+    command.draw_mode = draw_mode;
+    command.area = area;
+    keys.push_back(
+        static_cast<std::uint64_t>(layer) << 56
+        | static_cast<std::uint64_t>(blend_mode) << 53
+        | static_cast<std::uint64_t>(draw_mode) << 52
+        | static_cast<std::uint64_t>(area) << 44
+        | static_cast<std::uint64_t>(command.handle & 0xfffff) << 24
+        | depth
+    );
+    commands.push_back(command);
+}
+
+void DxLibPp::DrawCommandBuffer::DrawRectRotaGraph(
+    double x, double y, int src_x, int src_y, int src_width, int src_height,
+    double center_x, double center_y, double scale_x, double scale_y, double angle,
+    int handle, bool transparent
+) {
+    if (!rota_visible(x, y, src_width, src_height, center_x, center_y, scale_x, scale_y, angle)) {
+        ++culled;
+        return;
+    }
+    const Camera & camera = camera_state.camera;
+    Point screen = camera.ToScreen(Point{x, y});
+    Command command;
+    command.type = CommandType::RECT_ROTA_GRAPH;
+    command.transparent = transparent;
+    command.handle = handle;
+    command.src_x = src_x;
+    command.src_y = src_y;
+    command.src_width = src_width;
+    command.src_height = src_height;
+    command.x = static_cast<float>(screen.x);
+    command.y = static_cast<float>(screen.y);
+    command.center_x = static_cast<float>(center_x);
+    command.center_y = static_cast<float>(center_y);
+    command.scale_x = static_cast<float>(scale_x * camera.GetZoom());
+    command.scale_y = static_cast<float>(scale_y * camera.GetZoom());
+    command.angle = static_cast<float>(angle - camera.GetRotation());
+    push(command);
+}
+
+void DxLibPp::DrawCommandBuffer::DrawRectGraph(double x, double y, int src_x, int src_y, int src_width, int src_height, int handle, bool transparent) {
+    const Camera & camera = camera_state.camera;
+    if (camera.GetZoom() != 1.0 || camera.GetRotation() != 0.0) {
+        DrawRectRotaGraph(
+            x + src_width / 2.0, y + src_height / 2.0, src_x, src_y, src_width, src_height,
+            src_width / 2.0, src_height / 2.0, 1.0, 1.0, 0.0, handle, transparent
+        );
+        return;
+    }
+    if (!rota_visible(x, y, src_width, src_height, 0.0, 0.0, 1.0, 1.0, 0.0)) {
+        ++culled;
+        return;
+    }
+    Point screen = camera.ToScreen(Point{x, y});
+    x = screen.x;
+    y = screen.y;
+    Command command;
+    command.type = CommandType::RECT_GRAPH;
+    command.transparent = transparent;
+    command.handle = handle;
+    command.src_x = src_x;
+    command.src_y = src_y;
+    command.src_width = src_width;
+    command.src_height = src_height;
+    command.x = static_cast<float>(x);
+    command.y = static_cast<float>(y);
+    push(command);
+}
+
+void DxLibPp::DrawCommandBuffer::DrawDrawable(const Drawable & drawable) {
+    Command command;
+    command.type = CommandType::DRAWABLE;
+    command.drawable = &drawable;
+    push(command);
+}
+
+void DxLibPp::DrawCommandBuffer::Append(DrawCommandBuffer & other) {
+    std::array<std::uint8_t, MAX_AREAS> remap{};
+    for (std::size_t i = 1; i < other.areas.size(); ++i)
+        remap[i] = find_area(other.areas[i]);
+    constexpr std::uint64_t area_mask = std::uint64_t{0xff} << 44;
+    commands.reserve(commands.size() + other.commands.size());
+    keys.reserve(keys.size() + other.keys.size());
+    for (std::size_t i = 0; i < other.commands.size(); ++i) {
+        Command command = other.commands[i];
+        command.area = remap[command.area];
+        commands.push_back(command);
+        keys.push_back((other.keys[i] & ~area_mask) | static_cast<std::uint64_t>(command.area) << 44);
+    }
+    culled += other.culled;
+    other.Clear();
+}
+
+// Stable LSD radix sort of the keys, one byte per pass. Passes over bytes that are equal in every key, such
+// as the layer when only one is used, are skipped.
+void DxLibPp::DrawCommandBuffer::sort() {
+    std::size_t size = keys.size();
+    order.resize(size);
+    sort_order.resize(size);
+    sort_keys.resize(size);
+    for (std::size_t i = 0; i < size; ++i)
+        order[i] = static_cast<std::uint32_t>(i);
+    std::array<std::array<std::size_t, 256>, 8> counts{};
+    for (std::uint64_t key : keys)
+        for (int pass = 0; pass < 8; ++pass)
+            ++counts[pass][(key >> (pass * 8)) & 0xff];
+    for (int pass = 0; pass < 8; ++pass) {
+        auto & count = counts[pass];
+        if (count[(keys[0] >> (pass * 8)) & 0xff] == size)
+            continue;
+        std::size_t offset = 0;
+        for (std::size_t & bucket : count) {
+            std::size_t next = offset + bucket;
+            bucket = offset;
+            offset = next;
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            std::size_t slot = count[(keys[i] >> (pass * 8)) & 0xff]++;
+            sort_keys[slot] = keys[i];
+            sort_order[slot] = order[i];
+        }
+        keys.swap(sort_keys);
+        order.swap(sort_order);
+    }
+}
+
+void DxLibPp::DrawCommandBuffer::Flush() {
+    DXLIBPP_PROFILE_ZONE("DrawCommandBuffer::Flush");
+    stats = Stats{};
+    stats.commands = commands.size();
+    stats.culled = culled;
+    camera_state.culled += culled;
+    if (commands.empty()) {
+        Clear();
+        return;
+    }
+    sort();
+    // -1 forces the first command to set every state.
+    int current_blend = -1, current_param = -1, current_mode = -1, current_area = -1;
+    auto apply = [&](int blend, int param, int mode, int area) {
+        if (blend != current_blend || param != current_param) {
+            static constexpr int blend_modes[] = {DX_BLENDMODE_NOBLEND, DX_BLENDMODE_ALPHA, DX_BLENDMODE_ADD, DX_BLENDMODE_SUB};
+            SetDrawBlendMode_s(blend_modes[blend], param);
+            current_blend = blend;
+            current_param = param;
+            ++stats.state_changes;
+        } else {
+            ++stats.elided;
+        }
+        if (mode != current_mode) {
+            SetDrawMode_s(mode == static_cast<int>(DrawMode::BILINEAR) ? DX_DRAWMODE_BILINEAR : DX_DRAWMODE_NEAREST);
+            current_mode = mode;
+            ++stats.state_changes;
+        } else {
+            ++stats.elided;
+        }
+        if (area != current_area) {
+            if (area == 0)
+                SetDrawArea_s(0, 0, Screen::GetWidth(), Screen::GetHeight());
+            else
+                SetDrawArea_s(areas[area].x1, areas[area].y1, areas[area].x2, areas[area].y2);
+            current_area = area;
+            ++stats.state_changes;
+        } else {
+            ++stats.elided;
+        }
+    };
+    for (std::uint32_t index : order) {
+        const Command & command = commands[index];
+        apply(static_cast<int>(command.blend_mode), command.blend_param, static_cast<int>(command.draw_mode), command.area);
+        switch (command.type) {
+        case CommandType::RECT_ROTA_GRAPH:
+            DrawRectRotaGraph3_s(
+                static_cast<int>(command.x), static_cast<int>(command.y),
+                command.src_x, command.src_y, command.src_width, command.src_height,
+                static_cast<int>(command.center_x), static_cast<int>(command.center_y),
+                command.scale_x, command.scale_y, command.angle,
+                command.handle, command.transparent ? TRUE : FALSE, FALSE
+            );
+            ++camera_state.drawn;
+            break;
+        case CommandType::RECT_GRAPH:
+            DrawRectGraph_s(
+                static_cast<int>(command.x), static_cast<int>(command.y),
+                command.src_x, command.src_y, command.src_width, command.src_height,
+                command.handle, command.transparent ? TRUE : FALSE, FALSE
+            );
+            ++camera_state.drawn;
+            break;
+        case CommandType::DRAWABLE:
+            command.drawable->Draw();
+            break;
+        }
+    }
+    // Leave the defaults behind for immediate drawing. This is not part of replaying the frame, so it is kept
+    // out of the stats.
+    Stats frame = stats;
+    apply(static_cast<int>(BlendMode::NOBLEND), 255, static_cast<int>(DrawMode::NEAREST), 0);
+    stats = frame;
+    Clear();
+}
+
+void DxLibPp::DrawCommandBuffer::Clear() {
+    commands.clear();
+    keys.clear();
+    culled = 0;
+    areas.resize(1);
+    area = 0;
+}
+
+std::size_t DxLibPp::LayeredDrawList::Add(const Drawable & drawable, std::uint8_t layer, double z) {
+    std::size_t id;
+    if (free_ids.empty()) {
+        id = drawables.size();
+        drawables.push_back(nullptr);
+        zs.push_back(0.0);
+        layers.push_back(0);
+        queued.push_back(false);
+    } else {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    drawables[id] = &drawable;
+    zs[id] = z;
+    layers[id] = layer;
+    queue(id);
+    ++size;
+    return id;
+}
+
+void DxLibPp::LayeredDrawList::Remove(std::size_t id) {
+    check_id(id);
+    // The id may be reused at once: it stays queued, so Refresh() takes the old entry out either way.
+    queue(id);
+    drawables[id] = nullptr;
+    free_ids.push_back(static_cast<std::uint32_t>(id));
+    --size;
+}
+
+void DxLibPp::LayeredDrawList::Clear() {
+    drawables.clear();
+    zs.clear();
+    layers.clear();
+    queued.clear();
+    free_ids.clear();
+    pending.clear();
+    for (auto & order : orders)
+        order.clear();
+    dirty.fill(false);
+    size = 0;
+    moved = 0;
+}
+
+void DxLibPp::LayeredDrawList::SetLayer(std::size_t id, std::uint8_t layer) {
+    check_id(id);
+    if (layers[id] == layer)
+        return;
+    queue(id);
+    layers[id] = layer;
+}
+
+void DxLibPp::LayeredDrawList::SetZ(std::size_t id, double z) {
+    check_id(id);
+    if (zs[id] == z)
+        return;
+    queue(id);
+    zs[id] = z;
+}
+
+// Marks id for re-positioning and the layer it is on now as needing the pass that takes it out.
+void DxLibPp::LayeredDrawList::queue(std::size_t id) {
+    dirty[layers[id]] = true;
+    if (queued[id])
+        return;
+    queued[id] = true;
+    pending.push_back(static_cast<std::uint32_t>(id));
+}
+
+void DxLibPp::LayeredDrawList::Refresh() {
+    DXLIBPP_PROFILE_ZONE("LayeredDrawList::Refresh");
+    moved = 0;
+    if (pending.empty())
+        return;
+    for (std::size_t layer = 0; layer < LAYER_COUNT; ++layer) {
+        if (!dirty[layer])
+            continue;
+        auto & order = orders[layer];
+        order.erase(std::remove_if(order.begin(), order.end(), [&](std::uint32_t id) { return queued[id]; }), order.end());
+        dirty[layer] = false;
+    }
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](std::uint32_t id) {
+        queued[id] = false;
+        return drawables[id] == nullptr;
+    }), pending.end());
+    auto back_to_front = [&](std::uint32_t a, std::uint32_t b) { return zs[a] < zs[b] || (zs[a] == zs[b] && a < b); };
+    std::sort(pending.begin(), pending.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return layers[a] < layers[b] || (layers[a] == layers[b] && back_to_front(a, b));
+    });
+    for (auto first = pending.begin(); first != pending.end();) {
+        std::uint8_t layer = layers[*first];
+        auto last = std::find_if(first, pending.end(), [&](std::uint32_t id) { return layers[id] != layer; });
+        auto & order = orders[layer];
+        merged.resize(order.size() + static_cast<std::size_t>(last - first));
+        std::merge(order.begin(), order.end(), first, last, merged.begin(), back_to_front);
+        order.swap(merged);
+        first = last;
+    }
+    moved = pending.size();
+    pending.clear();
+}
+
+void DxLibPp::LayeredDrawList::Draw() {
+    DXLIBPP_PROFILE_ZONE("LayeredDrawList::Draw");
+    Refresh();
+    for (std::size_t layer = 0; layer < LAYER_COUNT; ++layer) {
+        if (!enabled[layer])
+            continue;
+        for (std::uint32_t id : orders[layer])
+            drawables[id]->Draw();
+    }
 }
 
 struct DxLibPp::Graph::impl_t {
     std::shared_ptr<int> handle{new int{-1}, &delete_handle };
-    Dimension get_dimension() const {
+    // Size of the image behind handle, queried once when it is set so that drawing, and submitting from
+    // worker threads, needs no DxLib call.
+    Dimension dimension;
+    const Dimension & get_dimension() const {
+        return dimension;
+    }
+    void query_dimension() {
         int width{}, height{};
         GetGraphSize_s(*handle, &width, &height);
-        return {static_cast<double>(width), static_cast<double>(height)};
+        dimension = {static_cast<double>(width), static_cast<double>(height)};
     }
     static void delete_handle(int * ptr) {
         if (*ptr != -1)
@@ -125,28 +843,48 @@ DxLibPp::Graph & DxLibPp::Graph::operator =(const Graph & g) {
 }
 
 void DxLibPp::Graph::Draw() const {
+    DXLIBPP_PROFILE_ZONE("Graph::Draw");
     Dimension d = impl->get_dimension();
-    int center_x = static_cast<int>(GetX() + GetWidth() / 2);
-    int center_y = static_cast<int>(GetY() + GetHeight() / 2);
+    Point center{GetX() + GetWidth() / 2, GetY() + GetHeight() / 2};
     double extend_x_rate = GetWidth() / d.GetWidth();
     double extend_y_rate = GetHeight() / d.GetHeight();
+    if (!count_visible(rota_visible(center.x, center.y, d.GetWidth(), d.GetHeight(), d.GetWidth() / 2, d.GetHeight() / 2, extend_x_rate, extend_y_rate, GetTheta())))
+        return;
+    const Camera & camera = camera_state.camera;
+    Point screen = camera.ToScreen(center);
     DrawRotaGraph3_s(
-        center_x, center_y,
-        center_x, center_y,
-        extend_x_rate, extend_y_rate,
-        GetTheta(), *impl->handle,
+        static_cast<int>(screen.x), static_cast<int>(screen.y),
+        static_cast<int>(d.GetWidth() / 2), static_cast<int>(d.GetHeight() / 2),
+        extend_x_rate * camera.GetZoom(), extend_y_rate * camera.GetZoom(),
+        GetTheta() - camera.GetRotation(), *impl->handle,
         TRUE, FALSE
     );
 }
 
+void DxLibPp::Graph::Submit(DrawCommandBuffer & buffer) const {
+    Dimension d = impl->get_dimension();
+    buffer.DrawRectRotaGraph(
+        GetX() + GetWidth() / 2, GetY() + GetHeight() / 2,
+        0, 0, static_cast<int>(d.GetWidth()), static_cast<int>(d.GetHeight()),
+        d.GetWidth() / 2, d.GetHeight() / 2,
+        GetWidth() / d.GetWidth(), GetHeight() / d.GetHeight(),
+        GetTheta(), *impl->handle
+    );
+}
+
 void DxLibPp::Graph::Load(std::string_view path) {
     int handle = LoadGraph_s(std::string{path}.c_str());
     impl->handle = std::shared_ptr<int>(new int{handle}, &impl_t::delete_handle);
+    impl->query_dimension();
     Dimension d = impl->get_dimension();
     width = d.GetWidth();
     height = d.GetHeight();
 }
 
+int DxLibPp::Graph::GetHandle() const {
+    return *impl->handle;
+}
+
 DxLibPp::Iterator<DxLibPp::Graph &> DxLibPp::Graph::LoadDivGraph(
     std::string_view path,
     std::size_t number,
@@ -159,11 +897,331 @@ DxLibPp::Iterator<DxLibPp::Graph &> DxLibPp::Graph::LoadDivGraph(
     for (std::size_t i = 0; i < handles.size(); ++i) {
         Graph g;
         g.impl->handle = std::shared_ptr<int>{new int{handles.at(i)}, impl_t::delete_handle};
+        g.impl->dimension = {static_cast<double>(column_width), static_cast<double>(row_height)};
         graphs->push_back(g);
     }
     return GetIterator(graphs);
 }
 
+struct DxLibPp::SpriteSheet::owner_t {
+    int handle{-1};
+    ~owner_t() {
+        if (handle != -1)
+            DeleteSharingGraph_s(handle);
+    }
+};
+
+DxLibPp::SpriteSheet::SpriteSheet(
+    std::string_view path,
+    std::size_t number,
+    std::size_t column_number, std::size_t row_number,
+    std::size_t column_width, std::size_t row_height
+) {
+    Load(path, number, column_number, row_number, column_width, row_height);
+}
+
+void DxLibPp::SpriteSheet::Load(
+    std::string_view path,
+    std::size_t number,
+    std::size_t column_number, std::size_t row_number,
+    std::size_t column_width, std::size_t row_height
+) {
+    if (column_number == 0 || number > column_number * row_number)
+        throw std::invalid_argument("SpriteSheet cells must fit in the grid.");
+    auto loaded = std::make_shared<owner_t>();
+    loaded->handle = LoadGraph_s(std::string{path}.c_str());
+    int width{}, height{};
+    GetGraphSize_s(loaded->handle, &width, &height);
+    if (column_number * column_width > static_cast<std::size_t>(width) || row_number * row_height > static_cast<std::size_t>(height))
+        throw std::invalid_argument("SpriteSheet grid must fit in the graph.");
+    owner = std::move(loaded);
+    this->number = number;
+    this->column_number = column_number;
+    this->column_width = column_width;
+    this->row_height = row_height;
+}
+
+int DxLibPp::SpriteSheet::GetHandle() const {
+    return owner ? owner->handle : -1;
+}
+
+void DxLibPp::SpriteSheet::Draw(std::size_t index, double x, double y) const {
+    Cell cell = GetCell(index);
+    if (!count_visible(rota_visible(x, y, cell.width, cell.height, 0.0, 0.0, 1.0, 1.0, 0.0)))
+        return;
+    const Camera & camera = camera_state.camera;
+    if (camera.GetZoom() != 1.0 || camera.GetRotation() != 0.0) {
+        Point screen = camera.ToScreen(Point{x + cell.width / 2.0, y + cell.height / 2.0});
+        DrawRectRotaGraph3_s(
+            static_cast<int>(screen.x), static_cast<int>(screen.y),
+            cell.x, cell.y, cell.width, cell.height,
+            cell.width / 2, cell.height / 2,
+            camera.GetZoom(), camera.GetZoom(), -camera.GetRotation(),
+            cell.handle, TRUE, FALSE
+        );
+        return;
+    }
+    Point screen = camera.ToScreen(Point{x, y});
+    DrawRectGraph_s(static_cast<int>(screen.x), static_cast<int>(screen.y), cell.x, cell.y, cell.width, cell.height, cell.handle, TRUE, FALSE);
+}
+
+void DxLibPp::SpriteSheet::Submit(DrawCommandBuffer & buffer, std::size_t index, double x, double y) const {
+    Cell cell = GetCell(index);
+    buffer.DrawRectGraph(x, y, cell.x, cell.y, cell.width, cell.height, cell.handle);
+}
+
+namespace {
+
+std::vector<DxLibPp::AnimationClip::Frame> whole_graph_frames(const std::vector<std::pair<DxLibPp::Graph, double>> & frames) {
+    std::vector<DxLibPp::AnimationClip::Frame> result;
+    result.reserve(frames.size());
+    for (const auto & [graph, duration] : frames) {
+        int width{}, height{};
+        GetGraphSize_s(graph.GetHandle(), &width, &height);
+        result.push_back(DxLibPp::AnimationClip::Frame{graph.GetHandle(), 0, 0, width, height, duration});
+    }
+    return result;
+}
+
+std::vector<DxLibPp::Graph> frame_graphs(const std::vector<std::pair<DxLibPp::Graph, double>> & frames) {
+    std::vector<DxLibPp::Graph> result;
+    result.reserve(frames.size());
+    for (const auto & frame : frames)
+        result.push_back(frame.first);
+    return result;
+}
+
+}
+
+DxLibPp::AnimationClip::AnimationClip(const std::vector<std::pair<Graph, double>> & frames)
+    : AnimationClip{whole_graph_frames(frames), frame_graphs(frames)}
+{}
+
+DxLibPp::AnimationClip::AnimationClip(std::vector<Frame> frames, std::vector<Graph> owners)
+    : frames{std::move(frames)}
+    , owners{std::move(owners)}
+{
+    if (this->frames.empty())
+        throw std::logic_error("AnimationClip must be not empty.");
+    for (const Frame & frame : this->frames) {
+        if (!(frame.duration > 0.0))
+            throw std::invalid_argument("AnimationClip frame duration must be positive.");
+        duration += frame.duration;
+    }
+}
+
+const DxLibPp::Graph * DxLibPp::AnimationClip::GetGraph(std::size_t index) const {
+    int handle = frames.at(index).handle;
+    for (const Graph & owner : owners)
+        if (owner.GetHandle() == handle)
+            return &owner;
+    return nullptr;
+}
+
+namespace {
+
+// Moves a cursor across one frame boundary. A finished cursor keeps its index.
+DxLibPp::AnimationEventType step_frame(std::uint32_t count, DxLibPp::AnimationMode mode, std::uint32_t & index, std::int8_t & direction) {
+    using DxLibPp::AnimationEventType;
+    switch (mode) {
+    case DxLibPp::AnimationMode::LOOP:
+        if (++index == count) {
+            index = 0;
+            return AnimationEventType::LOOP;
+        }
+        return AnimationEventType::FRAME;
+    case DxLibPp::AnimationMode::ONCE:
+        if (index + 1 >= count)
+            return AnimationEventType::FINISH;
+        ++index;
+        return AnimationEventType::FRAME;
+    case DxLibPp::AnimationMode::PING_PONG:
+    default:
+        if (count == 1)
+            return AnimationEventType::LOOP;
+        if (direction > 0 ? index + 1 >= count : index == 0) {
+            direction = static_cast<std::int8_t>(-direction);
+            index += direction;
+            return AnimationEventType::LOOP;
+        }
+        index += direction;
+        return AnimationEventType::FRAME;
+    }
+}
+
+// Carries a cursor whose remaining time has run out across every frame boundary the overrun covers. A looping
+// cursor that overran the whole clip skips the full cycles without raising their events.
+template<typename Raise>
+void cross_frames(const DxLibPp::AnimationClip & clip, DxLibPp::AnimationMode mode, std::uint32_t & index, std::int8_t & direction, double & remaining, Raise && raise) {
+    if (mode == DxLibPp::AnimationMode::LOOP && remaining <= -clip.GetDuration())
+        remaining = std::fmod(remaining, clip.GetDuration());
+    auto count = static_cast<std::uint32_t>(clip.GetFrameNumber());
+    while (remaining <= 0.0) {
+        DxLibPp::AnimationEventType type = step_frame(count, mode, index, direction);
+        raise(type, index);
+        if (type == DxLibPp::AnimationEventType::FINISH) {
+            remaining = std::numeric_limits<double>::infinity();
+            return;
+        }
+        remaining += clip.GetFrame(index).duration;
+    }
+}
+
+}
+
+DxLibPp::Animation::Animation(std::shared_ptr<const AnimationClip> clip, AnimationMode mode)
+    : clip{std::move(clip)}
+    , mode{mode}
+{
+    if (!this->clip)
+        throw std::logic_error("Animation must have a clip.");
+    remaining = GetCurrentFrame().duration;
+}
+
+DxLibPp::Animation::Animation(const std::shared_ptr<Iterator<std::shared_ptr<frame>>> & frame_iterator) {
+    std::vector<std::pair<Graph, double>> frames;
+    while (frame_iterator->HasNext()) {
+        std::shared_ptr<frame> next = frame_iterator->Next();
+        // Update() used to hold a frame for duration + 1 calls.
+        frames.emplace_back(*next->first, static_cast<double>(next->second + 1) * System::GetTimestep());
+    }
+    if (frames.empty())
+        throw std::logic_error("Animation must be not empty.");
+    clip = std::make_shared<const AnimationClip>(frames);
+    remaining = GetCurrentFrame().duration;
+    // Callers placed these animations by placing the frame graphs; start where the first one is. Sizes only
+    // stick when that graph was resized, so unscaled frames of different sizes keep their own.
+    const Graph & first = frames.front().first;
+    x = first.GetX();
+    y = first.GetY();
+    theta = first.GetTheta();
+    if (first.GetWidth() != GetCurrentFrame().width)
+        width = first.GetWidth();
+    if (first.GetHeight() != GetCurrentFrame().height)
+        height = first.GetHeight();
+}
+
+std::shared_ptr<DxLibPp::Graph> DxLibPp::Animation::GetCurrentGraph() const {
+    const Graph * owner = clip->GetGraph(index);
+    if (!owner)
+        return nullptr;
+    auto graph = std::make_shared<Graph>(*owner);
+    graph->SetX(x);
+    graph->SetY(y);
+    graph->SetWidth(GetWidth());
+    graph->SetHeight(GetHeight());
+    graph->SetTheta(theta);
+    return graph;
+}
+
+void DxLibPp::Animation::SetFrameIndex(std::size_t index) {
+    this->index = static_cast<std::uint32_t>(index % clip->GetFrameNumber());
+    direction = 1;
+    remaining = GetCurrentFrame().duration;
+}
+
+void DxLibPp::Animation::Advance(double seconds) {
+    remaining -= seconds * speed;
+    if (remaining <= 0.0)
+        cross_frames(*clip, mode, index, direction, remaining, [](AnimationEventType, std::uint32_t) {});
+}
+
+void DxLibPp::Animation::Update() {
+    Advance(System::GetDeltaTime());
+}
+
+void DxLibPp::Animation::Draw() const {
+    DXLIBPP_PROFILE_ZONE("Animation::Draw");
+    const AnimationClip::Frame & current = GetCurrentFrame();
+    Point center{GetX() + GetWidth() / 2, GetY() + GetHeight() / 2};
+    double scale_x = GetWidth() / current.width, scale_y = GetHeight() / current.height;
+    if (!count_visible(rota_visible(center.x, center.y, current.width, current.height, current.width / 2.0, current.height / 2.0, scale_x, scale_y, GetTheta())))
+        return;
+    const Camera & camera = camera_state.camera;
+    Point screen = camera.ToScreen(center);
+    DrawRectRotaGraph3_s(
+        static_cast<int>(screen.x), static_cast<int>(screen.y),
+        current.x, current.y, current.width, current.height,
+        current.width / 2, current.height / 2,
+        scale_x * camera.GetZoom(), scale_y * camera.GetZoom(),
+        GetTheta() - camera.GetRotation(), current.handle,
+        TRUE, FALSE
+    );
+}
+
+void DxLibPp::Animation::Submit(DrawCommandBuffer & buffer) const {
+    const AnimationClip::Frame & current = GetCurrentFrame();
+    buffer.DrawRectRotaGraph(
+        GetX() + GetWidth() / 2, GetY() + GetHeight() / 2,
+        current.x, current.y, current.width, current.height,
+        current.width / 2, current.height / 2,
+        GetWidth() / current.width, GetHeight() / current.height,
+        GetTheta(), current.handle
+    );
+}
+
+std::size_t DxLibPp::AnimationBatch::Add(std::shared_ptr<const AnimationClip> clip, AnimationMode mode, double speed) {
+    if (!clip)
+        throw std::logic_error("AnimationBatch cursor must have a clip.");
+    remaining.push_back(clip->GetFrame(0).duration);
+    speeds.push_back((std::max)(speed, 0.0));
+    indices.push_back(0);
+    directions.push_back(1);
+    modes.push_back(mode);
+    clips.push_back(std::move(clip));
+    return clips.size() - 1;
+}
+
+void DxLibPp::AnimationBatch::Remove(std::size_t id) {
+    std::size_t last = clips.size() - 1;
+    if (id != last) {
+        remaining[id] = remaining[last];
+        speeds[id] = speeds[last];
+        indices[id] = indices[last];
+        directions[id] = directions[last];
+        modes[id] = modes[last];
+        clips[id] = std::move(clips[last]);
+    }
+    remaining.pop_back();
+    speeds.pop_back();
+    indices.pop_back();
+    directions.pop_back();
+    modes.pop_back();
+    clips.pop_back();
+}
+
+void DxLibPp::AnimationBatch::Clear() {
+    remaining.clear();
+    speeds.clear();
+    indices.clear();
+    directions.clear();
+    modes.clear();
+    clips.clear();
+    events.clear();
+}
+
+void DxLibPp::AnimationBatch::SetFrameIndex(std::size_t id, std::size_t index) {
+    indices[id] = static_cast<std::uint32_t>(index % clips[id]->GetFrameNumber());
+    directions[id] = 1;
+    remaining[id] = GetCurrentFrame(id).duration;
+}
+
+void DxLibPp::AnimationBatch::Update(double seconds) {
+    DXLIBPP_PROFILE_ZONE("AnimationBatch::Update");
+    events.clear();
+    std::size_t size = clips.size();
+    double * remaining_data = remaining.data();
+    const double * speed_data = speeds.data();
+    for (std::size_t i = 0; i < size; ++i)
+        remaining_data[i] -= seconds * speed_data[i];
+    for (std::size_t id = 0; id < size; ++id) {
+        if (remaining_data[id] > 0.0)
+            continue;
+        cross_frames(*clips[id], modes[id], indices[id], directions[id], remaining_data[id],
+            [&](AnimationEventType type, std::uint32_t frame) { events.push_back(AnimationEvent{id, frame, type}); });
+    }
+}
+
 struct DxLibPp::Font::impl_t {
     std::shared_ptr<int> handle{new int{-1}, &delete_handle};
     static void delete_handle(int * ptr) {
@@ -229,7 +1287,10 @@ void DxLibPp::Font::Load(std::string_view path, int size) {
 }
 
 void DxLibPp::Font::Draw() const {
-    DrawStringToHandle_s(static_cast<int>(x), static_cast<int>(y), text.data(), GetColor(255, 255, 255), *impl->handle); //TODO
+    DXLIBPP_PROFILE_ZONE("Font::Draw");
+    // Only the position follows the camera; DrawStringToHandle cannot scale or turn text.
+    Point screen = camera_state.camera.ToScreen(Point{x, y});
+    DrawStringToHandle_s(static_cast<int>(screen.x), static_cast<int>(screen.y), text.data(), GetColor(255, 255, 255), *impl->handle); //TODO
 }
 
 void DxLibPp::Font::Update() {}
@@ -242,57 +1303,427 @@ void DxLibPp::Global::ResolveAttachment() {
     for (auto & request : GetAttachmentResuests()) request();
 }
 
-bool DxLibPp::System::Update() {
-    update_key_state();
-    return ScreenFlip() != -1 && ProcessMessage() != -1 && ClearDrawScreen() != -1;
-}
+namespace {
 
-int DxLibPp::Screen::GetWidth() {
-    int width{}, height{}, color_bit_depth{};
-    GetScreenState_s(&width, &height, &color_bit_depth);
-    return width;
-}
+DxLibPp::FrameStats frame_stats;
+bool frame_stats_overlay = false;
 
-int DxLibPp::Screen::GetHeight() {
-    int width{}, height{}, color_bit_depth{};
-    GetScreenState_s(&width, &height, &color_bit_depth);
-    return height;
+void take_frame_stats() {
+    frame_stats.entries.clear();
+    frame_stats.total_calls = 0;
+    frame_stats.total_time = 0.0;
+    for (std::size_t i = 0; i < call_counter_count; ++i) {
+        call_counter_t & counter = *call_counters[i];
+        if (counter.calls == 0)
+            continue;
+        double time = std::chrono::duration<double>(counter.time).count();
+        frame_stats.entries.push_back({counter.name, counter.calls, time});
+        frame_stats.total_calls += counter.calls;
+        frame_stats.total_time += time;
+        counter.calls = 0;
+        counter.time = {};
+    }
 }
 
-struct DxLibPp::Sound::impl_t {
-    std::shared_ptr<int> handle{new int{-1}, &delete_handle};
-    static void delete_handle(int * ptr) {
-        if (*ptr != -1)
-            DeleteSoundMem_s(*ptr);
-        delete ptr;
+// Uses DxLib directly so the overlay does not show up in the stats it draws.
+void draw_frame_stats() {
+    constexpr int line_height = 16;
+    unsigned color = GetColor(255, 255, 255);
+    char line[128];
+    int y = 0;
+    std::snprintf(line, sizeof(line), "calls %u  %.3f ms", frame_stats.total_calls, frame_stats.total_time * 1.0e3);
+    DrawString(0, y, line, color);
+    for (const auto & entry : frame_stats.entries) {
+        y += line_height;
+        std::snprintf(line, sizeof(line), "%-28s %6u  %.3f ms", entry.name, entry.calls, entry.time * 1.0e3);
+        DrawString(0, y, line, color);
     }
-};
-
-DxLibPp::Sound::Sound()
-    : impl{std::make_unique<impl_t>()}
-{}
+}
 
-DxLibPp::Sound::Sound(std::string_view path) {
-    Load(path);
 }
 
-DxLibPp::Sound::Sound(const Sound & obj)
-    : impl{std::make_unique<impl_t>(*obj.impl)}
-{}
+namespace {
 
-DxLibPp::Sound::~Sound() {}
+struct run_state_t {
+    double timestep = 1.0 / 60.0;
+    int max_updates = 5;
+    double frame_rate_limit = 0.0;
+    double delta_time = 0.0;
+    LONGLONG last_update = -1;
+    bool quit = false;
+    DxLibPp::FrameMetrics metrics;
+} run_state;
 
-DxLibPp::Sound & DxLibPp::Sound::operator =(const Sound & obj) {
-    *impl = *obj.impl;
-    return *this;
+double seconds_since(LONGLONG start) {
+    return static_cast<double>(GetNowHiPerformanceCount() - start) * 1.0e-6;
 }
 
-void DxLibPp::Sound::Play(int play_type, bool top_position_flag) {
-    PlaySoundMem_s(*impl->handle, play_type, top_position_flag ? TRUE : FALSE);
+// Sleeps most of the remaining time and spins the last stretch, since sleep wakes up late by up to a
+// scheduler quantum.
+void wait_until(LONGLONG deadline) {
+    constexpr LONGLONG spin_microseconds = 2000;
+    LONGLONG remaining = deadline - GetNowHiPerformanceCount();
+    if (remaining > spin_microseconds)
+        std::this_thread::sleep_for(std::chrono::microseconds{remaining - spin_microseconds});
+    while (GetNowHiPerformanceCount() < deadline)
+        std::this_thread::yield();
 }
 
-void DxLibPp::Sound::Stop() {
-    StopSoundMem_s(*impl->handle);
+}
+
+bool DxLibPp::System::Update() {
+    DXLIBPP_PROFILE_ZONE("System::Update");
+    LONGLONG now = GetNowHiPerformanceCount();
+    if (run_state.last_update >= 0)
+        run_state.delta_time = static_cast<double>(now - run_state.last_update) * 1.0e-6;
+    run_state.last_update = now;
+    if (call_stats_enabled) {
+        take_frame_stats();
+        if (frame_stats_overlay)
+            draw_frame_stats();
+    }
+    camera_state.last = CullStats{camera_state.drawn, camera_state.culled};
+    camera_state.drawn = camera_state.culled = 0;
+    update_key_state();
+    return ScreenFlip() != -1 && ProcessMessage() != -1 && ClearDrawScreen() != -1;
+}
+
+void DxLibPp::System::Run(const std::function<void()> & update, const std::function<void(double alpha)> & draw) {
+    run_state.quit = false;
+    run_state.metrics = FrameMetrics{};
+    LONGLONG frame_start = GetNowHiPerformanceCount();
+    double accumulator = 0.0;
+    while (!run_state.quit && Update()) {
+        LONGLONG now = GetNowHiPerformanceCount();
+        FrameMetrics & metrics = run_state.metrics;
+        metrics.frame_time = static_cast<double>(now - frame_start) * 1.0e-6;
+        frame_start = now;
+        accumulator += metrics.frame_time;
+
+        metrics.update_count = 0;
+        run_state.delta_time = run_state.timestep;
+        {
+            DXLIBPP_PROFILE_ZONE("System::Run update");
+            while (accumulator >= run_state.timestep && metrics.update_count < run_state.max_updates && !run_state.quit) {
+                update();
+                accumulator -= run_state.timestep;
+                ++metrics.update_count;
+            }
+        }
+        if (accumulator >= run_state.timestep) {
+            accumulator = std::fmod(accumulator, run_state.timestep);
+            ++metrics.dropped_frames;
+        }
+        metrics.update_time = seconds_since(now);
+        run_state.delta_time = metrics.frame_time;
+
+        metrics.alpha = accumulator / run_state.timestep;
+        LONGLONG draw_start = GetNowHiPerformanceCount();
+        {
+            DXLIBPP_PROFILE_ZONE("System::Run draw");
+            draw(metrics.alpha);
+        }
+        metrics.draw_time = seconds_since(draw_start);
+        ++metrics.frame_count;
+
+        if (run_state.frame_rate_limit > 0.0)
+            wait_until(frame_start + static_cast<LONGLONG>(1.0e6 / run_state.frame_rate_limit));
+    }
+}
+
+void DxLibPp::System::Quit() noexcept {
+    run_state.quit = true;
+}
+
+void DxLibPp::System::SetTimestep(double seconds) {
+    if (!(seconds > 0.0))
+        throw std::invalid_argument("System timestep must be positive.");
+    run_state.timestep = seconds;
+}
+
+double DxLibPp::System::GetTimestep() noexcept {
+    return run_state.timestep;
+}
+
+void DxLibPp::System::SetMaxUpdatesPerFrame(int count) {
+    if (count < 1)
+        throw std::invalid_argument("System must run at least one update per frame.");
+    run_state.max_updates = count;
+}
+
+int DxLibPp::System::GetMaxUpdatesPerFrame() noexcept {
+    return run_state.max_updates;
+}
+
+void DxLibPp::System::SetFrameRateLimit(double frames_per_second) {
+    run_state.frame_rate_limit = (std::max)(frames_per_second, 0.0);
+}
+
+double DxLibPp::System::GetFrameRateLimit() noexcept {
+    return run_state.frame_rate_limit;
+}
+
+double DxLibPp::System::GetDeltaTime() noexcept {
+    return run_state.delta_time;
+}
+
+const DxLibPp::FrameMetrics & DxLibPp::System::GetFrameMetrics() noexcept {
+    return run_state.metrics;
+}
+
+void DxLibPp::System::SetFrameStatsEnabled(bool enabled) noexcept {
+    if (enabled && !call_stats_enabled) {
+        for (std::size_t i = 0; i < call_counter_count; ++i) {
+            call_counters[i]->calls = 0;
+            call_counters[i]->time = {};
+        }
+    }
+    call_stats_enabled = enabled;
+    if (!enabled)
+        frame_stats = FrameStats{};
+}
+
+bool DxLibPp::System::IsFrameStatsEnabled() noexcept {
+    return call_stats_enabled;
+}
+
+const DxLibPp::FrameStats & DxLibPp::System::GetFrameStats() noexcept {
+    return frame_stats;
+}
+
+void DxLibPp::System::SetFrameStatsOverlay(bool visible) noexcept {
+    frame_stats_overlay = visible;
+}
+
+namespace {
+
+struct profiler_ring_t {
+    DxLibPp::SpscQueue<DxLibPp::Profiler::Zone, DxLibPp::Profiler::RING_SIZE> zones;
+};
+
+struct profiler_t {
+    std::atomic<bool> enabled{true};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::atomic<std::uint64_t> dropped{};
+    std::mutex mutex;
+    std::vector<std::shared_ptr<profiler_ring_t>> rings; // index is the thread id of the zones
+    std::vector<DxLibPp::Profiler::Zone> zones;
+} profiler;
+
+thread_local std::uint32_t profiler_depth = 0;
+
+// Rings stay registered after their thread exits so its last zones can still be collected.
+std::pair<profiler_ring_t *, std::uint32_t> profiler_ring() {
+    thread_local std::pair<profiler_ring_t *, std::uint32_t> ring = [] {
+        auto created = std::make_shared<profiler_ring_t>();
+        std::lock_guard<std::mutex> lock{profiler.mutex};
+        profiler.rings.push_back(created);
+        return std::make_pair(created.get(), static_cast<std::uint32_t>(profiler.rings.size() - 1));
+    }();
+    return ring;
+}
+
+void write_json_string(std::ofstream & file, const char * text) {
+    file << '"';
+    for (; *text != '\0'; ++text) {
+        if (*text == '"' || *text == '\\')
+            file << '\\';
+        file << *text;
+    }
+    file << '"';
+}
+
+}
+
+void DxLibPp::Profiler::SetEnabled(bool enabled) noexcept {
+    profiler.enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool DxLibPp::Profiler::IsEnabled() noexcept {
+    return profiler.enabled.load(std::memory_order_relaxed);
+}
+
+std::int64_t DxLibPp::Profiler::GetTime() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler.epoch).count();
+}
+
+void DxLibPp::Profiler::Record(const char * name, std::int64_t begin, std::int64_t end, std::uint32_t depth) noexcept {
+    auto [ring, thread] = profiler_ring();
+    if (!ring->zones.Push(Zone{name, begin, end, thread, depth}))
+        profiler.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DxLibPp::Profiler::Collect() {
+    std::lock_guard<std::mutex> lock{profiler.mutex};
+    Zone zone;
+    for (auto & ring : profiler.rings)
+        while (ring->zones.Pop(zone))
+            profiler.zones.push_back(zone);
+}
+
+const std::vector<DxLibPp::Profiler::Zone> & DxLibPp::Profiler::GetZones() noexcept {
+    return profiler.zones;
+}
+
+std::uint64_t DxLibPp::Profiler::GetDroppedCount() noexcept {
+    return profiler.dropped.load(std::memory_order_relaxed);
+}
+
+void DxLibPp::Profiler::Clear() {
+    Collect();
+    profiler.zones.clear();
+    profiler.dropped.store(0, std::memory_order_relaxed);
+}
+
+void DxLibPp::Profiler::ExportChromeTrace(std::string_view path) {
+    Collect();
+    std::ofstream file{std::string{path}};
+    file << "{\"traceEvents\":[";
+    const char * separator = "\n";
+    char number[64];
+    for (const Zone & zone : profiler.zones) {
+        file << separator << "{\"name\":";
+        write_json_string(file, zone.name);
+        std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", zone.begin * 1.0e-3, (zone.end - zone.begin) * 1.0e-3);
+        file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << zone.thread << ",\"ts\":" << number << "}";
+        separator = ",\n";
+    }
+    file << "\n]}\n";
+    if (!file)
+        throw std::runtime_error("Profiler::ExportChromeTrace failed.");
+}
+
+// Binary layout: magic "DXPF", version byte, varint name count, names as (varint length, bytes), varint
+// zone count, then zones sorted by begin as varints of (name index, thread, depth, begin delta, duration).
+void DxLibPp::Profiler::ExportBinary(std::string_view path) {
+    Collect();
+    std::vector<Zone> zones = profiler.zones;
+    std::sort(zones.begin(), zones.end(), [](const Zone & a, const Zone & b) { return a.begin < b.begin; });
+    std::vector<const char *> names;
+    std::vector<std::uint32_t> name_indexes;
+    name_indexes.reserve(zones.size());
+    for (const Zone & zone : zones) {
+        auto found = std::find_if(names.begin(), names.end(), [&](const char * name) { return name == zone.name || std::strcmp(name, zone.name) == 0; });
+        if (found == names.end())
+            found = names.insert(names.end(), zone.name);
+        name_indexes.push_back(static_cast<std::uint32_t>(found - names.begin()));
+    }
+
+    std::vector<std::uint8_t> data{'D', 'X', 'P', 'F', 1};
+    write_varint(data, names.size());
+    for (const char * name : names) {
+        std::size_t length = std::strlen(name);
+        write_varint(data, length);
+        data.insert(data.end(), name, name + length);
+    }
+    write_varint(data, zones.size());
+    std::int64_t previous = 0;
+    for (std::size_t i = 0; i < zones.size(); ++i) {
+        write_varint(data, name_indexes[i]);
+        write_varint(data, zones[i].thread);
+        write_varint(data, zones[i].depth);
+        write_varint(data, static_cast<std::uint64_t>(zones[i].begin - previous));
+        write_varint(data, static_cast<std::uint64_t>(zones[i].end - zones[i].begin));
+        previous = zones[i].begin;
+    }
+
+    std::ofstream file{std::string{path}, std::ios::binary};
+    file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file)
+        throw std::runtime_error("Profiler::ExportBinary failed.");
+}
+
+DxLibPp::ProfileScope::ProfileScope(const char * name) noexcept
+    : name{Profiler::IsEnabled() ? name : nullptr}
+    , begin{}
+{
+    if (this->name) {
+        ++profiler_depth;
+        begin = Profiler::GetTime();
+    }
+}
+
+DxLibPp::ProfileScope::~ProfileScope() {
+    if (name) {
+        std::int64_t end = Profiler::GetTime();
+        Profiler::Record(name, begin, end, --profiler_depth);
+    }
+}
+
+int DxLibPp::Screen::GetWidth() {
+    int width{}, height{}, color_bit_depth{};
+    GetScreenState_s(&width, &height, &color_bit_depth);
+    return width;
+}
+
+int DxLibPp::Screen::GetHeight() {
+    int width{}, height{}, color_bit_depth{};
+    GetScreenState_s(&width, &height, &color_bit_depth);
+    return height;
+}
+
+void DxLibPp::Screen::SetCamera(const Camera & camera) {
+    camera_state.camera = camera;
+    camera_state.view = camera.GetView(GetWidth(), GetHeight());
+    camera_state.culling = true;
+}
+
+void DxLibPp::Screen::ResetCamera() {
+    camera_state.camera = Camera{};
+    camera_state.view = Rect{};
+    camera_state.culling = false;
+}
+
+const DxLibPp::Camera & DxLibPp::Screen::GetCamera() {
+    return camera_state.camera;
+}
+
+const DxLibPp::Rect & DxLibPp::Screen::GetView() {
+    return camera_state.view;
+}
+
+bool DxLibPp::Screen::IsVisible(const Rect & r) {
+    return !camera_state.culling || camera_state.view.intersects(r);
+}
+
+const DxLibPp::CullStats & DxLibPp::Screen::GetCullStats() {
+    return camera_state.last;
+}
+
+struct DxLibPp::Sound::impl_t {
+    std::shared_ptr<int> handle{new int{-1}, &delete_handle};
+    static void delete_handle(int * ptr) {
+        if (*ptr != -1)
+            DeleteSoundMem_s(*ptr);
+        delete ptr;
+    }
+};
+
+DxLibPp::Sound::Sound()
+    : impl{std::make_unique<impl_t>()}
+{}
+
+DxLibPp::Sound::Sound(std::string_view path) {
+    Load(path);
+}
+
+DxLibPp::Sound::Sound(const Sound & obj)
+    : impl{std::make_unique<impl_t>(*obj.impl)}
+{}
+
+DxLibPp::Sound::~Sound() {}
+
+DxLibPp::Sound & DxLibPp::Sound::operator =(const Sound & obj) {
+    *impl = *obj.impl;
+    return *this;
+}
+
+void DxLibPp::Sound::Play(int play_type, bool top_position_flag) {
+    PlaySoundMem_s(*impl->handle, play_type, top_position_flag ? TRUE : FALSE);
+}
+
+void DxLibPp::Sound::Stop() {
+    StopSoundMem_s(*impl->handle);
 }
 
 void DxLibPp::Sound::Load(std::string_view path) {
@@ -304,118 +1735,1750 @@ bool DxLibPp::Sound::Check() const {
     return CheckSoundMem_s(*impl->handle) ? true : false;
 }
 
-bool DxLibPp::Key::CheckHit(int key_code) {
-    if (key_code < 0 || key_code >= 256)
-        throw std::runtime_error("key_code must be [0, 255].");
-    return key_state[key_code] ? true : false;
-}
-
-int DxLibPp::Key::GetTimer(int key_code) {
-    return key_timer[key_code];
-}
-
-const int DxLibPp::Key::INPUT_BACK = KEY_INPUT_BACK;
-const int DxLibPp::Key::INPUT_TAB = KEY_INPUT_TAB;
-const int DxLibPp::Key::INPUT_RETURN = KEY_INPUT_RETURN;
-
-const int DxLibPp::Key::INPUT_LSHIFT = KEY_INPUT_LSHIFT;
-const int DxLibPp::Key::INPUT_RSHIFT = KEY_INPUT_RSHIFT;
-const int DxLibPp::Key::INPUT_LCONTROL = KEY_INPUT_LCONTROL;
-const int DxLibPp::Key::INPUT_RCONTROL = KEY_INPUT_RCONTROL;
-const int DxLibPp::Key::INPUT_ESCAPE = KEY_INPUT_ESCAPE;
-const int DxLibPp::Key::INPUT_SPACE = KEY_INPUT_SPACE;
-const int DxLibPp::Key::INPUT_PGUP = KEY_INPUT_PGUP;
-const int DxLibPp::Key::INPUT_PGDN = KEY_INPUT_PGDN;
-const int DxLibPp::Key::INPUT_END = KEY_INPUT_END;
-const int DxLibPp::Key::INPUT_HOME = KEY_INPUT_HOME;
-const int DxLibPp::Key::INPUT_LEFT = KEY_INPUT_LEFT;
-const int DxLibPp::Key::INPUT_UP = KEY_INPUT_UP;
-const int DxLibPp::Key::INPUT_RIGHT = KEY_INPUT_RIGHT;
-const int DxLibPp::Key::INPUT_DOWN = KEY_INPUT_DOWN;
-const int DxLibPp::Key::INPUT_INSERT = KEY_INPUT_INSERT;
-const int DxLibPp::Key::INPUT_DELETE = KEY_INPUT_DELETE;
-
-const int DxLibPp::Key::INPUT_MINUS = KEY_INPUT_MINUS;
-const int DxLibPp::Key::INPUT_YEN = KEY_INPUT_YEN;
-const int DxLibPp::Key::INPUT_PREVTRACK = KEY_INPUT_PREVTRACK;
-const int DxLibPp::Key::INPUT_PERIOD = KEY_INPUT_PERIOD;
-const int DxLibPp::Key::INPUT_SLASH = KEY_INPUT_SLASH;
-const int DxLibPp::Key::INPUT_LALT = KEY_INPUT_LALT;
-const int DxLibPp::Key::INPUT_RALT = KEY_INPUT_RALT;
-const int DxLibPp::Key::INPUT_SCROLL = KEY_INPUT_SCROLL;
-const int DxLibPp::Key::INPUT_SEMICOLON = KEY_INPUT_SEMICOLON;
-const int DxLibPp::Key::INPUT_COLON = KEY_INPUT_COLON;
-const int DxLibPp::Key::INPUT_LBRACKET = KEY_INPUT_LBRACKET;
-const int DxLibPp::Key::INPUT_RBRACKET = KEY_INPUT_RBRACKET;
-const int DxLibPp::Key::INPUT_AT = KEY_INPUT_AT;
-const int DxLibPp::Key::INPUT_BACKSLASH = KEY_INPUT_BACKSLASH;
-const int DxLibPp::Key::INPUT_COMMA = KEY_INPUT_COMMA;
-const int DxLibPp::Key::INPUT_CAPSLOCK = KEY_INPUT_CAPSLOCK;
-const int DxLibPp::Key::INPUT_PAUSE = KEY_INPUT_PAUSE;
-
-const int DxLibPp::Key::INPUT_NUMPAD0 = KEY_INPUT_NUMPAD0;
-const int DxLibPp::Key::INPUT_NUMPAD1 = KEY_INPUT_NUMPAD1;
-const int DxLibPp::Key::INPUT_NUMPAD2 = KEY_INPUT_NUMPAD2;
-const int DxLibPp::Key::INPUT_NUMPAD3 = KEY_INPUT_NUMPAD3;
-const int DxLibPp::Key::INPUT_NUMPAD4 = KEY_INPUT_NUMPAD4;
-const int DxLibPp::Key::INPUT_NUMPAD5 = KEY_INPUT_NUMPAD5;
-const int DxLibPp::Key::INPUT_NUMPAD6 = KEY_INPUT_NUMPAD6;
-const int DxLibPp::Key::INPUT_NUMPAD7 = KEY_INPUT_NUMPAD7;
-const int DxLibPp::Key::INPUT_NUMPAD8 = KEY_INPUT_NUMPAD8;
-const int DxLibPp::Key::INPUT_NUMPAD9 = KEY_INPUT_NUMPAD9;
-const int DxLibPp::Key::INPUT_MULTIPLY = KEY_INPUT_MULTIPLY;
-const int DxLibPp::Key::INPUT_ADD = KEY_INPUT_ADD;
-const int DxLibPp::Key::INPUT_SUBTRACT = KEY_INPUT_SUBTRACT;
-const int DxLibPp::Key::INPUT_DECIMAL = KEY_INPUT_DECIMAL;
-const int DxLibPp::Key::INPUT_DIVIDE = KEY_INPUT_DIVIDE;
-const int DxLibPp::Key::INPUT_NUMPADENTER = KEY_INPUT_NUMPADENTER;
-
-const int DxLibPp::Key::INPUT_F1 = KEY_INPUT_F1;
-const int DxLibPp::Key::INPUT_F2 = KEY_INPUT_F2;
-const int DxLibPp::Key::INPUT_F3 = KEY_INPUT_F3;
-const int DxLibPp::Key::INPUT_F4 = KEY_INPUT_F4;
-const int DxLibPp::Key::INPUT_F5 = KEY_INPUT_F5;
-const int DxLibPp::Key::INPUT_F6 = KEY_INPUT_F6;
-const int DxLibPp::Key::INPUT_F7 = KEY_INPUT_F7;
-const int DxLibPp::Key::INPUT_F8 = KEY_INPUT_F8;
-const int DxLibPp::Key::INPUT_F9 = KEY_INPUT_F9;
-const int DxLibPp::Key::INPUT_F10 = KEY_INPUT_F10;
-const int DxLibPp::Key::INPUT_F11 = KEY_INPUT_F11;
-const int DxLibPp::Key::INPUT_F12 = KEY_INPUT_F12;
-
-const int DxLibPp::Key::INPUT_A = KEY_INPUT_A;
-const int DxLibPp::Key::INPUT_B = KEY_INPUT_B;
-const int DxLibPp::Key::INPUT_C = KEY_INPUT_C;
-const int DxLibPp::Key::INPUT_D = KEY_INPUT_D;
-const int DxLibPp::Key::INPUT_E = KEY_INPUT_E;
-const int DxLibPp::Key::INPUT_F = KEY_INPUT_F;
-const int DxLibPp::Key::INPUT_G = KEY_INPUT_G;
-const int DxLibPp::Key::INPUT_H = KEY_INPUT_H;
-const int DxLibPp::Key::INPUT_I = KEY_INPUT_I;
-const int DxLibPp::Key::INPUT_J = KEY_INPUT_J;
-const int DxLibPp::Key::INPUT_K = KEY_INPUT_K;
-const int DxLibPp::Key::INPUT_L = KEY_INPUT_L;
-const int DxLibPp::Key::INPUT_M = KEY_INPUT_M;
-const int DxLibPp::Key::INPUT_N = KEY_INPUT_N;
-const int DxLibPp::Key::INPUT_O = KEY_INPUT_O;
-const int DxLibPp::Key::INPUT_P = KEY_INPUT_P;
-const int DxLibPp::Key::INPUT_Q = KEY_INPUT_Q;
-const int DxLibPp::Key::INPUT_R = KEY_INPUT_R;
-const int DxLibPp::Key::INPUT_S = KEY_INPUT_S;
-const int DxLibPp::Key::INPUT_T = KEY_INPUT_T;
-const int DxLibPp::Key::INPUT_U = KEY_INPUT_U;
-const int DxLibPp::Key::INPUT_V = KEY_INPUT_V;
-const int DxLibPp::Key::INPUT_W = KEY_INPUT_W;
-const int DxLibPp::Key::INPUT_X = KEY_INPUT_X;
-const int DxLibPp::Key::INPUT_Y = KEY_INPUT_Y;
-const int DxLibPp::Key::INPUT_Z = KEY_INPUT_Z;
-const int DxLibPp::Key::INPUT_0 = KEY_INPUT_0;
-const int DxLibPp::Key::INPUT_1 = KEY_INPUT_1;
-const int DxLibPp::Key::INPUT_2 = KEY_INPUT_2;
-const int DxLibPp::Key::INPUT_3 = KEY_INPUT_3;
-const int DxLibPp::Key::INPUT_4 = KEY_INPUT_4;
-const int DxLibPp::Key::INPUT_5 = KEY_INPUT_5;
-const int DxLibPp::Key::INPUT_6 = KEY_INPUT_6;
-const int DxLibPp::Key::INPUT_7 = KEY_INPUT_7;
-const int DxLibPp::Key::INPUT_8 = KEY_INPUT_8;
-const int DxLibPp::Key::INPUT_9 = KEY_INPUT_9;
+DxLibPp::InputSnapshot::InputSnapshot(const InputSnapshot & previous, const bits_type & down) noexcept
+    : down{down}
+    , frame{previous.frame + 1}
+    , press_frames{previous.press_frames}
+{
+    for (std::size_t i = 0; i < down.size(); ++i) {
+        pressed[i] = down[i] & ~previous.down[i];
+        released[i] = ~down[i] & previous.down[i];
+        for (std::uint64_t word = pressed[i]; word != 0; word &= word - 1)
+            press_frames[i * 64 + count_trailing_zeros(word)] = frame;
+    }
+}
+
+DxLibPp::InputSnapshot::InputSnapshot(const InputSnapshot & previous, const char * key_state) noexcept
+    : InputSnapshot(previous, pack_key_state(key_state))
+{}
+
+void DxLibPp::InputSnapshot::SetPad(const InputSnapshot & previous, int index, std::uint32_t buttons, float x, float y) noexcept {
+    if (static_cast<unsigned>(index) >= PAD_COUNT)
+        return;
+    std::uint32_t last = previous.pads[index].down;
+    pads[index] = Pad{buttons, buttons & ~last, ~buttons & last, x, y};
+}
+
+void DxLibPp::InputSnapshot::SetMouse(const InputSnapshot & previous, int x, int y, std::uint32_t buttons) noexcept {
+    std::uint32_t last = previous.mouse.down;
+    mouse = Mouse{x, y, buttons, buttons & ~last, ~buttons & last};
+}
+
+const DxLibPp::InputSnapshot & DxLibPp::Key::GetSnapshot() noexcept {
+    return key_snapshots[current_key_snapshot];
+}
+
+bool DxLibPp::Key::CheckHit(int key_code) noexcept {
+    return GetSnapshot().IsDown(key_code);
+}
+
+bool DxLibPp::Key::CheckPressed(int key_code) noexcept {
+    return GetSnapshot().IsPressed(key_code);
+}
+
+bool DxLibPp::Key::CheckReleased(int key_code) noexcept {
+    return GetSnapshot().IsReleased(key_code);
+}
+
+int DxLibPp::Key::GetTimer(int key_code) noexcept {
+    return GetSnapshot().GetTimer(key_code);
+}
+
+void DxLibPp::InputRecorder::Start() {
+    input_recorder = input_recorder_t{};
+    input_recorder.data.assign(std::begin(input_stream_magic), std::end(input_stream_magic));
+    input_recorder.active = true;
+}
+
+std::vector<std::uint8_t> DxLibPp::InputRecorder::Stop() {
+    if (!input_recorder.active)
+        return {};
+    write_varint(input_recorder.data, input_recorder.unchanged);
+    write_varint(input_recorder.data, 0);
+    input_recorder.active = false;
+    return std::move(input_recorder.data);
+}
+
+void DxLibPp::InputRecorder::Save(std::string_view path) {
+    std::vector<std::uint8_t> data = Stop();
+    std::ofstream file{std::string{path}, std::ios::binary};
+    file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file)
+        throw std::runtime_error("InputRecorder::Save failed.");
+}
+
+bool DxLibPp::InputRecorder::IsRecording() noexcept {
+    return input_recorder.active;
+}
+
+std::uint32_t DxLibPp::InputRecorder::GetFrameCount() noexcept {
+    return input_recorder.frames;
+}
+
+void DxLibPp::InputReplayer::Start(std::vector<std::uint8_t> data) {
+    input_replayer_t replayer;
+    replayer.data = std::move(data);
+    replayer.position = sizeof(input_stream_magic);
+    if (replayer.data.size() < sizeof(input_stream_magic)
+        || !std::equal(std::begin(input_stream_magic), std::end(input_stream_magic), replayer.data.begin())
+        || !replayer.read_record())
+        throw std::runtime_error("InputReplayer::Start received an invalid input stream.");
+    replayer.active = true;
+    input_replayer = std::move(replayer);
+}
+
+void DxLibPp::InputReplayer::Load(std::string_view path) {
+    std::ifstream file{std::string{path}, std::ios::binary};
+    if (!file)
+        throw std::runtime_error("InputReplayer::Load failed.");
+    Start(std::vector<std::uint8_t>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}});
+}
+
+void DxLibPp::InputReplayer::Stop() noexcept {
+    input_replayer.active = false;
+}
+
+bool DxLibPp::InputReplayer::IsReplaying() noexcept {
+    return input_replayer.active;
+}
+
+void DxLibPp::InputEvents::StartPolling(int interval_microseconds) {
+    if (input_events.polling.load(std::memory_order_relaxed))
+        return;
+    input_events.polling.store(true, std::memory_order_release);
+    input_events.poller = std::thread{[interval_microseconds] { input_events.poll(interval_microseconds); }};
+}
+
+void DxLibPp::InputEvents::StopPolling() {
+    if (!input_events.polling.load(std::memory_order_relaxed))
+        return;
+    input_events.polling.store(false, std::memory_order_release);
+    input_events.poller.join();
+}
+
+bool DxLibPp::InputEvents::IsPolling() noexcept {
+    return input_events.polling.load(std::memory_order_relaxed);
+}
+
+void DxLibPp::InputEvents::Poll() {
+    if (input_events.polling.load(std::memory_order_relaxed))
+        return;
+    GetHitKeyStateAll_s(key_state);
+    input_events.emit(pack_key_state(key_state), GetNowHiPerformanceCount());
+}
+
+bool DxLibPp::InputEvents::Pop(InputEvent & event) noexcept {
+    return input_events.queue.Pop(event);
+}
+
+std::uint64_t DxLibPp::InputEvents::GetDroppedCount() noexcept {
+    return input_events.dropped.load(std::memory_order_relaxed);
+}
+
+#define CHECK_KEY_CODE(name) static_assert(DxLibPp::Key::INPUT_##name == KEY_INPUT_##name, "Key::INPUT_" #name " does not match DxLib.");
+CHECK_KEY_CODE(BACK)
+CHECK_KEY_CODE(TAB)
+CHECK_KEY_CODE(RETURN)
+
+CHECK_KEY_CODE(LSHIFT)
+CHECK_KEY_CODE(RSHIFT)
+CHECK_KEY_CODE(LCONTROL)
+CHECK_KEY_CODE(RCONTROL)
+CHECK_KEY_CODE(ESCAPE)
+CHECK_KEY_CODE(SPACE)
+CHECK_KEY_CODE(PGUP)
+CHECK_KEY_CODE(PGDN)
+CHECK_KEY_CODE(END)
+CHECK_KEY_CODE(HOME)
+CHECK_KEY_CODE(LEFT)
+CHECK_KEY_CODE(UP)
+CHECK_KEY_CODE(RIGHT)
+CHECK_KEY_CODE(DOWN)
+CHECK_KEY_CODE(INSERT)
+CHECK_KEY_CODE(DELETE)
+
+CHECK_KEY_CODE(MINUS)
+CHECK_KEY_CODE(YEN)
+CHECK_KEY_CODE(PREVTRACK)
+CHECK_KEY_CODE(PERIOD)
+CHECK_KEY_CODE(SLASH)
+CHECK_KEY_CODE(LALT)
+CHECK_KEY_CODE(RALT)
+CHECK_KEY_CODE(SCROLL)
+CHECK_KEY_CODE(SEMICOLON)
+CHECK_KEY_CODE(COLON)
+CHECK_KEY_CODE(LBRACKET)
+CHECK_KEY_CODE(RBRACKET)
+CHECK_KEY_CODE(AT)
+CHECK_KEY_CODE(BACKSLASH)
+CHECK_KEY_CODE(COMMA)
+CHECK_KEY_CODE(CAPSLOCK)
+CHECK_KEY_CODE(PAUSE)
+
+CHECK_KEY_CODE(NUMPAD0)
+CHECK_KEY_CODE(NUMPAD1)
+CHECK_KEY_CODE(NUMPAD2)
+CHECK_KEY_CODE(NUMPAD3)
+CHECK_KEY_CODE(NUMPAD4)
+CHECK_KEY_CODE(NUMPAD5)
+CHECK_KEY_CODE(NUMPAD6)
+CHECK_KEY_CODE(NUMPAD7)
+CHECK_KEY_CODE(NUMPAD8)
+CHECK_KEY_CODE(NUMPAD9)
+CHECK_KEY_CODE(MULTIPLY)
+CHECK_KEY_CODE(ADD)
+CHECK_KEY_CODE(SUBTRACT)
+CHECK_KEY_CODE(DECIMAL)
+CHECK_KEY_CODE(DIVIDE)
+CHECK_KEY_CODE(NUMPADENTER)
+
+CHECK_KEY_CODE(F1)
+CHECK_KEY_CODE(F2)
+CHECK_KEY_CODE(F3)
+CHECK_KEY_CODE(F4)
+CHECK_KEY_CODE(F5)
+CHECK_KEY_CODE(F6)
+CHECK_KEY_CODE(F7)
+CHECK_KEY_CODE(F8)
+CHECK_KEY_CODE(F9)
+CHECK_KEY_CODE(F10)
+CHECK_KEY_CODE(F11)
+CHECK_KEY_CODE(F12)
+
+CHECK_KEY_CODE(A)
+CHECK_KEY_CODE(B)
+CHECK_KEY_CODE(C)
+CHECK_KEY_CODE(D)
+CHECK_KEY_CODE(E)
+CHECK_KEY_CODE(F)
+CHECK_KEY_CODE(G)
+CHECK_KEY_CODE(H)
+CHECK_KEY_CODE(I)
+CHECK_KEY_CODE(J)
+CHECK_KEY_CODE(K)
+CHECK_KEY_CODE(L)
+CHECK_KEY_CODE(M)
+CHECK_KEY_CODE(N)
+CHECK_KEY_CODE(O)
+CHECK_KEY_CODE(P)
+CHECK_KEY_CODE(Q)
+CHECK_KEY_CODE(R)
+CHECK_KEY_CODE(S)
+CHECK_KEY_CODE(T)
+CHECK_KEY_CODE(U)
+CHECK_KEY_CODE(V)
+CHECK_KEY_CODE(W)
+CHECK_KEY_CODE(X)
+CHECK_KEY_CODE(Y)
+CHECK_KEY_CODE(Z)
+CHECK_KEY_CODE(0)
+CHECK_KEY_CODE(1)
+CHECK_KEY_CODE(2)
+CHECK_KEY_CODE(3)
+CHECK_KEY_CODE(4)
+CHECK_KEY_CODE(5)
+CHECK_KEY_CODE(6)
+CHECK_KEY_CODE(7)
+CHECK_KEY_CODE(8)
+CHECK_KEY_CODE(9)
+#undef CHECK_KEY_CODE
+
+static_assert(DxLibPp::Joypad::INPUT_DOWN == PAD_INPUT_DOWN && DxLibPp::Joypad::INPUT_LEFT == PAD_INPUT_LEFT
+    && DxLibPp::Joypad::INPUT_RIGHT == PAD_INPUT_RIGHT && DxLibPp::Joypad::INPUT_UP == PAD_INPUT_UP
+    && DxLibPp::Joypad::INPUT_A == PAD_INPUT_A && DxLibPp::Joypad::INPUT_M == PAD_INPUT_M,
+    "Joypad::INPUT_* do not match DxLib.");
+static_assert(DxLibPp::Mouse::INPUT_LEFT == MOUSE_INPUT_LEFT && DxLibPp::Mouse::INPUT_RIGHT == MOUSE_INPUT_RIGHT
+    && DxLibPp::Mouse::INPUT_MIDDLE == MOUSE_INPUT_MIDDLE,
+    "Mouse::INPUT_* do not match DxLib.");
+
+int DxLibPp::Joypad::GetCount() noexcept {
+    return joypad_count;
+}
+
+void DxLibPp::Joypad::SetDeadZone(float dead_zone) noexcept {
+    joypad_dead_zone = (std::min)((std::max)(dead_zone, 0.0f), 0.99f);
+}
+
+float DxLibPp::Joypad::GetDeadZone() noexcept {
+    return joypad_dead_zone;
+}
+
+void DxLibPp::TiledMap::SetWidth(double width) {
+    if (column_number == 0)
+        throw std::logic_error("TiledMap without columns cannot be resized.");
+    column_width = width / column_number;
+}
+
+void DxLibPp::TiledMap::SetHeight(double height) {
+    if (row_number == 0)
+        throw std::logic_error("TiledMap without rows cannot be resized.");
+    row_height = height / row_number;
+}
+
+// Validated up front, so an out-of-range cell leaves both the tiles and the collision layer untouched.
+void DxLibPp::TiledMap::SetGraphIndex(std::size_t x, std::size_t y, std::size_t graph_index) {
+    if (x >= column_number || y >= row_number)
+        throw std::out_of_range("TiledMap cell is out of range.");
+    collision.SetSolid(static_cast<int>(x), static_cast<int>(y), (GetTileFlags(graph_index) & TILE_SOLID) != 0);
+    graph_indexes[column_number * y + x] = graph_index;
+}
+
+void DxLibPp::TiledMap::SetTileFlags(std::size_t graph_index, unsigned flags) {
+    if (graph_index == EMPTY)
+        throw std::logic_error("EMPTY tile cannot have flags.");
+    if (graph_index >= tile_flags.size())
+        tile_flags.resize(graph_index + 1);
+    if (tile_flags[graph_index] == flags)
+        return;
+    tile_flags[graph_index] = flags;
+    bool solid = (flags & TILE_SOLID) != 0;
+    for (std::size_t i = 0; i < graph_indexes.size(); ++i)
+        if (graph_indexes[i] == graph_index)
+            collision.SetSolid(static_cast<int>(i % column_number), static_cast<int>(i / column_number), solid);
+}
+
+void DxLibPp::TiledMap::resize() {
+    graph_indexes.resize(column_number * row_number, EMPTY);
+    collision.Resize(static_cast<int>(column_number), static_cast<int>(row_number));
+    for (std::size_t i = 0; i < graph_indexes.size(); ++i)
+        if (GetTileFlags(graph_indexes[i]) & TILE_SOLID)
+            collision.SetSolid(static_cast<int>(i % column_number), static_cast<int>(i / column_number), true);
+}
+
+void DxLibPp::TiledMap::Draw() const {
+    DXLIBPP_PROFILE_ZONE("TiledMap::Draw");
+    double first_column = 0.0, first_row = 0.0;
+    double last_column = static_cast<double>(GetColumnNumber()), last_row = static_cast<double>(GetRowNumber());
+    if (camera_state.culling) {
+        // Clamped as doubles, since a far-out view can overflow int.
+        const Rect & view = camera_state.view;
+        first_column = (std::max)(first_column, std::floor((view.GetX() - GetX()) / GetColumnWidth()));
+        first_row = (std::max)(first_row, std::floor((view.GetY() - GetY()) / GetRowHeight()));
+        last_column = (std::min)(last_column, std::ceil((view.GetX() + view.GetWidth() - GetX()) / GetColumnWidth()));
+        last_row = (std::min)(last_row, std::ceil((view.GetY() + view.GetHeight() - GetY()) / GetRowHeight()));
+    }
+    for (double row = first_row; row < last_row; ++row) {
+        for (double column = first_column; column < last_column; ++column) {
+            std::size_t graph_index = GetGraphIndex(static_cast<std::size_t>(column), static_cast<std::size_t>(row));
+            if (graph_index != EMPTY) {
+                auto g = Graph(GetGraph(graph_index));
+                g.SetX(GetX() + GetColumnWidth() * column);
+                g.SetY(GetY() + GetRowHeight() * row);
+                g.SetWidth(GetColumnWidth());
+                g.SetHeight(GetRowHeight());
+                g.Draw();
+            }
+        }
+    }
+}
+
+void DxLibPp::TiledMap::get_cell_range(const Rect & r, int & x0, int & y0, int & x1, int & y1) const {
+    double left = r.GetX() - GetX(), top = r.GetY() - GetY();
+    x0 = static_cast<int>(std::floor(left / GetColumnWidth()));
+    y0 = static_cast<int>(std::floor(top / GetRowHeight()));
+    x1 = static_cast<int>(std::ceil((left + r.GetWidth()) / GetColumnWidth())) - 1;
+    y1 = static_cast<int>(std::ceil((top + r.GetHeight()) / GetRowHeight())) - 1;
+}
+
+bool DxLibPp::TiledMap::CheckCollision(const Rect & r) const {
+    int x0, y0, x1, y1;
+    get_cell_range(r, x0, y0, x1, y1);
+    return collision.AnySolid(x0, y0, x1, y1);
+}
+
+std::optional<DxLibPp::TiledMap::RaycastHit> DxLibPp::TiledMap::Raycast(const Point & from, const Point & to) const {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    double fx = (from.x - GetX()) / GetColumnWidth(), fy = (from.y - GetY()) / GetRowHeight();
+    double dx = (to.x - from.x) / GetColumnWidth(), dy = (to.y - from.y) / GetRowHeight();
+    int column = static_cast<int>(std::floor(fx)), row = static_cast<int>(std::floor(fy));
+    int step_x = dx > 0 ? 1 : dx < 0 ? -1 : 0;
+    int step_y = dy > 0 ? 1 : dy < 0 ? -1 : 0;
+    double t_delta_x = dx != 0 ? std::abs(1 / dx) : infinity;
+    double t_delta_y = dy != 0 ? std::abs(1 / dy) : infinity;
+    double t_max_x = dx > 0 ? (column + 1 - fx) / dx : dx < 0 ? (fx - column) / -dx : infinity;
+    double t_max_y = dy > 0 ? (row + 1 - fy) / dy : dy < 0 ? (fy - row) / -dy : infinity;
+    double t = 0;
+    int normal_x = 0, normal_y = 0;
+    while (!collision.IsSolid(column, row)) {
+        if (t_max_x < t_max_y) {
+            t = t_max_x;
+            column += step_x;
+            t_max_x += t_delta_x;
+            normal_x = -step_x;
+            normal_y = 0;
+        } else {
+            t = t_max_y;
+            row += step_y;
+            t_max_y += t_delta_y;
+            normal_x = 0;
+            normal_y = -step_y;
+        }
+        if (t > 1)
+            return std::nullopt;
+    }
+    RaycastHit hit;
+    hit.point = Point{from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t};
+    hit.column = column;
+    hit.row = row;
+    hit.fraction = t;
+    hit.normal_x = normal_x;
+    hit.normal_y = normal_y;
+    return hit;
+}
+
+DxLibPp::TiledMap::SweepResult DxLibPp::TiledMap::Sweep(const Rect & r, const Point & delta) const {
+    const double column_width = GetColumnWidth(), row_height = GetRowHeight();
+    auto floor_cell = [](double value, double size) { return static_cast<int>(std::floor(value / size)); };
+    auto ceil_cell = [](double value, double size) { return static_cast<int>(std::ceil(value / size)); };
+    double left = r.GetX() - GetX(), top = r.GetY() - GetY();
+    double right = left + r.GetWidth(), bottom = top + r.GetHeight();
+    SweepResult result;
+    double dx = delta.x, dy = delta.y;
+
+    if (dx != 0) {
+        int y0 = floor_cell(top, row_height), y1 = ceil_cell(bottom, row_height) - 1;
+        if (dx > 0) {
+            for (int column = ceil_cell(right, column_width), last = ceil_cell(right + dx, column_width) - 1; column <= last; ++column) {
+                if (collision.AnySolid(column, y0, column, y1)) {
+                    dx = column * column_width - right;
+                    result.hit_x = true;
+                    break;
+                }
+            }
+        } else {
+            for (int column = floor_cell(left, column_width) - 1, last = floor_cell(left + dx, column_width); column >= last; --column) {
+                if (collision.AnySolid(column, y0, column, y1)) {
+                    dx = (column + 1) * column_width - left;
+                    result.hit_x = true;
+                    break;
+                }
+            }
+        }
+        left += dx;
+        right += dx;
+    }
+
+    if (dy != 0) {
+        int x0 = floor_cell(left, column_width), x1 = ceil_cell(right, column_width) - 1;
+        if (dy > 0) {
+            for (int row = ceil_cell(bottom, row_height), last = ceil_cell(bottom + dy, row_height) - 1; row <= last; ++row) {
+                if (collision.AnySolid(x0, row, x1, row)) {
+                    dy = row * row_height - bottom;
+                    result.hit_y = true;
+                    break;
+                }
+            }
+        } else {
+            for (int row = floor_cell(top, row_height) - 1, last = floor_cell(top + dy, row_height); row >= last; --row) {
+                if (collision.AnySolid(x0, row, x1, row)) {
+                    dy = (row + 1) * row_height - top;
+                    result.hit_y = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    result.delta = Point{dx, dy};
+    return result;
+}
+
+namespace {
+    constexpr int direction_x[8] = {1, 0, -1, 0, 1, -1, -1, 1};
+    constexpr int direction_y[8] = {0, 1, 0, -1, 1, 1, -1, -1};
+    constexpr float diagonal_cost = 1.41421356f;
+
+    float octile_distance(int dx, int dy) {
+        dx = std::abs(dx);
+        dy = std::abs(dy);
+        return static_cast<float>(dx + dy) + (diagonal_cost - 2) * static_cast<float>((std::min)(dx, dy));
+    }
+
+    int sign(int value) { return (value > 0) - (value < 0); }
+
+    bool can_move(const DxLibPp::CollisionGrid & grid, int x, int y, int dx, int dy) {
+        if (grid.IsSolid(x + dx, y + dy))
+            return false;
+        return dx == 0 || dy == 0 || (!grid.IsSolid(x + dx, y) && !grid.IsSolid(x, y + dy));
+    }
+}
+
+DxLibPp::Cell DxLibPp::FlowField::GetNext(Cell c) const {
+    std::uint8_t direction = GetDirection(c);
+    if (direction == NONE)
+        return c;
+    return Cell{c.x + direction_x[direction], c.y + direction_y[direction]};
+}
+
+void DxLibPp::PathFinder::begin_query() {
+    std::size_t size = static_cast<std::size_t>(grid->GetWidth()) * grid->GetHeight();
+    if (g_costs.size() != size) {
+        g_costs.assign(size, 0);
+        parents.assign(size, -1);
+        open_stamps.assign(size, 0);
+        closed_stamps.assign(size, 0);
+        stamp = 0;
+    }
+    if (++stamp == 0) {
+        std::fill(open_stamps.begin(), open_stamps.end(), 0);
+        std::fill(closed_stamps.begin(), closed_stamps.end(), 0);
+        stamp = 1;
+    }
+    open_nodes.clear();
+    expanded_node_count = 0;
+}
+
+bool DxLibPp::PathFinder::visit(int index, float g, int parent) {
+    if (open_stamps[index] == stamp && g_costs[index] <= g)
+        return false;
+    open_stamps[index] = stamp;
+    g_costs[index] = g;
+    parents[index] = parent;
+    return true;
+}
+
+void DxLibPp::PathFinder::push(int index, float g, float h) {
+    open_nodes.push_back(open_node_t{g + h, g, index});
+    std::push_heap(open_nodes.begin(), open_nodes.end());
+}
+
+void DxLibPp::PathFinder::build_path(int goal_index, std::vector<Cell> & path) const {
+    int width = grid->GetWidth();
+    for (int index = goal_index; index != -1; index = parents[index]) {
+        Cell c{index % width, index / width};
+        path.push_back(c);
+        int parent = parents[index];
+        if (parent == -1)
+            break;
+        Cell p{parent % width, parent / width};
+        int sx = sign(p.x - c.x), sy = sign(p.y - c.y);
+        for (Cell t{c.x + sx, c.y + sy}; t != p; t.x += sx, t.y += sy)
+            path.push_back(t);
+    }
+    std::reverse(path.begin(), path.end());
+}
+
+bool DxLibPp::PathFinder::FindPath(Cell start, Cell goal, std::vector<Cell> & path) {
+    path.clear();
+    if (solid(start.x, start.y) || solid(goal.x, goal.y))
+        return false;
+    begin_query();
+    int width = grid->GetWidth();
+    int start_index = start.y * width + start.x, goal_index = goal.y * width + goal.x;
+    visit(start_index, 0, -1);
+    push(start_index, 0, octile_distance(goal.x - start.x, goal.y - start.y));
+    while (!open_nodes.empty()) {
+        std::pop_heap(open_nodes.begin(), open_nodes.end());
+        open_node_t node = open_nodes.back();
+        open_nodes.pop_back();
+        if (closed(node.index) || node.g > g_costs[node.index])
+            continue;
+        closed_stamps[node.index] = stamp;
+        ++expanded_node_count;
+        if (node.index == goal_index) {
+            build_path(goal_index, path);
+            return true;
+        }
+        int x = node.index % width, y = node.index / width;
+        for (int d = 0; d < 8; ++d) {
+            int dx = direction_x[d], dy = direction_y[d];
+            if (!can_move(*grid, x, y, dx, dy))
+                continue;
+            int nx = x + dx, ny = y + dy, neighbor = ny * width + nx;
+            if (closed(neighbor))
+                continue;
+            float g = node.g + (d < 4 ? 1.0f : diagonal_cost);
+            if (visit(neighbor, g, node.index))
+                push(neighbor, g, octile_distance(goal.x - nx, goal.y - ny));
+        }
+    }
+    return false;
+}
+
+int DxLibPp::PathFinder::jump(int x, int y, int dx, int dy, Cell goal) const {
+    int width = grid->GetWidth();
+    for (;;) {
+        if (solid(x, y))
+            return -1;
+        if (x == goal.x && y == goal.y)
+            return y * width + x;
+        if (dx != 0 && dy != 0) {
+            if (jump(x + dx, y, dx, 0, goal) != -1 || jump(x, y + dy, 0, dy, goal) != -1)
+                return y * width + x;
+            if (solid(x + dx, y) || solid(x, y + dy))
+                return -1;
+        } else if (dx != 0) {
+            if ((!solid(x, y - 1) && solid(x - dx, y - 1)) || (!solid(x, y + 1) && solid(x - dx, y + 1)))
+                return y * width + x;
+        } else {
+            if ((!solid(x - 1, y) && solid(x - 1, y - dy)) || (!solid(x + 1, y) && solid(x + 1, y - dy)))
+                return y * width + x;
+        }
+        x += dx;
+        y += dy;
+    }
+}
+
+bool DxLibPp::PathFinder::FindJumpPath(Cell start, Cell goal, std::vector<Cell> & path) {
+    path.clear();
+    if (solid(start.x, start.y) || solid(goal.x, goal.y))
+        return false;
+    begin_query();
+    int width = grid->GetWidth();
+    int start_index = start.y * width + start.x, goal_index = goal.y * width + goal.x;
+    visit(start_index, 0, -1);
+    push(start_index, 0, octile_distance(goal.x - start.x, goal.y - start.y));
+    while (!open_nodes.empty()) {
+        std::pop_heap(open_nodes.begin(), open_nodes.end());
+        open_node_t node = open_nodes.back();
+        open_nodes.pop_back();
+        if (closed(node.index) || node.g > g_costs[node.index])
+            continue;
+        closed_stamps[node.index] = stamp;
+        ++expanded_node_count;
+        if (node.index == goal_index) {
+            build_path(goal_index, path);
+            return true;
+        }
+        int x = node.index % width, y = node.index / width;
+
+        int neighbors[8][2];
+        int count = 0;
+        auto add = [&](int dx, int dy) { neighbors[count][0] = dx; neighbors[count][1] = dy; ++count; };
+        int parent = parents[node.index];
+        if (parent == -1) {
+            for (int d = 0; d < 8; ++d)
+                if (can_move(*grid, x, y, direction_x[d], direction_y[d]))
+                    add(direction_x[d], direction_y[d]);
+        } else {
+            int dx = sign(x - parent % width), dy = sign(y - parent / width);
+            if (dx != 0 && dy != 0) {
+                bool vertical = !solid(x, y + dy), horizontal = !solid(x + dx, y);
+                if (vertical) add(0, dy);
+                if (horizontal) add(dx, 0);
+                if (vertical && horizontal) add(dx, dy);
+            } else if (dx != 0) {
+                bool next = !solid(x + dx, y), down = !solid(x, y + 1), up = !solid(x, y - 1);
+                if (next) {
+                    add(dx, 0);
+                    if (down) add(dx, 1);
+                    if (up) add(dx, -1);
+                }
+                if (down) add(0, 1);
+                if (up) add(0, -1);
+            } else {
+                bool next = !solid(x, y + dy), right = !solid(x + 1, y), left = !solid(x - 1, y);
+                if (next) {
+                    add(0, dy);
+                    if (right) add(1, dy);
+                    if (left) add(-1, dy);
+                }
+                if (right) add(1, 0);
+                if (left) add(-1, 0);
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int jump_point = jump(x + neighbors[i][0], y + neighbors[i][1], neighbors[i][0], neighbors[i][1], goal);
+            if (jump_point == -1 || closed(jump_point))
+                continue;
+            int jx = jump_point % width, jy = jump_point / width;
+            float g = node.g + octile_distance(jx - x, jy - y);
+            if (visit(jump_point, g, node.index))
+                push(jump_point, g, octile_distance(goal.x - jx, goal.y - jy));
+        }
+    }
+    return false;
+}
+
+namespace {
+    // Direction from a cell back to the neighbour that reached it, i.e. the opposite of direction d.
+    std::uint8_t reverse_direction(int d) {
+        return static_cast<std::uint8_t>(d < 4 ? (d + 2) % 4 : 4 + (d - 2) % 4);
+    }
+}
+
+void DxLibPp::PathFinder::build_flow_field(FlowField & field, Cell target) {
+    int width = grid->GetWidth(), height = grid->GetHeight();
+    std::size_t size = static_cast<std::size_t>(width) * height;
+    field.target = target;
+    field.width = width;
+    field.height = height;
+    field.revision = grid->GetRevision();
+    field.costs.assign(size, std::numeric_limits<float>::infinity());
+    field.directions.assign(size, FlowField::NONE);
+    if (solid(target.x, target.y))
+        return;
+    open_nodes.clear();
+    int target_index = target.y * width + target.x;
+    field.costs[target_index] = 0;
+    push(target_index, 0, 0);
+    relax_flow_field(field);
+}
+
+void DxLibPp::PathFinder::relax_flow_field(FlowField & field) {
+    int width = field.width;
+    while (!open_nodes.empty()) {
+        std::pop_heap(open_nodes.begin(), open_nodes.end());
+        open_node_t node = open_nodes.back();
+        open_nodes.pop_back();
+        if (node.g > field.costs[node.index])
+            continue;
+        int x = node.index % width, y = node.index / width;
+        for (int d = 0; d < 8; ++d) {
+            int dx = direction_x[d], dy = direction_y[d];
+            if (!can_move(*grid, x, y, dx, dy))
+                continue;
+            int neighbor = (y + dy) * width + (x + dx);
+            float g = node.g + (d < 4 ? 1.0f : diagonal_cost);
+            if (g < field.costs[neighbor]) {
+                field.costs[neighbor] = g;
+                field.directions[neighbor] = reverse_direction(d);
+                push(neighbor, g, 0);
+            }
+        }
+    }
+}
+
+// Cells whose step toward the target was cut by a flip lose their cost together with every cell routed
+// through them; the search then resumes from the surviving cells bordering that region and from the cells
+// around each flip, where an opened cell may offer a shorter way.
+bool DxLibPp::PathFinder::repair_flow_field(FlowField & field) {
+    int width = field.width, height = field.height;
+    if (width != grid->GetWidth() || height != grid->GetHeight())
+        return false;
+    int target_index = field.target.y * width + field.target.x;
+    bool target_changed = false;
+    changed_cells.clear();
+    if (!grid->GetChanges(field.revision, [&](int x, int y) {
+            int index = y * width + x;
+            target_changed |= index == target_index;
+            changed_cells.push_back(index);
+        }) || target_changed)
+        return false;
+
+    auto for_each_around = [&](int index, auto callback) {
+        int cx = index % width, cy = index / width;
+        for (int y = (std::max)(cy - 1, 0); y <= (std::min)(cy + 1, height - 1); ++y)
+            for (int x = (std::max)(cx - 1, 0); x <= (std::min)(cx + 1, width - 1); ++x)
+                callback(x, y, y * width + x);
+    };
+    auto invalidate = [&](int index) {
+        field.costs[index] = std::numeric_limits<float>::infinity();
+        field.directions[index] = FlowField::NONE;
+        invalidated_cells.push_back(index);
+    };
+    invalidated_cells.clear();
+    for (int changed : changed_cells) {
+        for_each_around(changed, [&](int x, int y, int index) {
+            std::uint8_t d = field.directions[index];
+            if (d != FlowField::NONE && (solid(x, y) || !can_move(*grid, x, y, direction_x[d], direction_y[d])))
+                invalidate(index);
+        });
+    }
+    for (std::size_t i = 0; i < invalidated_cells.size(); ++i) {
+        int x = invalidated_cells[i] % width, y = invalidated_cells[i] / width;
+        for (int d = 0; d < 8; ++d) {
+            int nx = x + direction_x[d], ny = y + direction_y[d];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                continue;
+            int neighbor = ny * width + nx;
+            if (field.directions[neighbor] == reverse_direction(d))
+                invalidate(neighbor);
+        }
+    }
+
+    open_nodes.clear();
+    auto seed = [&](int, int, int index) {
+        if (field.costs[index] != std::numeric_limits<float>::infinity())
+            push(index, field.costs[index], 0);
+    };
+    for (int invalidated : invalidated_cells)
+        for_each_around(invalidated, seed);
+    for (int changed : changed_cells)
+        for_each_around(changed, seed);
+    relax_flow_field(field);
+    field.revision = grid->GetRevision();
+    return true;
+}
+
+const DxLibPp::FlowField & DxLibPp::PathFinder::GetFlowField(Cell target) {
+    for (auto & cached : flow_fields) {
+        if (cached.field->target == target) {
+            if (cached.field->revision != grid->GetRevision() && !repair_flow_field(*cached.field))
+                build_flow_field(*cached.field, target);
+            cached.last_use = ++flow_field_clock;
+            return *cached.field;
+        }
+    }
+    if (flow_fields.size() < flow_field_cache_size) {
+        flow_fields.push_back(cached_flow_field_t{std::make_unique<FlowField>()});
+    } else {
+        auto oldest = std::min_element(flow_fields.begin(), flow_fields.end(), [](auto & a, auto & b) { return a.last_use < b.last_use; });
+        std::iter_swap(oldest, flow_fields.end() - 1);
+    }
+    auto & cached = flow_fields.back();
+    build_flow_field(*cached.field, target);
+    cached.last_use = ++flow_field_clock;
+    return *cached.field;
+}
+
+std::size_t DxLibPp::PathFinder::GetMemoryUsage() const {
+    std::size_t bytes = g_costs.capacity() * sizeof(float) + parents.capacity() * sizeof(int)
+        + (open_stamps.capacity() + closed_stamps.capacity()) * sizeof(std::uint32_t)
+        + open_nodes.capacity() * sizeof(open_node_t)
+        + (changed_cells.capacity() + invalidated_cells.capacity()) * sizeof(int)
+        + flow_fields.capacity() * sizeof(cached_flow_field_t);
+    for (const auto & cached : flow_fields)
+        bytes += sizeof(FlowField) + cached.field->costs.capacity() * sizeof(float) + cached.field->directions.capacity();
+    return bytes;
+}
+
+DxLibPp::HierarchicalPathFinder::HierarchicalPathFinder(const CollisionGrid & grid, int cluster_size)
+    : grid{&grid}
+    , cluster_size{cluster_size}
+{
+    if (cluster_size < 2)
+        throw std::logic_error("HierarchicalPathFinder cluster size must be at least 2.");
+    Rebuild();
+}
+
+void DxLibPp::HierarchicalPathFinder::get_cluster_bounds(int cluster, int & x0, int & y0, int & x1, int & y1) const {
+    x0 = (cluster % cluster_columns) * cluster_size;
+    y0 = (cluster / cluster_columns) * cluster_size;
+    x1 = (std::min)(x0 + cluster_size, grid_width);
+    y1 = (std::min)(y0 + cluster_size, grid_height);
+}
+
+void DxLibPp::HierarchicalPathFinder::Rebuild() {
+    grid_width = grid->GetWidth();
+    grid_height = grid->GetHeight();
+    cluster_columns = (grid_width + cluster_size - 1) / cluster_size;
+    cluster_rows = (grid_height + cluster_size - 1) / cluster_size;
+    nodes.clear();
+    free_nodes.clear();
+    node_count = 0;
+    cluster_nodes.assign(static_cast<std::size_t>(cluster_columns) * cluster_rows, {});
+    std::size_t border_count = cluster_columns * cluster_rows == 0 ? 0
+        : static_cast<std::size_t>(cluster_columns - 1) * cluster_rows + static_cast<std::size_t>(cluster_rows - 1) * cluster_columns;
+    border_nodes.assign(border_count, {});
+    for (std::size_t border = 0; border < border_count; ++border)
+        build_border(static_cast<int>(border));
+    for (std::size_t cluster = 0; cluster < cluster_nodes.size(); ++cluster)
+        connect_cluster(static_cast<int>(cluster));
+    repaired_cluster_count = cluster_nodes.size();
+    revision = grid->GetRevision();
+}
+
+int DxLibPp::HierarchicalPathFinder::new_node(Cell cell, int cluster, int border) {
+    int index;
+    if (free_nodes.empty()) {
+        index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    } else {
+        index = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    node_t & node = nodes[index];
+    node.cell = cell;
+    node.cluster = cluster;
+    node.border = border;
+    node.partner = -1;
+    node.edges.clear();
+    cluster_nodes[cluster].push_back(index);
+    border_nodes[border].push_back(index);
+    ++node_count;
+    return index;
+}
+
+void DxLibPp::HierarchicalPathFinder::build_border(int border) {
+    int vertical_count = (cluster_columns - 1) * cluster_rows;
+    bool vertical = border < vertical_count;
+    int cx, cy, dx, dy;
+    Cell first;
+    int length;
+    if (vertical) {
+        cx = border % (cluster_columns - 1);
+        cy = border / (cluster_columns - 1);
+        dx = 1;
+        dy = 0;
+        first = Cell{(cx + 1) * cluster_size - 1, cy * cluster_size};
+        length = (std::min)(cluster_size, grid_height - first.y);
+    } else {
+        int index = border - vertical_count;
+        cx = index % cluster_columns;
+        cy = index / cluster_columns;
+        dx = 0;
+        dy = 1;
+        first = Cell{cx * cluster_size, (cy + 1) * cluster_size - 1};
+        length = (std::min)(cluster_size, grid_width - first.x);
+    }
+    int cluster_a = cy * cluster_columns + cx;
+    int cluster_b = cluster_a + (vertical ? 1 : cluster_columns);
+    auto add_transition = [&](int offset) {
+        Cell a{first.x + dy * offset, first.y + dx * offset};
+        Cell b{a.x + dx, a.y + dy};
+        int na = new_node(a, cluster_a, border);
+        int nb = new_node(b, cluster_b, border);
+        nodes[na].partner = nb;
+        nodes[nb].partner = na;
+    };
+    int segment_begin = -1;
+    for (int offset = 0; offset <= length; ++offset) {
+        bool open = offset < length
+            && !grid->IsSolid(first.x + dy * offset, first.y + dx * offset)
+            && !grid->IsSolid(first.x + dy * offset + dx, first.y + dx * offset + dy);
+        if (open && segment_begin < 0) {
+            segment_begin = offset;
+        } else if (!open && segment_begin >= 0) {
+            int segment_end = offset - 1;
+            if (segment_end - segment_begin + 1 < 6) {
+                add_transition((segment_begin + segment_end) / 2);
+            } else {
+                add_transition(segment_begin);
+                add_transition(segment_end);
+            }
+            segment_begin = -1;
+        }
+    }
+}
+
+void DxLibPp::HierarchicalPathFinder::remove_border(int border) {
+    for (int index : border_nodes[border]) {
+        auto & members = cluster_nodes[nodes[index].cluster];
+        members.erase(std::find(members.begin(), members.end(), index));
+        nodes[index].cluster = -1;
+        nodes[index].partner = -1;
+        nodes[index].edges.clear();
+        free_nodes.push_back(index);
+        --node_count;
+    }
+    border_nodes[border].clear();
+}
+
+bool DxLibPp::HierarchicalPathFinder::search_cluster(int cluster, Cell source, Cell target) {
+    int x0, y0, x1, y1;
+    get_cluster_bounds(cluster, x0, y0, x1, y1);
+    int local_width = x1 - x0;
+    local_costs.assign(static_cast<std::size_t>(local_width) * (y1 - y0), std::numeric_limits<float>::infinity());
+    local_parents.assign(local_costs.size(), -1);
+    local_open.clear();
+    int source_index = (source.y - y0) * local_width + (source.x - x0);
+    int target_index = target.x < 0 ? -1 : (target.y - y0) * local_width + (target.x - x0);
+    local_costs[source_index] = 0;
+    local_open.push_back(open_node_t{0, 0, source_index});
+    while (!local_open.empty()) {
+        std::pop_heap(local_open.begin(), local_open.end());
+        open_node_t node = local_open.back();
+        local_open.pop_back();
+        if (node.g > local_costs[node.index])
+            continue;
+        if (node.index == target_index)
+            return true;
+        int x = x0 + node.index % local_width, y = y0 + node.index / local_width;
+        for (int d = 0; d < 8; ++d) {
+            int nx = x + direction_x[d], ny = y + direction_y[d];
+            if (nx < x0 || ny < y0 || nx >= x1 || ny >= y1 || !can_move(*grid, x, y, direction_x[d], direction_y[d]))
+                continue;
+            int neighbor = (ny - y0) * local_width + (nx - x0);
+            float g = node.g + (d < 4 ? 1.0f : diagonal_cost);
+            if (g < local_costs[neighbor]) {
+                local_costs[neighbor] = g;
+                local_parents[neighbor] = node.index;
+                float h = target_index < 0 ? 0 : octile_distance(target.x - nx, target.y - ny);
+                local_open.push_back(open_node_t{g + h, g, neighbor});
+                std::push_heap(local_open.begin(), local_open.end());
+            }
+        }
+    }
+    return target_index < 0;
+}
+
+float DxLibPp::HierarchicalPathFinder::get_local_cost(int cluster, Cell c) const {
+    int x0, y0, x1, y1;
+    get_cluster_bounds(cluster, x0, y0, x1, y1);
+    return local_costs[(c.y - y0) * (x1 - x0) + (c.x - x0)];
+}
+
+void DxLibPp::HierarchicalPathFinder::connect_cluster(int cluster) {
+    const auto & members = cluster_nodes[cluster];
+    for (int index : members)
+        nodes[index].edges.clear();
+    for (int index : members) {
+        search_cluster(cluster, nodes[index].cell, Cell{-1, -1});
+        for (int other : members) {
+            if (other == index)
+                continue;
+            float cost = get_local_cost(cluster, nodes[other].cell);
+            if (cost != std::numeric_limits<float>::infinity())
+                nodes[index].edges.push_back(edge_t{other, cost});
+        }
+    }
+}
+
+void DxLibPp::HierarchicalPathFinder::sync() {
+    if (grid->GetRevision() == revision)
+        return;
+    std::vector<char> dirty(cluster_nodes.size());
+    bool logged = grid->GetWidth() == grid_width && grid->GetHeight() == grid_height
+        && grid->GetChanges(revision, [&](int x, int y) { dirty[cluster_of(Cell{x, y})] = 1; });
+    if (!logged) {
+        Rebuild();
+        return;
+    }
+    int vertical_count = (cluster_columns - 1) * cluster_rows;
+    std::vector<char> borders(border_nodes.size()), affected(cluster_nodes.size());
+    for (int cluster = 0; cluster < static_cast<int>(dirty.size()); ++cluster) {
+        if (!dirty[cluster])
+            continue;
+        int cx = cluster % cluster_columns, cy = cluster / cluster_columns;
+        affected[cluster] = 1;
+        if (cx > 0) { borders[cy * (cluster_columns - 1) + cx - 1] = 1; affected[cluster - 1] = 1; }
+        if (cx < cluster_columns - 1) { borders[cy * (cluster_columns - 1) + cx] = 1; affected[cluster + 1] = 1; }
+        if (cy > 0) { borders[vertical_count + (cy - 1) * cluster_columns + cx] = 1; affected[cluster - cluster_columns] = 1; }
+        if (cy < cluster_rows - 1) { borders[vertical_count + cy * cluster_columns + cx] = 1; affected[cluster + cluster_columns] = 1; }
+    }
+    for (int border = 0; border < static_cast<int>(borders.size()); ++border) {
+        if (borders[border]) {
+            remove_border(border);
+            build_border(border);
+        }
+    }
+    repaired_cluster_count = 0;
+    for (int cluster = 0; cluster < static_cast<int>(affected.size()); ++cluster) {
+        if (affected[cluster]) {
+            connect_cluster(cluster);
+            ++repaired_cluster_count;
+        }
+    }
+    revision = grid->GetRevision();
+}
+
+bool DxLibPp::HierarchicalPathFinder::append_local_path(int cluster, Cell from, Cell to, std::vector<Cell> & path) {
+    if (!search_cluster(cluster, from, to))
+        return false;
+    int x0, y0, x1, y1;
+    get_cluster_bounds(cluster, x0, y0, x1, y1);
+    int local_width = x1 - x0;
+    std::size_t begin = path.size();
+    int from_index = (from.y - y0) * local_width + (from.x - x0);
+    for (int index = (to.y - y0) * local_width + (to.x - x0); index != from_index; index = local_parents[index])
+        path.push_back(Cell{x0 + index % local_width, y0 + index / local_width});
+    std::reverse(path.begin() + begin, path.end());
+    return true;
+}
+
+bool DxLibPp::HierarchicalPathFinder::FindPath(Cell start, Cell goal, std::vector<Cell> & path) {
+    path.clear();
+    if (grid->IsSolid(start.x, start.y) || grid->IsSolid(goal.x, goal.y))
+        return false;
+    sync();
+    path.push_back(start);
+    int start_cluster = cluster_of(start), goal_cluster = cluster_of(goal);
+    if (start_cluster == goal_cluster && append_local_path(start_cluster, start, goal, path))
+        return true;
+
+    start_links.clear();
+    search_cluster(start_cluster, start, Cell{-1, -1});
+    for (int index : cluster_nodes[start_cluster]) {
+        float cost = get_local_cost(start_cluster, nodes[index].cell);
+        if (cost != std::numeric_limits<float>::infinity())
+            start_links.push_back(edge_t{index, cost});
+    }
+    goal_links.clear();
+    search_cluster(goal_cluster, goal, Cell{-1, -1});
+    for (int index : cluster_nodes[goal_cluster]) {
+        float cost = get_local_cost(goal_cluster, nodes[index].cell);
+        if (cost != std::numeric_limits<float>::infinity())
+            goal_links.push_back(edge_t{index, cost});
+    }
+
+    int start_node = static_cast<int>(nodes.size()), goal_node = start_node + 1;
+    std::size_t size = nodes.size() + 2;
+    if (abstract_costs.size() < size) {
+        abstract_costs.resize(size);
+        abstract_parents.resize(size);
+        abstract_stamps.assign(size, 0);
+        abstract_stamp = 0;
+    }
+    if (++abstract_stamp == 0) {
+        std::fill(abstract_stamps.begin(), abstract_stamps.end(), 0);
+        abstract_stamp = 1;
+    }
+    auto cell_of = [&](int index) { return index == start_node ? start : index == goal_node ? goal : nodes[index].cell; };
+    auto relax = [&](int from, int to, float g) {
+        if (abstract_stamps[to] == abstract_stamp && abstract_costs[to] <= g)
+            return;
+        abstract_stamps[to] = abstract_stamp;
+        abstract_costs[to] = g;
+        abstract_parents[to] = from;
+        Cell c = cell_of(to);
+        abstract_open.push_back(open_node_t{g + octile_distance(goal.x - c.x, goal.y - c.y), g, to});
+        std::push_heap(abstract_open.begin(), abstract_open.end());
+    };
+    abstract_open.clear();
+    relax(-1, start_node, 0);
+    bool found = false;
+    while (!abstract_open.empty()) {
+        std::pop_heap(abstract_open.begin(), abstract_open.end());
+        open_node_t node = abstract_open.back();
+        abstract_open.pop_back();
+        if (node.g > abstract_costs[node.index])
+            continue;
+        if (node.index == goal_node) {
+            found = true;
+            break;
+        }
+        if (node.index == start_node) {
+            for (const auto & link : start_links)
+                relax(node.index, link.to, node.g + link.cost);
+            continue;
+        }
+        const node_t & current = nodes[node.index];
+        for (const auto & edge : current.edges)
+            relax(node.index, edge.to, node.g + edge.cost);
+        if (current.partner >= 0)
+            relax(node.index, current.partner, node.g + 1);
+        if (current.cluster == goal_cluster)
+            for (const auto & link : goal_links)
+                if (link.to == node.index)
+                    relax(node.index, goal_node, node.g + link.cost);
+    }
+    if (!found) {
+        path.clear();
+        return false;
+    }
+
+    waypoints.clear();
+    for (int index = goal_node; index != -1; index = abstract_parents[index])
+        waypoints.push_back(cell_of(index));
+    std::reverse(waypoints.begin(), waypoints.end());
+    for (std::size_t i = 1; i < waypoints.size(); ++i) {
+        Cell from = waypoints[i - 1], to = waypoints[i];
+        if (from == to)
+            continue;
+        if (cluster_of(from) != cluster_of(to))
+            path.push_back(to);
+        else
+            append_local_path(cluster_of(from), from, to, path);
+    }
+    return true;
+}
+
+std::size_t DxLibPp::HierarchicalPathFinder::GetAbstractEdgeCount() const {
+    std::size_t count = 0;
+    for (const auto & node : nodes)
+        if (node.cluster >= 0)
+            count += node.edges.size() + (node.partner >= 0 ? 1 : 0);
+    return count;
+}
+
+std::size_t DxLibPp::HierarchicalPathFinder::GetMemoryUsage() const {
+    std::size_t bytes = nodes.capacity() * sizeof(node_t) + free_nodes.capacity() * sizeof(int);
+    for (const auto & node : nodes)
+        bytes += node.edges.capacity() * sizeof(edge_t);
+    for (const auto & members : cluster_nodes)
+        bytes += sizeof(members) + members.capacity() * sizeof(int);
+    for (const auto & members : border_nodes)
+        bytes += sizeof(members) + members.capacity() * sizeof(int);
+    bytes += local_costs.capacity() * sizeof(float) + local_parents.capacity() * sizeof(int)
+        + local_open.capacity() * sizeof(open_node_t)
+        + abstract_costs.capacity() * sizeof(float) + abstract_parents.capacity() * sizeof(int)
+        + abstract_stamps.capacity() * sizeof(std::uint32_t) + abstract_open.capacity() * sizeof(open_node_t)
+        + (start_links.capacity() + goal_links.capacity()) * sizeof(edge_t) + waypoints.capacity() * sizeof(Cell);
+    return bytes;
+}
+
+DxLibPp::WorkerPool::WorkerPool(std::size_t thread_count) {
+    if (thread_count == 0)
+        thread_count = (std::max)(1u, std::thread::hardware_concurrency());
+    for (std::size_t worker = 0; worker < thread_count; ++worker)
+        threads.emplace_back([this, worker] { work(worker); });
+}
+
+DxLibPp::WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        done.wait(lock, [&] { return active == 0; });
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto & thread : threads)
+        thread.join();
+}
+
+void DxLibPp::WorkerPool::Dispatch(std::size_t count, std::function<void(std::size_t, std::size_t)> task) {
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        this->task = std::move(task);
+        this->count = count;
+        next = 0;
+        active = threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+}
+
+void DxLibPp::WorkerPool::Wait() {
+    std::unique_lock<std::mutex> lock{mutex};
+    done.wait(lock, [&] { return active == 0; });
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void DxLibPp::WorkerPool::work(std::size_t worker) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        std::size_t local_count;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            local_count = count;
+        }
+        try {
+            for (std::size_t item; (item = next.fetch_add(1)) < local_count; )
+                task(worker, item);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!error)
+                error = std::current_exception();
+            next = local_count;
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        if (--active == 0)
+            done.notify_all();
+    }
+}
+
+namespace {
+
+// The system whose worker is running on this thread, and that worker's queue.
+thread_local const DxLibPp::JobSystem * job_system_owner = nullptr;
+thread_local std::size_t job_system_queue = 0;
+
+}
+
+DxLibPp::JobSystem::JobSystem(std::size_t thread_count) {
+    if (thread_count == 0)
+        thread_count = (std::max)(1u, std::thread::hardware_concurrency()) - 1;
+    for (std::size_t queue = 0; queue <= thread_count; ++queue)
+        queues.push_back(std::make_unique<queue_t>());
+    for (std::size_t worker = 1; worker <= thread_count; ++worker)
+        threads.emplace_back([this, worker] { work(worker); });
+}
+
+DxLibPp::JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock{sleep_mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto & thread : threads)
+        thread.join();
+}
+
+std::size_t DxLibPp::JobSystem::current_queue() const {
+    return job_system_owner == this ? job_system_queue : 0;
+}
+
+void DxLibPp::JobSystem::push(job_t job) {
+    queue_t & queue = *queues[current_queue()];
+    {
+        // Counted before it becomes visible, so that a thief never takes queued below zero.
+        std::lock_guard<std::mutex> lock{sleep_mutex};
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        queue.jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void DxLibPp::JobSystem::Run(Job job, JobCounter * counter) {
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    push(job_t{std::move(job), counter});
+}
+
+void DxLibPp::JobSystem::RunAfter(JobCounter & dependency, Job job, JobCounter * counter) {
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock{dependency.mutex};
+        if (dependency.pending.load(std::memory_order_acquire) != 0) {
+            dependency.continuations.push_back([this, job = std::move(job), counter]() mutable {
+                push(job_t{std::move(job), counter});
+            });
+            return;
+        }
+    }
+    push(job_t{std::move(job), counter});
+}
+
+void DxLibPp::JobSystem::finish(JobCounter * counter) {
+    if (!counter)
+        return;
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock{counter->mutex};
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations);
+    }
+    for (auto & continuation : ready)
+        continuation();
+}
+
+// Pops the newest job of the thread's own queue, or steals the oldest job of another.
+bool DxLibPp::JobSystem::try_run(std::size_t queue) {
+    std::optional<job_t> job;
+    for (std::size_t i = 0; i < queues.size() && !job; ++i) {
+        queue_t & victim = *queues[(queue + i) % queues.size()];
+        std::lock_guard<std::mutex> lock{victim.mutex};
+        if (victim.jobs.empty())
+            continue;
+        if (i == 0) {
+            job = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+        } else {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+    }
+    if (!job)
+        return false;
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    if (!job->counter) {
+        // Nobody waits on this job, so nothing could rethrow what it throws.
+        try {
+            job->job();
+        } catch (...) {
+            std::terminate();
+        }
+        return true;
+    }
+    try {
+        job->job();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock{job->counter->mutex};
+        if (!job->counter->error)
+            job->counter->error = std::current_exception();
+    }
+    finish(job->counter);
+    return true;
+}
+
+void DxLibPp::JobSystem::Wait(JobCounter & counter) {
+    std::size_t queue = current_queue();
+    while (!counter.IsDone())
+        if (!try_run(queue))
+            std::this_thread::yield();
+    // Locking also waits for the last finish() to let go of the mutex before the counter can be destroyed.
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock{counter.mutex};
+        error = std::exchange(counter.error, nullptr);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void DxLibPp::JobSystem::ParallelFor(std::size_t begin, std::size_t end, const std::function<void(std::size_t, std::size_t)> & body, std::size_t grain) {
+    if (begin >= end)
+        return;
+    std::size_t count = end - begin;
+    if (grain == 0)
+        grain = (std::max)(std::size_t{1}, count / ((threads.size() + 1) * 4));
+    if (count <= grain) {
+        body(begin, end);
+        return;
+    }
+    JobCounter counter;
+    for (std::size_t first = begin; first < end; first += grain) {
+        std::size_t last = (std::min)(first + grain, end);
+        Run([&body, first, last] { body(first, last); }, &counter);
+    }
+    Wait(counter);
+}
+
+void DxLibPp::JobSystem::work(std::size_t queue) {
+    job_system_owner = this;
+    job_system_queue = queue;
+    for (;;) {
+        if (try_run(queue))
+            continue;
+        std::unique_lock<std::mutex> lock{sleep_mutex};
+        wake.wait(lock, [&] { return stopping || queued.load(std::memory_order_relaxed) != 0; });
+        if (stopping)
+            return;
+    }
+}
+
+std::size_t DxLibPp::ThreadDrawCommandBuffers::GetSize() const {
+    std::size_t size = 0;
+    for (const DrawCommandBuffer & buffer : buffers)
+        size += buffer.GetSize();
+    return size;
+}
+
+void DxLibPp::ThreadDrawCommandBuffers::Flush() {
+    DXLIBPP_PROFILE_ZONE("ThreadDrawCommandBuffers::Flush");
+    for (std::size_t thread = 1; thread < buffers.size(); ++thread)
+        buffers[0].Append(buffers[thread]);
+    buffers[0].Flush();
+}
+
+void DxLibPp::ThreadDrawCommandBuffers::Clear() {
+    for (DrawCommandBuffer & buffer : buffers)
+        buffer.Clear();
+}
+
+DxLibPp::PathQueryService::PathQueryService(const CollisionGrid & grid, std::size_t thread_count)
+    : grid{&grid}
+    , pool{std::make_unique<WorkerPool>(thread_count)}
+{
+    for (std::size_t worker = 0; worker < pool->GetThreadCount(); ++worker)
+        finders.push_back(std::make_unique<PathFinder>(snapshot));
+    worker_paths.resize(pool->GetThreadCount());
+}
+
+// One finder per thread that can run the batch's jobs: the workers and the thread that calls Collect().
+DxLibPp::PathQueryService::PathQueryService(const CollisionGrid & grid, JobSystem & jobs)
+    : grid{&grid}
+    , jobs{&jobs}
+{
+    for (std::size_t worker = 0; worker <= jobs.GetWorkerCount(); ++worker)
+        finders.push_back(std::make_unique<PathFinder>(snapshot));
+    worker_paths.resize(jobs.GetWorkerCount() + 1);
+}
+
+DxLibPp::PathQueryService::~PathQueryService() {
+    if (dispatched && pool)
+        pool->Wait();
+    else if (dispatched)
+        jobs->Wait(batch);
+}
+
+std::uint64_t DxLibPp::PathQueryService::Submit(Cell start, Cell goal) {
+    pending.push_back(request_t{next_ticket, start, goal});
+    return next_ticket++;
+}
+
+void DxLibPp::PathQueryService::Dispatch() {
+    if (dispatched)
+        throw std::logic_error("PathQueryService batch is still in flight; call Collect() first.");
+    if (!has_snapshot || snapshot.GetRevision() != grid->GetRevision()) {
+        snapshot = *grid;
+        has_snapshot = true;
+    }
+    std::swap(pending, in_flight);
+    pending.clear();
+    batch_results.resize(in_flight.size());
+    batch_deterministic = deterministic;
+    completed = 0;
+    dispatched = true;
+    if (pool) {
+        pool->Dispatch(in_flight.size(), [this](std::size_t worker, std::size_t item) { solve(worker, item); });
+        return;
+    }
+    // Any thread waiting on the JobSystem may run these jobs, so each job owns a finder rather than using
+    // the running thread's, and the jobs share out the requests between them.
+    next_item = 0;
+    for (std::size_t finder = 0; finder < (std::min)(finders.size(), in_flight.size()); ++finder) {
+        jobs->Run([this, finder] {
+            for (std::size_t item; (item = next_item.fetch_add(1)) < in_flight.size();)
+                solve(finder, item);
+        }, &batch);
+    }
+}
+
+void DxLibPp::PathQueryService::solve(std::size_t worker, std::size_t item) {
+    const request_t & request = in_flight[item];
+    if (batch_deterministic) {
+        PathResult & result = batch_results[item];
+        result.found = finders[worker]->FindJumpPath(request.start, request.goal, result.path);
+        result.ticket = request.ticket;
+        result.start = request.start;
+        result.goal = request.goal;
+        return;
+    }
+    auto & path = worker_paths[worker];
+    bool found = finders[worker]->FindJumpPath(request.start, request.goal, path);
+    PathResult & result = batch_results[completed.fetch_add(1)];
+    result.found = found;
+    result.path.assign(path.begin(), path.end());
+    result.ticket = request.ticket;
+    result.start = request.start;
+    result.goal = request.goal;
+}
+
+const std::vector<DxLibPp::PathResult> & DxLibPp::PathQueryService::Collect() {
+    if (dispatched) {
+        dispatched = false;
+        if (pool)
+            pool->Wait();
+        else
+            jobs->Wait(batch);
+        std::swap(batch_results, collected_results);
+    } else {
+        collected_results.clear();
+    }
+    return collected_results;
+}
+
+namespace {
+
+// xorshift64*: cheap, and reproducible across platforms for a given seed.
+float random_unit(std::uint64_t & state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<float>((state * 0x2545f4914f6cdd1dull) >> 40) * (1.0f / 16777216.0f);
+}
+
+float random_range(std::uint64_t & state, double min, double max) {
+    return static_cast<float>(min + (max - min) * random_unit(state));
+}
+
+// splitmix64 finalizer: turns a counter into a well-mixed, non-zero xorshift seed.
+std::uint64_t mix_seed(std::uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value != 0 ? value : 0x9e3779b97f4a7c15ull;
+}
+
+void integrate_particles(float * x, float * y, float * vx, float * vy, float * life, std::size_t count, float seconds, float gravity_x, float gravity_y) {
+    std::size_t i = 0;
+#if DXLIBPP_PARTICLE_SSE2
+    const __m128 dt = _mm_set1_ps(seconds);
+    const __m128 dvx = _mm_set1_ps(gravity_x * seconds);
+    const __m128 dvy = _mm_set1_ps(gravity_y * seconds);
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i);
+        __m128 pvx = _mm_add_ps(_mm_loadu_ps(vx + i), dvx);
+        __m128 pvy = _mm_add_ps(_mm_loadu_ps(vy + i), dvy);
+        _mm_storeu_ps(vx + i, pvx);
+        _mm_storeu_ps(vy + i, pvy);
+        _mm_storeu_ps(x + i, _mm_add_ps(px, _mm_mul_ps(pvx, dt)));
+        _mm_storeu_ps(y + i, _mm_add_ps(py, _mm_mul_ps(pvy, dt)));
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), dt));
+    }
+#endif
+    for (; i < count; ++i) {
+        vx[i] += gravity_x * seconds;
+        vy[i] += gravity_y * seconds;
+        x[i] += vx[i] * seconds;
+        y[i] += vy[i] * seconds;
+        life[i] -= seconds;
+    }
+}
+
+std::size_t chunk_number(std::size_t count) {
+    return (count + DxLibPp::ParticleSystem::CHUNK_SIZE - 1) / DxLibPp::ParticleSystem::CHUNK_SIZE;
+}
+
+}
+
+struct DxLibPp::ParticleSystem::vertex_buffer_t {
+    std::vector<VERTEX2D> vertices;
+};
+
+DxLibPp::ParticleSystem::ParticleSystem(std::size_t capacity, std::size_t thread_count)
+    : capacity{capacity}
+    , x(capacity), y(capacity), vx(capacity), vy(capacity), life(capacity), inverse_max_life(capacity), sizes(capacity)
+    , colors(capacity)
+    , chunk_live(chunk_number(capacity))
+    , vertices{std::make_unique<vertex_buffer_t>()}
+{
+    if (thread_count != 1)
+        pool = std::make_unique<WorkerPool>(thread_count);
+    vertices->vertices.resize((pool ? capacity : (std::min)(capacity, BATCH_QUADS)) * 6);
+}
+
+DxLibPp::ParticleSystem::ParticleSystem(std::size_t capacity, JobSystem & jobs)
+    : ParticleSystem(capacity, 1)
+{
+    this->jobs = &jobs;
+    vertices->vertices.resize(capacity * 6);
+}
+
+DxLibPp::ParticleSystem::~ParticleSystem() {}
+
+std::size_t DxLibPp::ParticleSystem::AddEmitter(const ParticleEmitter & emitter) {
+    emitters.push_back(emitter);
+    emitter_backlog.push_back(0.0);
+    return emitters.size() - 1;
+}
+
+void DxLibPp::ParticleSystem::run(std::size_t count, const std::function<void(std::size_t)> & task) const {
+    if (jobs) {
+        jobs->ParallelFor(0, count, [&](std::size_t first, std::size_t last) {
+            for (std::size_t item = first; item < last; ++item)
+                task(item);
+        }, 1);
+        return;
+    }
+    if (!pool || count <= 1) {
+        for (std::size_t item = 0; item < count; ++item)
+            task(item);
+        return;
+    }
+    pool->Run(count, [&](std::size_t, std::size_t item) { task(item); });
+}
+
+std::size_t DxLibPp::ParticleSystem::Emit(const ParticleEmitter & emitter, std::size_t count) {
+    std::size_t spawned = (std::min)(count, capacity - this->count);
+    dropped += count - spawned;
+    std::size_t first = this->count;
+    std::uint64_t base = mix_seed(random++);
+    run(chunk_number(spawned), [&](std::size_t chunk) {
+        std::size_t offset = chunk * CHUNK_SIZE;
+        spawn(emitter, first + offset, (std::min)(CHUNK_SIZE, spawned - offset), mix_seed(base + chunk));
+    });
+    this->count += spawned;
+    return spawned;
+}
+
+void DxLibPp::ParticleSystem::spawn(const ParticleEmitter & emitter, std::size_t first, std::size_t count, std::uint64_t seed) {
+    for (std::size_t i = first; i < first + count; ++i) {
+        float angle = random_range(seed, emitter.direction - emitter.spread, emitter.direction + emitter.spread);
+        float speed = random_range(seed, emitter.speed_min, emitter.speed_max);
+        float max_life = (std::max)(random_range(seed, emitter.life_min, emitter.life_max), 1.0e-6f);
+        x[i] = static_cast<float>(emitter.x);
+        y[i] = static_cast<float>(emitter.y);
+        vx[i] = std::cos(angle) * speed;
+        vy[i] = std::sin(angle) * speed;
+        life[i] = max_life;
+        inverse_max_life[i] = 1.0f / max_life;
+        sizes[i] = emitter.size;
+        colors[i] = emitter.color;
+    }
+}
+
+void DxLibPp::ParticleSystem::move(std::size_t from, std::size_t to) {
+    x[to] = x[from];
+    y[to] = y[from];
+    vx[to] = vx[from];
+    vy[to] = vy[from];
+    life[to] = life[from];
+    inverse_max_life[to] = inverse_max_life[from];
+    sizes[to] = sizes[from];
+    colors[to] = colors[from];
+}
+
+// Compacts the live particles of [first, first + count) to its front and returns how many there are.
+std::size_t DxLibPp::ParticleSystem::retire(std::size_t first, std::size_t count) {
+    std::size_t end = first + count;
+    for (std::size_t i = first; i < end;) {
+        if (life[i] > 0.0f)
+            ++i;
+        else
+            move(--end, i);
+    }
+    return end - first;
+}
+
+void DxLibPp::ParticleSystem::Update(double seconds) {
+    DXLIBPP_PROFILE_ZONE("ParticleSystem::Update");
+    for (std::size_t i = 0; i < emitters.size(); ++i) {
+        if (!emitters[i].enabled)
+            continue;
+        emitter_backlog[i] += emitters[i].rate * seconds;
+        auto due = static_cast<std::size_t>(emitter_backlog[i]);
+        emitter_backlog[i] -= static_cast<double>(due);
+        Emit(emitters[i], due);
+    }
+    std::size_t chunks = chunk_number(count);
+    if (chunks == 0)
+        return;
+    run(chunks, [&](std::size_t chunk) {
+        std::size_t first = chunk * CHUNK_SIZE, size = (std::min)(CHUNK_SIZE, count - first);
+        integrate_particles(x.data() + first, y.data() + first, vx.data() + first, vy.data() + first, life.data() + first,
+            size, static_cast<float>(seconds), gravity_x, gravity_y);
+        chunk_live[chunk] = retire(first, size);
+    });
+
+    // Each chunk now holds its survivors at the front. Fill the holes below the new count with survivors
+    // taken from the back, so only as many particles move as died.
+    std::size_t live = 0;
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+        live += chunk_live[chunk];
+    std::size_t hole_chunk = 0, hole = chunk_live[0];
+    for (std::size_t chunk = chunks; chunk-- > 0;) {
+        std::size_t first = chunk * CHUNK_SIZE;
+        for (std::size_t source = first + chunk_live[chunk]; source-- > (std::max)(first, live);) {
+            while (hole == (std::min)((hole_chunk + 1) * CHUNK_SIZE, count)) {
+                ++hole_chunk;
+                hole = hole_chunk * CHUNK_SIZE + chunk_live[hole_chunk];
+            }
+            move(source, hole++);
+        }
+    }
+    count = live;
+}
+
+void DxLibPp::ParticleSystem::write_vertices(std::size_t first, std::size_t count, void * output) const {
+    // The camera as an affine map: screen = (xx, xy; yx, yy) * world + (tx, ty). Quads stay square in world
+    // space, so each needs one corner mapped and two scaled edge vectors.
+    const Camera & camera = camera_state.camera;
+    double zoom = camera.GetZoom(), c = std::cos(camera.GetRotation()), s = std::sin(camera.GetRotation());
+    float xx = static_cast<float>(zoom * c), xy = static_cast<float>(zoom * s);
+    float yx = static_cast<float>(-zoom * s), yy = static_cast<float>(zoom * c);
+    Point offset = camera.ToScreen(Point{0.0, 0.0});
+    float tx = static_cast<float>(offset.x), ty = static_cast<float>(offset.y);
+    auto * vertex = static_cast<VERTEX2D *>(output);
+    for (std::size_t i = first; i < first + count; ++i) {
+        std::uint32_t color = colors[i];
+        float fade = (std::min)(life[i] * inverse_max_life[i], 1.0f);
+        COLOR_U8 dif;
+        dif.b = static_cast<BYTE>(color);
+        dif.g = static_cast<BYTE>(color >> 8);
+        dif.r = static_cast<BYTE>(color >> 16);
+        dif.a = static_cast<BYTE>(static_cast<float>(color >> 24) * fade);
+        float size = sizes[i], left = x[i] - size * 0.5f, top = y[i] - size * 0.5f;
+        float x0 = xx * left + xy * top + tx, y0 = yx * left + yy * top + ty;
+        float edge_xx = xx * size, edge_xy = yx * size, edge_yx = xy * size, edge_yy = yy * size;
+        VECTOR top_left{x0, y0, 0.0f}, top_right{x0 + edge_xx, y0 + edge_xy, 0.0f};
+        VECTOR bottom_left{x0 + edge_yx, y0 + edge_yy, 0.0f}, bottom_right{x0 + edge_xx + edge_yx, y0 + edge_xy + edge_yy, 0.0f};
+        *vertex++ = VERTEX2D{top_left, 1.0f, dif, 0.0f, 0.0f};
+        *vertex++ = VERTEX2D{top_right, 1.0f, dif, 1.0f, 0.0f};
+        *vertex++ = VERTEX2D{bottom_left, 1.0f, dif, 0.0f, 1.0f};
+        *vertex++ = VERTEX2D{top_right, 1.0f, dif, 1.0f, 0.0f};
+        *vertex++ = VERTEX2D{bottom_right, 1.0f, dif, 1.0f, 1.0f};
+        *vertex++ = VERTEX2D{bottom_left, 1.0f, dif, 0.0f, 1.0f};
+    }
+}
+
+void DxLibPp::ParticleSystem::Draw() const {
+    DXLIBPP_PROFILE_ZONE("ParticleSystem::Draw");
+    int handle = graph.GetHandle() != -1 ? graph.GetHandle() : DX_NONE_GRAPH;
+    VERTEX2D * output = vertices->vertices.data();
+    if (pool || jobs) {
+        run(chunk_number(count), [&](std::size_t chunk) {
+            std::size_t first = chunk * CHUNK_SIZE;
+            write_vertices(first, (std::min)(CHUNK_SIZE, count - first), output + first * 6);
+        });
+        if (count > 0)
+            DrawPrimitive2D_s(output, static_cast<int>(count * 6), DX_PRIMTYPE_TRIANGLELIST, handle, TRUE);
+        return;
+    }
+    for (std::size_t first = 0; first < count; first += BATCH_QUADS) {
+        std::size_t quads = (std::min)(BATCH_QUADS, count - first);
+        write_vertices(first, quads, output);
+        DrawPrimitive2D_s(output, static_cast<int>(quads * 6), DX_PRIMTYPE_TRIANGLELIST, handle, TRUE);
+    }
+}
+
+void DxLibPp::ParticleSystem::Clear() {
+    count = 0;
+    std::fill(emitter_backlog.begin(), emitter_backlog.end(), 0.0);
+}
@@ -5,18 +5,84 @@
 #include <memory>
 #include <list>
 #include <vector>
+#include <array>
 #include <utility>
 #include <optional>
 #include <functional>
 #include <type_traits>
 #include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <initializer_list>
+#include <deque>
 
 #ifdef _MSC_VER
 #    pragma comment(linker, "/subsystem:windows /ENTRY:mainCRTStartup")
 #endif
 
+// Define DXLIBPP_PROFILE=1 to compile profiling zones in; otherwise DXLIBPP_PROFILE_ZONE expands to nothing.
+#ifndef DXLIBPP_PROFILE
+#    define DXLIBPP_PROFILE 0
+#endif
+
+#define DXLIBPP_PROFILE_CONCAT_IMPL(a, b) a##b
+#define DXLIBPP_PROFILE_CONCAT(a, b) DXLIBPP_PROFILE_CONCAT_IMPL(a, b)
+#if DXLIBPP_PROFILE
+#    define DXLIBPP_PROFILE_ZONE(name) ::DxLibPp::ProfileScope DXLIBPP_PROFILE_CONCAT(dxlibpp_profile_zone_, __LINE__){name}
+#else
+#    define DXLIBPP_PROFILE_ZONE(name) static_cast<void>(0)
+#endif
+#define DXLIBPP_PROFILE_FUNCTION() DXLIBPP_PROFILE_ZONE(__func__)
+
 namespace DxLibPp {
 
+// Records named time ranges into a ring buffer owned by the recording thread. Zone names must be string
+// literals (or otherwise outlive the profiler). Zones recorded while a thread's ring is full are dropped
+// and counted; Collect() regularly (e.g. once per frame) to avoid that.
+struct Profiler {
+    struct Zone {
+        const char * name;
+        std::int64_t begin, end; // nanoseconds since the profiler started
+        std::uint32_t thread;
+        std::uint32_t depth;
+    };
+
+    static constexpr std::size_t RING_SIZE = 16384;
+
+    static void SetEnabled(bool enabled) noexcept;
+    static bool IsEnabled() noexcept;
+    static std::int64_t GetTime() noexcept;
+    static void Record(const char * name, std::int64_t begin, std::int64_t end, std::uint32_t depth) noexcept;
+
+    // Moves the zones recorded so far on every thread into the collected set.
+    static void Collect();
+    static const std::vector<Zone> & GetZones() noexcept;
+    static std::uint64_t GetDroppedCount() noexcept;
+    static void Clear();
+
+    // Both exporters Collect() first. The Chrome trace opens in chrome://tracing or Perfetto.
+    static void ExportChromeTrace(std::string_view path);
+    static void ExportBinary(std::string_view path);
+};
+
+struct ProfileScope {
+    explicit ProfileScope(const char * name) noexcept;
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope & operator =(const ProfileScope &) = delete;
+    ~ProfileScope();
+
+private:
+    const char * name;
+    std::int64_t begin;
+};
+
 template<typename Reference> struct Iterator {
     using referecne = Reference;
 
@@ -127,7 +193,7 @@ struct BasicPoint : AbstractPosition<T> {
     BasicPoint(value_type x, value_type y) : x{x}, y{y} {}
     BasicPoint(const BasicPoint & p) : x{p.x}, y{p.y} {}
     virtual ~BasicPoint() {}
-    BasicPoint & operator =(const BasicPoint & p) { x = p.x; y = p.y; }
+    BasicPoint & operator =(const BasicPoint & p) { x = p.x; y = p.y; return *this; }
     BasicPoint & operator +=(const BasicPoint & p) { x += p.x; y += p.y; return *this; }
     BasicPoint operator +(const BasicPoint & p) { return BasicPoint{*this} += p; }
     BasicPoint & operator -=(const BasicPoint & p) { x -= p.x; y -= p.y; return *this; }
@@ -182,20 +248,63 @@ struct BasicRect : AbstractPosition<T>, AbstractDimension<T> {
     virtual value_type GetY() const override { return y; }
     virtual value_type GetWidth() const override { return width; }
     virtual value_type GetHeight() const override { return height; }
+    virtual void SetX(value_type x) override { this->x = x; }
+    virtual void SetY(value_type y) override { this->y = y; }
+    virtual void SetWidth(value_type width) override { this->width = width; }
+    virtual void SetHeight(value_type height) override { this->height = height; }
 
 private:
     value_type x{}, y{}, width{}, height{};
 };
 using Rect = BasicRect<double>;
 
+// Maps world coordinates to the screen: the world point GetPosition() lands on the screen point GetOrigin(),
+// scaled by GetZoom() and turned by -GetRotation(), so that turning the camera one way turns the world the
+// other on screen. The default camera is the identity.
+struct Camera {
+    Camera() = default;
+    Camera(const Point & position, double zoom = 1.0, double rotation = 0.0, const Point & origin = Point{});
+
+    const Point & GetPosition() const { return position; }
+    void SetPosition(const Point & position) { this->position = position; update(); }
+    double GetZoom() const { return zoom; }
+    void SetZoom(double zoom);
+    double GetRotation() const { return rotation; }
+    void SetRotation(double rotation) { this->rotation = rotation; update(); }
+    const Point & GetOrigin() const { return origin; }
+    void SetOrigin(const Point & origin) { this->origin = origin; update(); }
+    bool IsIdentity() const { return identity; }
+
+    Point ToScreen(const Point & world) const;
+    Point ToWorld(const Point & screen) const;
+    // The world-space bounding box of the screen rectangle [0, width) x [0, height).
+    Rect GetView(double width, double height) const;
+
+private:
+    void update();
+
+    Point position, origin;
+    double zoom{1.0}, rotation{};
+    double cos_rotation{1.0}, sin_rotation{};
+    bool identity{true};
+};
+
+struct DrawCommandBuffer;
+
 struct Drawable {
     virtual ~Drawable() {}
     virtual void Draw() const = 0;
+    // Records this object's drawing into buffer instead of drawing now. By default the buffer calls Draw()
+    // when it replays.
+    virtual void Submit(DrawCommandBuffer & buffer) const;
 };
 
 struct Updatable {
     virtual ~Updatable() {}
     virtual void Update() = 0;
+    // True if Update() touches only this object and makes no DxLib calls, so that Global::Update() may run
+    // it on a worker thread alongside other objects.
+    virtual bool IsThreadSafe() const { return false; }
 };
 
 template<typename T>
@@ -241,6 +350,165 @@ struct Object
     virtual void Update() override {}
 };
 
+enum class BlendMode : std::uint8_t {
+    NOBLEND,
+    ALPHA,
+    ADD,
+    SUB
+};
+
+enum class DrawMode : std::uint8_t {
+    NEAREST,
+    BILINEAR
+};
+
+// Draw calls recorded during a frame and replayed by Flush(). Each command carries the state that was
+// current when it was recorded and a 64-bit key: layer (8 bits), blend mode (3), draw mode (1), draw area (8),
+// texture (20) and depth (24), most significant first. Flush() radix-sorts the keys, so within a layer
+// commands are grouped by state and texture rather than kept in submission order. Depth is the lowest field:
+// it only orders commands that also share blend mode, draw mode, draw area and texture, so sprites that must
+// overlap in a fixed order belong on different layers. Replay skips SetDrawBlendMode, SetDrawMode and
+// SetDrawArea calls that would not change anything.
+struct DrawCommandBuffer {
+    enum class CommandType : std::uint8_t {
+        RECT_ROTA_GRAPH,
+        RECT_GRAPH,
+        DRAWABLE
+    };
+
+    struct Command {
+        CommandType type{};
+        BlendMode blend_mode{};
+        std::uint8_t blend_param{};
+        DrawMode draw_mode{};
+        std::uint8_t area{};
+        bool transparent{};
+        int handle{-1};
+        int src_x{}, src_y{}, src_width{}, src_height{};
+        float x{}, y{}, center_x{}, center_y{}, scale_x{1.0f}, scale_y{1.0f}, angle{};
+        const Drawable * drawable{};
+    };
+
+    struct Stats {
+        std::size_t commands{};
+        std::size_t state_changes{}; // state calls issued
+        std::size_t elided{};        // state calls skipped because the state already matched
+        std::size_t culled{};        // commands rejected by the camera when they were recorded
+    };
+
+    static constexpr std::size_t MAX_AREAS = 256;
+
+    void SetLayer(std::uint8_t layer) { this->layer = layer; }
+    std::uint8_t GetLayer() const { return layer; }
+    // Lower depths replay first among commands whose other key fields match. Only the low 24 bits are used.
+    void SetDepth(std::uint32_t depth) { this->depth = depth & 0xffffffu; }
+    std::uint32_t GetDepth() const { return depth; }
+    void SetBlendMode(BlendMode mode, int param = 255);
+    void SetDrawMode(DrawMode mode) { draw_mode = mode; }
+    // Clips following commands to [x1, x2) x [y1, y2). ResetDrawArea() returns to the whole screen, as do
+    // Flush() and Clear(), since areas are numbered per frame.
+    void SetDrawArea(int x1, int y1, int x2, int y2);
+    void ResetDrawArea() { area = 0; }
+
+    // Positions are in world space: the camera set on Screen is applied when recording, and commands whose
+    // bounds miss its view are dropped and counted in Stats::culled.
+    // Draws the source rectangle of handle rotated by angle about (center_x, center_y), which lands on (x, y).
+    void DrawRectRotaGraph(
+        double x, double y, int src_x, int src_y, int src_width, int src_height,
+        double center_x, double center_y, double scale_x, double scale_y, double angle,
+        int handle, bool transparent = true
+    );
+    void DrawRectGraph(double x, double y, int src_x, int src_y, int src_width, int src_height, int handle, bool transparent = true);
+    // drawable must stay alive until the next Flush() or Clear().
+    void DrawDrawable(const Drawable & drawable);
+    // Moves in the commands recorded by other, after this buffer's own, and clears other. Draw areas are
+    // renumbered into this buffer's table; layers, depths and states are kept.
+    void Append(DrawCommandBuffer & other);
+
+    // Sorts and replays the recorded commands, then clears them and restores the default state.
+    void Flush();
+    void Clear();
+    std::size_t GetSize() const { return commands.size(); }
+    const Stats & GetStats() const { return stats; } // of the last Flush()
+
+private:
+    struct area_t {
+        int x1, y1, x2, y2;
+    };
+
+    void push(Command command);
+    std::uint8_t find_area(const area_t & a);
+    void sort();
+
+    std::vector<Command> commands;
+    std::vector<std::uint64_t> keys, sort_keys;
+    std::vector<std::uint32_t> order, sort_order;
+    std::vector<area_t> areas{area_t{}};
+    std::uint8_t layer{};
+    std::uint32_t depth{};
+    BlendMode blend_mode{};
+    std::uint8_t blend_param{255};
+    DrawMode draw_mode{};
+    std::uint8_t area{};
+    std::size_t culled{};
+    Stats stats;
+};
+
+// Drawables kept in draw order: by layer, then by z within a layer, back to front. Changes to z and layer
+// are queued and applied by Refresh(), which takes out only the changed drawables, sorts them and merges
+// them back in, so a frame in which few drawables move costs a linear pass over the affected layers rather
+// than a full sort. Equal z values are ordered by id.
+struct LayeredDrawList {
+    static constexpr std::size_t LAYER_COUNT = 256;
+
+    // drawable must stay alive until it is removed. The returned id stays valid until Remove(); the ids of
+    // removed drawables are reused. Passing an id that is not live throws.
+    std::size_t Add(const Drawable & drawable, std::uint8_t layer = 0, double z = 0.0);
+    void Remove(std::size_t id);
+    void Clear();
+    std::size_t GetSize() const { return size; }
+
+    const Drawable & Get(std::size_t id) const { check_id(id); return *drawables[id]; }
+    std::uint8_t GetLayer(std::size_t id) const { check_id(id); return layers[id]; }
+    void SetLayer(std::size_t id, std::uint8_t layer);
+    double GetZ(std::size_t id) const { check_id(id); return zs[id]; }
+    void SetZ(std::size_t id, double z);
+    // Disabled layers keep their order but are skipped by Draw().
+    bool IsLayerEnabled(std::uint8_t layer) const { return enabled[layer]; }
+    void SetLayerEnabled(std::uint8_t layer, bool enabled) { this->enabled[layer] = enabled; }
+
+    // Applies the changes made since the last call. Draw() calls it.
+    void Refresh();
+    // Ids on layer, back to front, as of the last Refresh().
+    const std::vector<std::uint32_t> & GetOrder(std::uint8_t layer) const { return orders[layer]; }
+    std::size_t GetMovedCount() const { return moved; } // drawables re-positioned by the last Refresh()
+    // Draws the enabled layers from 0 up.
+    void Draw();
+
+private:
+    void queue(std::size_t id);
+    void check_id(std::size_t id) const {
+        if (id >= drawables.size() || drawables[id] == nullptr)
+            throw std::runtime_error("LayeredDrawList id is invalid.");
+    }
+
+    std::vector<const Drawable *> drawables; // null for removed ids
+    std::vector<double> zs;
+    std::vector<std::uint8_t> layers;
+    std::vector<bool> queued;
+    std::vector<std::uint32_t> free_ids, pending, merged;
+    std::array<std::vector<std::uint32_t>, LAYER_COUNT> orders;
+    std::array<bool, LAYER_COUNT> dirty{};
+    std::array<bool, LAYER_COUNT> enabled = make_enabled();
+    std::size_t size{}, moved{};
+
+    static std::array<bool, LAYER_COUNT> make_enabled() {
+        std::array<bool, LAYER_COUNT> layers;
+        layers.fill(true);
+        return layers;
+    }
+};
+
 struct Graph : Object {
     Graph();
     Graph(std::string_view path);
@@ -255,10 +523,12 @@ struct Graph : Object {
     virtual double GetWidth() const override { return width; }
     virtual double GetHeight() const override { return height; }
     virtual void SetWidth(double width) override { this->width = width; }
-    virtual void SetHeight(double heihgt) override { this->height = height; }
+    virtual void SetHeight(double height) override { this->height = height; }
     virtual double GetTheta() const override { return theta; }
     virtual void SetTheta(double theta) override { this->theta = theta; }
+    virtual void Submit(DrawCommandBuffer & buffer) const override;
     virtual void Load(std::string_view path);
+    int GetHandle() const;
     static Iterator<Graph &> LoadDivGraph(
         std::string_view path,
         std::size_t number,
@@ -272,24 +542,191 @@ private:
     std::unique_ptr<impl_t> impl;
 };
 
+// A texture cut into a grid of equally sized cells. The sheet holds the one texture handle; a cell is the
+// handle plus a source rectangle, computed from its index. Copies share the texture, which is released
+// together with any graphs derived from it when the last copy goes away.
+struct SpriteSheet {
+    struct Cell {
+        int handle{-1};
+        int x{}, y{}, width{}, height{};
+    };
+
+    SpriteSheet() = default;
+    SpriteSheet(
+        std::string_view path,
+        std::size_t number,
+        std::size_t column_number, std::size_t row_number,
+        std::size_t column_width, std::size_t row_height
+    );
+    void Load(
+        std::string_view path,
+        std::size_t number,
+        std::size_t column_number, std::size_t row_number,
+        std::size_t column_width, std::size_t row_height
+    );
+
+    int GetHandle() const;
+    std::size_t GetCellNumber() const { return number; }
+    // Throws std::out_of_range unless index < GetCellNumber(); Draw() and Submit() check through it.
+    Cell GetCell(std::size_t index) const {
+        if (index >= number)
+            throw std::out_of_range("SpriteSheet cell is out of range.");
+        return Cell{
+            GetHandle(),
+            static_cast<int>(index % column_number * column_width), static_cast<int>(index / column_number * row_height),
+            static_cast<int>(column_width), static_cast<int>(row_height)
+        };
+    }
+    // Draws the cell unscaled with its top-left corner at (x, y).
+    void Draw(std::size_t index, double x, double y) const;
+    void Submit(DrawCommandBuffer & buffer, std::size_t index, double x, double y) const;
+
+private:
+    std::size_t number{}, column_number{1}, column_width{}, row_height{};
+    struct owner_t;
+    std::shared_ptr<const owner_t> owner;
+};
+
+// Immutable frame table shared by any number of Animations. Frames are stored contiguously; each names a
+// graph handle, the source rectangle within it and how long it stays on screen, in seconds.
+struct AnimationClip {
+    struct Frame {
+        int handle{-1};
+        int x{}, y{}, width{}, height{};
+        double duration{};
+    };
+
+    // Each graph is shown whole for the paired number of seconds. The clip keeps the graphs alive.
+    AnimationClip(const std::vector<std::pair<Graph, double>> & frames);
+    // owners keep the handles referenced by frames alive for the lifetime of the clip.
+    AnimationClip(std::vector<Frame> frames, std::vector<Graph> owners = {});
+
+    std::size_t GetFrameNumber() const { return frames.size(); }
+    const Frame & GetFrame(std::size_t index) const { return frames[index]; }
+    const std::vector<Frame> & GetFrames() const { return frames; }
+    double GetDuration() const { return duration; }
+    // The owner whose handle frame index draws, or nullptr when the clip does not own that handle.
+    const Graph * GetGraph(std::size_t index) const;
+
+private:
+    std::vector<Frame> frames;
+    std::vector<Graph> owners;
+    double duration{};
+};
+
+enum class AnimationMode : std::uint8_t {
+    LOOP,       // wraps from the last frame to the first
+    ONCE,       // stops on the last frame
+    PING_PONG   // plays forward, then backward, and so on
+};
+
+// A playback cursor over a shared AnimationClip. Width and height default to the current frame's size.
 struct Animation : Object {
     using frame = std::pair<std::shared_ptr<Graph>, std::size_t>;
-    Animation(const std::shared_ptr<Iterator<std::shared_ptr<frame>>> & frame_iterator) {
-        while (frame_iterator->HasNext())
-            frames->push_back(frame_iterator->Next());
-        if (frames->empty()) throw std::logic_error("Animation must be not empty.");
-    }
-    std::shared_ptr<Graph> GetCurrentGraph() const { return frames->at(index)->first; }
-    virtual void Draw() const override { GetCurrentGraph()->Draw(); }
-    virtual double GetWidth() const override { return frames->front()->first->GetWidth(); }
-    virtual double GetHeight() const override { return frames->front()->first->GetHeight(); }
-    virtual void Update() override { if (++count > frames->at(index)->second) { count = 0; ++index %= frames->size(); } }
-private:
-    std::shared_ptr<std::vector<std::shared_ptr<frame>>> frames{
-        std::make_shared<std::vector<std::shared_ptr<frame>>>()
-    };
-    std::size_t count{};
-    std::size_t index{};
+    Animation(std::shared_ptr<const AnimationClip> clip, AnimationMode mode = AnimationMode::LOOP);
+    // Builds a clip used by this instance only; prefer sharing one AnimationClip between instances. Frame
+    // durations are counted in updates of System::GetTimestep() seconds, as before playback was time based.
+    // The animation starts at the first frame graph's position and rotation, and its size if it was resized.
+    Animation(const std::shared_ptr<Iterator<std::shared_ptr<frame>>> & frame_iterator);
+
+    const std::shared_ptr<const AnimationClip> & GetClip() const { return clip; }
+    const AnimationClip::Frame & GetCurrentFrame() const { return clip->GetFrame(index); }
+    // Frames are no longer Graph objects. This returns a copy of the current frame's owner with the
+    // animation's position, size and rotation, or nullptr; moving the copy does not move the animation.
+    [[deprecated("Use GetCurrentFrame(); an Animation draws at its own position.")]]
+    std::shared_ptr<Graph> GetCurrentGraph() const;
+    std::size_t GetFrameIndex() const { return index; }
+    void SetFrameIndex(std::size_t index);
+    AnimationMode GetMode() const { return mode; }
+    // A finished animation switched to LOOP or PING_PONG plays on from its last frame.
+    void SetMode(AnimationMode mode) {
+        if (IsFinished() && mode != AnimationMode::ONCE)
+            remaining = GetCurrentFrame().duration;
+        this->mode = mode;
+    }
+    double GetSpeed() const { return speed; }
+    void SetSpeed(double speed) { this->speed = (std::max)(speed, 0.0); }
+    // Only an AnimationMode::ONCE animation finishes, upon reaching the end of its last frame.
+    bool IsFinished() const { return std::isinf(remaining); }
+    void Restart() { SetFrameIndex(0); }
+
+    // Moves playback forward by seconds times the speed.
+    void Advance(double seconds);
+    virtual void Draw() const override;
+    virtual void Submit(DrawCommandBuffer & buffer) const override;
+    // Advances by System::GetDeltaTime().
+    virtual void Update() override;
+    virtual double GetX() const override { return x; }
+    virtual double GetY() const override { return y; }
+    virtual void SetX(double x) override { this->x = x; }
+    virtual void SetY(double y) override { this->y = y; }
+    virtual double GetWidth() const override { return width > 0.0 ? width : GetCurrentFrame().width; }
+    virtual double GetHeight() const override { return height > 0.0 ? height : GetCurrentFrame().height; }
+    virtual void SetWidth(double width) override { this->width = width; }
+    virtual void SetHeight(double height) override { this->height = height; }
+    virtual double GetTheta() const override { return theta; }
+    virtual void SetTheta(double theta) override { this->theta = theta; }
+
+private:
+    std::shared_ptr<const AnimationClip> clip;
+    double remaining{}; // time left on the current frame; infinite once finished
+    double speed{1.0};
+    std::uint32_t index{};
+    std::int8_t direction{1};
+    AnimationMode mode{};
+    double x{}, y{}, width{}, height{}, theta{};
+};
+
+enum class AnimationEventType : std::uint8_t {
+    FRAME,  // entered another frame
+    LOOP,   // wrapped to the first frame, or turned around in AnimationMode::PING_PONG
+    FINISH  // reached the end of an AnimationMode::ONCE animation
+};
+
+struct AnimationEvent {
+    std::size_t id;
+    std::uint32_t frame; // frame index after the event
+    AnimationEventType type;
+};
+
+// Playback cursors for many animations, stored as parallel arrays. Update() runs one pass over the remaining
+// times, which the compiler can vectorize, then walks only the cursors that crossed a frame boundary.
+struct AnimationBatch {
+    // Returns the new cursor's id, which stays valid until a Remove() moves another cursor into it.
+    std::size_t Add(std::shared_ptr<const AnimationClip> clip, AnimationMode mode = AnimationMode::LOOP, double speed = 1.0);
+    // Moves the last cursor into id's place, so the last id becomes id.
+    void Remove(std::size_t id);
+    void Clear();
+    std::size_t GetSize() const { return clips.size(); }
+
+    void Update(double seconds);
+    // Events raised by the last Update(), in cursor order.
+    const std::vector<AnimationEvent> & GetEvents() const { return events; }
+
+    const AnimationClip & GetClip(std::size_t id) const { return *clips[id]; }
+    const AnimationClip::Frame & GetCurrentFrame(std::size_t id) const { return clips[id]->GetFrame(indices[id]); }
+    std::size_t GetFrameIndex(std::size_t id) const { return indices[id]; }
+    void SetFrameIndex(std::size_t id, std::size_t index);
+    AnimationMode GetMode(std::size_t id) const { return modes[id]; }
+    // A finished cursor switched to LOOP or PING_PONG plays on from its last frame.
+    void SetMode(std::size_t id, AnimationMode mode) {
+        if (IsFinished(id) && mode != AnimationMode::ONCE)
+            remaining[id] = GetCurrentFrame(id).duration;
+        modes[id] = mode;
+    }
+    double GetSpeed(std::size_t id) const { return speeds[id]; }
+    void SetSpeed(std::size_t id, double speed) { speeds[id] = (std::max)(speed, 0.0); }
+    bool IsFinished(std::size_t id) const { return std::isinf(remaining[id]); }
+    void Restart(std::size_t id) { SetFrameIndex(id, 0); }
+
+private:
+    std::vector<double> remaining;
+    std::vector<double> speeds;
+    std::vector<std::uint32_t> indices;
+    std::vector<std::int8_t> directions;
+    std::vector<AnimationMode> modes;
+    std::vector<std::shared_ptr<const AnimationClip>> clips;
+    std::vector<AnimationEvent> events;
 };
 
 struct Font : Object {
@@ -321,6 +758,8 @@ private:
     std::unique_ptr<impl_t> impl;
 };
 
+struct JobSystem;
+
 template<typename T>
 struct As {
     As();
@@ -338,6 +777,11 @@ struct Global {
     template<typename T> static void RequestAttachment(As<T> & obj);
     static void ResolveAttachment();
     template<typename T, typename ... Args> static std::shared_ptr<T> Create(Args && ... args);
+    // Updates list<T>(): thread-safe objects in parallel on jobs, then the rest in list order on this thread.
+    template<typename T> static void Update(JobSystem & jobs);
+    // Fills drawables with the objects of list<T>() that pass visible, in list order. visible runs in parallel
+    // on jobs and must not call DxLib; draw the result on the main thread.
+    template<typename T, typename Predicate> static void PrepareDrawList(JobSystem & jobs, std::vector<const T *> & drawables, Predicate visible);
 };
 
 template<typename T> As<T>::As() { Global::RequestAttachment<T>(*this); }
@@ -358,10 +802,62 @@ template<typename T, typename ... Args> std::shared_ptr<T> Global::Create(Args &
     return ptr;
 }
 
+// Timing of the last frame run by System::Run(). Times are in seconds.
+struct FrameMetrics {
+    double frame_time{};        // wall time between the starts of the last two frames
+    double update_time{};       // time spent in the update callbacks of the last frame
+    double draw_time{};         // time spent in the draw callback of the last frame
+    int update_count{};         // fixed steps run in the last frame
+    double alpha{};             // interpolation factor passed to draw, in [0, 1)
+    std::uint64_t frame_count{};
+    std::uint64_t dropped_frames{}; // frames that hit the catch-up cap and discarded simulation time
+};
+
+// DxLib calls made through the library during one frame, taken at each System::Update().
+struct FrameStats {
+    struct Entry {
+        const char * name;
+        std::uint32_t calls;
+        double time; // seconds
+    };
+    std::vector<Entry> entries; // functions called at least once, in declaration order
+    std::uint32_t total_calls{};
+    double total_time{};
+};
+
 struct SystemInitializer;
 struct System {
     friend struct SystemInitializer;
     static bool Update();
+
+    // Runs update at a fixed timestep and draw once per frame, until the window closes or Quit() is called.
+    // A slow frame is caught up with at most GetMaxUpdatesPerFrame() steps; the remaining backlog is
+    // dropped rather than allowed to grow. draw receives how far the simulation is between its last two
+    // steps, for interpolating positions.
+    static void Run(const std::function<void()> & update, const std::function<void(double alpha)> & draw);
+    static void Quit() noexcept;
+
+    static void SetTimestep(double seconds);
+    static double GetTimestep() noexcept;
+    static void SetMaxUpdatesPerFrame(int count);
+    static int GetMaxUpdatesPerFrame() noexcept;
+    // Sleeps so that frames start at most frames_per_second times a second. 0 (the default) leaves pacing
+    // to ScreenFlip and vsync.
+    static void SetFrameRateLimit(double frames_per_second);
+    static double GetFrameRateLimit() noexcept;
+
+    // The fixed timestep inside an update callback of Run(), the time between the last two Update() calls
+    // otherwise.
+    static double GetDeltaTime() noexcept;
+    static const FrameMetrics & GetFrameMetrics() noexcept;
+
+    // Call counting is off by default; while off each wrapped call costs one flag test. Building the
+    // library with DXLIBPP_CALL_STATS=0 removes the counters entirely.
+    static void SetFrameStatsEnabled(bool enabled) noexcept;
+    static bool IsFrameStatsEnabled() noexcept;
+    static const FrameStats & GetFrameStats() noexcept;
+    // Draws the last frame's stats in the top-left corner, just before ScreenFlip.
+    static void SetFrameStatsOverlay(bool visible) noexcept;
 };
 
 static struct SystemInitializer {
@@ -369,9 +865,31 @@ static struct SystemInitializer {
     ~SystemInitializer();
 } system_initializer;
 
+// Objects drawn and rejected by the camera view test.
+struct CullStats {
+    std::uint64_t drawn{};
+    std::uint64_t culled{};
+};
+
 struct Screen {
     static int GetWidth();
     static int GetHeight();
+
+    // Graph, Animation, SpriteSheet, TiledMap, Font, ParticleSystem and DrawCommandBuffer draw through this
+    // camera. Graphs, animations, sprite sheet cells and buffer commands whose bounds miss the view are
+    // dropped before any DxLib call. The view is computed from the screen size here, so set the camera again
+    // after resizing. Until the first call nothing is culled. Call it on the main thread only, never while
+    // jobs are submitting.
+    static void SetCamera(const Camera & camera);
+    // Returns to the identity camera with culling off.
+    static void ResetCamera();
+    static const Camera & GetCamera();
+    // The world-space rectangle seen through the camera; empty until SetCamera() is called.
+    static const Rect & GetView();
+    // True if the world-space rectangle r may be on screen.
+    static bool IsVisible(const Rect & r);
+    // Counts for the last frame, taken at each System::Update().
+    static const CullStats & GetCullStats();
 };
 
 struct Sound {
@@ -396,140 +914,551 @@ private:
     std::unique_ptr<impl_t> impl;
 };
 
+// Keyboard state of one frame. Key codes outside [0, 255] read as released.
+struct InputSnapshot {
+    using bits_type = std::array<std::uint64_t, 4>;
+
+    InputSnapshot() noexcept {}
+    InputSnapshot(const InputSnapshot & previous, const bits_type & down) noexcept;
+    InputSnapshot(const InputSnapshot & previous, const char * key_state) noexcept;
+
+    bool IsDown(int key_code) const noexcept { return test(down, key_code); }
+    bool IsPressed(int key_code) const noexcept { return test(pressed, key_code); }
+    bool IsReleased(int key_code) const noexcept { return test(released, key_code); }
+
+    int GetTimer(int key_code) const noexcept {
+        unsigned index = static_cast<unsigned>(key_code) & 255;
+        return static_cast<int>(test(down, key_code)) * static_cast<int>(frame - press_frames[index] + 1);
+    }
+
+    const bits_type & GetDown() const noexcept { return down; }
+    const bits_type & GetPressed() const noexcept { return pressed; }
+    const bits_type & GetReleased() const noexcept { return released; }
+    std::uint32_t GetFrame() const noexcept { return frame; }
+
+    static constexpr int PAD_COUNT = 4;
+
+    // Buttons use the PAD_INPUT_* bit layout; x and y are in [-1, 1] with the dead zone already removed.
+    struct Pad {
+        std::uint32_t down{}, pressed{}, released{};
+        float x{}, y{};
+    };
+
+    // Buttons use the MOUSE_INPUT_* bit layout.
+    struct Mouse {
+        int x{}, y{};
+        std::uint32_t down{}, pressed{}, released{};
+    };
+
+    // Pads outside [0, PAD_COUNT) read as disconnected.
+    const Pad & GetPad(int index) const noexcept {
+        static const Pad disconnected{};
+        return static_cast<unsigned>(index) < PAD_COUNT ? pads[index] : disconnected;
+    }
+    const Mouse & GetMouse() const noexcept { return mouse; }
+
+    void SetPad(const InputSnapshot & previous, int index, std::uint32_t buttons, float x, float y) noexcept;
+    void SetMouse(const InputSnapshot & previous, int x, int y, std::uint32_t buttons) noexcept;
+
+private:
+    static bool test(const bits_type & bits, int key_code) noexcept {
+        unsigned index = static_cast<unsigned>(key_code);
+        std::uint64_t valid = index < 256;
+        index &= 255;
+        return ((bits[index >> 6] >> (index & 63)) & valid) != 0;
+    }
+
+    bits_type down{}, pressed{}, released{};
+    std::uint32_t frame{};
+    std::array<std::uint32_t, 256> press_frames{};
+    std::array<Pad, PAD_COUNT> pads{};
+    Mouse mouse{};
+};
+
 struct Key {
     friend struct System;
-    static bool CheckHit(int key_code);
-    static int GetTimer(int key_code);
-
-    static const int INPUT_BACK;
-    static const int INPUT_TAB;
-    static const int INPUT_RETURN;
-
-    static const int INPUT_LSHIFT;
-    static const int INPUT_RSHIFT;
-    static const int INPUT_LCONTROL;
-    static const int INPUT_RCONTROL;
-    static const int INPUT_ESCAPE;
-    static const int INPUT_SPACE;
-    static const int INPUT_PGUP;
-    static const int INPUT_PGDN;
-    static const int INPUT_END;
-    static const int INPUT_HOME;
-    static const int INPUT_LEFT;
-    static const int INPUT_UP;
-    static const int INPUT_RIGHT;
-    static const int INPUT_DOWN;
-    static const int INPUT_INSERT;
-    static const int INPUT_DELETE;
-
-    static const int INPUT_MINUS;
-    static const int INPUT_YEN;
-    static const int INPUT_PREVTRACK;
-    static const int INPUT_PERIOD;
-    static const int INPUT_SLASH;
-    static const int INPUT_LALT;
-    static const int INPUT_RALT;
-    static const int INPUT_SCROLL;
-    static const int INPUT_SEMICOLON;
-    static const int INPUT_COLON;
-    static const int INPUT_LBRACKET;
-    static const int INPUT_RBRACKET;
-    static const int INPUT_AT;
-    static const int INPUT_BACKSLASH;
-    static const int INPUT_COMMA;
-    static const int INPUT_CAPSLOCK;
-    static const int INPUT_PAUSE;
-
-    static const int INPUT_NUMPAD0;
-    static const int INPUT_NUMPAD1;
-    static const int INPUT_NUMPAD2;
-    static const int INPUT_NUMPAD3;
-    static const int INPUT_NUMPAD4;
-    static const int INPUT_NUMPAD5;
-    static const int INPUT_NUMPAD6;
-    static const int INPUT_NUMPAD7;
-    static const int INPUT_NUMPAD8;
-    static const int INPUT_NUMPAD9;
-    static const int INPUT_MULTIPLY;
-    static const int INPUT_ADD;
-    static const int INPUT_SUBTRACT;
-    static const int INPUT_DECIMAL;
-    static const int INPUT_DIVIDE;
-    static const int INPUT_NUMPADENTER;
-
-    static const int INPUT_F1;
-    static const int INPUT_F2;
-    static const int INPUT_F3;
-    static const int INPUT_F4;
-    static const int INPUT_F5;
-    static const int INPUT_F6;
-    static const int INPUT_F7;
-    static const int INPUT_F8;
-    static const int INPUT_F9;
-    static const int INPUT_F10;
-    static const int INPUT_F11;
-    static const int INPUT_F12;
-
-    static const int INPUT_A;
-    static const int INPUT_B;
-    static const int INPUT_C;
-    static const int INPUT_D;
-    static const int INPUT_E;
-    static const int INPUT_F;
-    static const int INPUT_G;
-    static const int INPUT_H;
-    static const int INPUT_I;
-    static const int INPUT_J;
-    static const int INPUT_K;
-    static const int INPUT_L;
-    static const int INPUT_M;
-    static const int INPUT_N;
-    static const int INPUT_O;
-    static const int INPUT_P;
-    static const int INPUT_Q;
-    static const int INPUT_R;
-    static const int INPUT_S;
-    static const int INPUT_T;
-    static const int INPUT_U;
-    static const int INPUT_V;
-    static const int INPUT_W;
-    static const int INPUT_X;
-    static const int INPUT_Y;
-    static const int INPUT_Z;
-    static const int INPUT_0;
-    static const int INPUT_1;
-    static const int INPUT_2;
-    static const int INPUT_3;
-    static const int INPUT_4;
-    static const int INPUT_5;
-    static const int INPUT_6;
-    static const int INPUT_7;
-    static const int INPUT_8;
-    static const int INPUT_9;
+    static bool CheckHit(int key_code) noexcept;
+    static bool CheckPressed(int key_code) noexcept;
+    static bool CheckReleased(int key_code) noexcept;
+    static int GetTimer(int key_code) noexcept;
+    static const InputSnapshot & GetSnapshot() noexcept;
+
+    static constexpr int INPUT_BACK = 0x0E;
+    static constexpr int INPUT_TAB = 0x0F;
+    static constexpr int INPUT_RETURN = 0x1C;
+
+    static constexpr int INPUT_LSHIFT = 0x2A;
+    static constexpr int INPUT_RSHIFT = 0x36;
+    static constexpr int INPUT_LCONTROL = 0x1D;
+    static constexpr int INPUT_RCONTROL = 0x9D;
+    static constexpr int INPUT_ESCAPE = 0x01;
+    static constexpr int INPUT_SPACE = 0x39;
+    static constexpr int INPUT_PGUP = 0xC9;
+    static constexpr int INPUT_PGDN = 0xD1;
+    static constexpr int INPUT_END = 0xCF;
+    static constexpr int INPUT_HOME = 0xC7;
+    static constexpr int INPUT_LEFT = 0xCB;
+    static constexpr int INPUT_UP = 0xC8;
+    static constexpr int INPUT_RIGHT = 0xCD;
+    static constexpr int INPUT_DOWN = 0xD0;
+    static constexpr int INPUT_INSERT = 0xD2;
+    static constexpr int INPUT_DELETE = 0xD3;
+
+    static constexpr int INPUT_MINUS = 0x0C;
+    static constexpr int INPUT_YEN = 0x7D;
+    static constexpr int INPUT_PREVTRACK = 0x90;
+    static constexpr int INPUT_PERIOD = 0x34;
+    static constexpr int INPUT_SLASH = 0x35;
+    static constexpr int INPUT_LALT = 0x38;
+    static constexpr int INPUT_RALT = 0xB8;
+    static constexpr int INPUT_SCROLL = 0x46;
+    static constexpr int INPUT_SEMICOLON = 0x27;
+    static constexpr int INPUT_COLON = 0x92;
+    static constexpr int INPUT_LBRACKET = 0x1A;
+    static constexpr int INPUT_RBRACKET = 0x1B;
+    static constexpr int INPUT_AT = 0x91;
+    static constexpr int INPUT_BACKSLASH = 0x2B;
+    static constexpr int INPUT_COMMA = 0x33;
+    static constexpr int INPUT_CAPSLOCK = 0x3A;
+    static constexpr int INPUT_PAUSE = 0xC5;
+
+    static constexpr int INPUT_NUMPAD0 = 0x52;
+    static constexpr int INPUT_NUMPAD1 = 0x4F;
+    static constexpr int INPUT_NUMPAD2 = 0x50;
+    static constexpr int INPUT_NUMPAD3 = 0x51;
+    static constexpr int INPUT_NUMPAD4 = 0x4B;
+    static constexpr int INPUT_NUMPAD5 = 0x4C;
+    static constexpr int INPUT_NUMPAD6 = 0x4D;
+    static constexpr int INPUT_NUMPAD7 = 0x47;
+    static constexpr int INPUT_NUMPAD8 = 0x48;
+    static constexpr int INPUT_NUMPAD9 = 0x49;
+    static constexpr int INPUT_MULTIPLY = 0x37;
+    static constexpr int INPUT_ADD = 0x4E;
+    static constexpr int INPUT_SUBTRACT = 0x4A;
+    static constexpr int INPUT_DECIMAL = 0x53;
+    static constexpr int INPUT_DIVIDE = 0xB5;
+    static constexpr int INPUT_NUMPADENTER = 0x9C;
+
+    static constexpr int INPUT_F1 = 0x3B;
+    static constexpr int INPUT_F2 = 0x3C;
+    static constexpr int INPUT_F3 = 0x3D;
+    static constexpr int INPUT_F4 = 0x3E;
+    static constexpr int INPUT_F5 = 0x3F;
+    static constexpr int INPUT_F6 = 0x40;
+    static constexpr int INPUT_F7 = 0x41;
+    static constexpr int INPUT_F8 = 0x42;
+    static constexpr int INPUT_F9 = 0x43;
+    static constexpr int INPUT_F10 = 0x44;
+    static constexpr int INPUT_F11 = 0x57;
+    static constexpr int INPUT_F12 = 0x58;
+
+    static constexpr int INPUT_A = 0x1E;
+    static constexpr int INPUT_B = 0x30;
+    static constexpr int INPUT_C = 0x2E;
+    static constexpr int INPUT_D = 0x20;
+    static constexpr int INPUT_E = 0x12;
+    static constexpr int INPUT_F = 0x21;
+    static constexpr int INPUT_G = 0x22;
+    static constexpr int INPUT_H = 0x23;
+    static constexpr int INPUT_I = 0x17;
+    static constexpr int INPUT_J = 0x24;
+    static constexpr int INPUT_K = 0x25;
+    static constexpr int INPUT_L = 0x26;
+    static constexpr int INPUT_M = 0x32;
+    static constexpr int INPUT_N = 0x31;
+    static constexpr int INPUT_O = 0x18;
+    static constexpr int INPUT_P = 0x19;
+    static constexpr int INPUT_Q = 0x10;
+    static constexpr int INPUT_R = 0x13;
+    static constexpr int INPUT_S = 0x1F;
+    static constexpr int INPUT_T = 0x14;
+    static constexpr int INPUT_U = 0x16;
+    static constexpr int INPUT_V = 0x2F;
+    static constexpr int INPUT_W = 0x11;
+    static constexpr int INPUT_X = 0x2D;
+    static constexpr int INPUT_Y = 0x15;
+    static constexpr int INPUT_Z = 0x2C;
+    static constexpr int INPUT_0 = 0x0B;
+    static constexpr int INPUT_1 = 0x02;
+    static constexpr int INPUT_2 = 0x03;
+    static constexpr int INPUT_3 = 0x04;
+    static constexpr int INPUT_4 = 0x05;
+    static constexpr int INPUT_5 = 0x06;
+    static constexpr int INPUT_6 = 0x07;
+    static constexpr int INPUT_7 = 0x08;
+    static constexpr int INPUT_8 = 0x09;
+    static constexpr int INPUT_9 = 0x0A;
+};
+
+// Joypads are indexed from 0 (DX_INPUT_PAD1). State is polled once per System::Update().
+struct Joypad {
+    static bool CheckHit(int pad, std::uint32_t buttons) noexcept { return (GetState(pad).down & buttons) != 0; }
+    static bool CheckPressed(int pad, std::uint32_t buttons) noexcept { return (GetState(pad).pressed & buttons) != 0; }
+    static bool CheckReleased(int pad, std::uint32_t buttons) noexcept { return (GetState(pad).released & buttons) != 0; }
+    static float GetX(int pad) noexcept { return GetState(pad).x; }
+    static float GetY(int pad) noexcept { return GetState(pad).y; }
+    static const InputSnapshot::Pad & GetState(int pad) noexcept { return Key::GetSnapshot().GetPad(pad); }
+    static int GetCount() noexcept;
+
+    // Fraction of full deflection below which the stick reads as centred. Defaults to 0.2.
+    static void SetDeadZone(float dead_zone) noexcept;
+    static float GetDeadZone() noexcept;
+
+    static constexpr std::uint32_t INPUT_DOWN = 0x00000001;
+    static constexpr std::uint32_t INPUT_LEFT = 0x00000002;
+    static constexpr std::uint32_t INPUT_RIGHT = 0x00000004;
+    static constexpr std::uint32_t INPUT_UP = 0x00000008;
+    static constexpr std::uint32_t INPUT_A = 0x00000010;
+    static constexpr std::uint32_t INPUT_B = 0x00000020;
+    static constexpr std::uint32_t INPUT_C = 0x00000040;
+    static constexpr std::uint32_t INPUT_X = 0x00000080;
+    static constexpr std::uint32_t INPUT_Y = 0x00000100;
+    static constexpr std::uint32_t INPUT_Z = 0x00000200;
+    static constexpr std::uint32_t INPUT_L = 0x00000400;
+    static constexpr std::uint32_t INPUT_R = 0x00000800;
+    static constexpr std::uint32_t INPUT_START = 0x00001000;
+    static constexpr std::uint32_t INPUT_M = 0x00002000;
+};
+
+// Mouse position in client coordinates and button state, polled once per System::Update().
+struct Mouse {
+    static int GetX() noexcept { return Key::GetSnapshot().GetMouse().x; }
+    static int GetY() noexcept { return Key::GetSnapshot().GetMouse().y; }
+    static Point GetPosition() noexcept { return Point{static_cast<double>(GetX()), static_cast<double>(GetY())}; }
+    static bool CheckHit(std::uint32_t buttons) noexcept { return (Key::GetSnapshot().GetMouse().down & buttons) != 0; }
+    static bool CheckPressed(std::uint32_t buttons) noexcept { return (Key::GetSnapshot().GetMouse().pressed & buttons) != 0; }
+    static bool CheckReleased(std::uint32_t buttons) noexcept { return (Key::GetSnapshot().GetMouse().released & buttons) != 0; }
+
+    static constexpr std::uint32_t INPUT_LEFT = 0x0001;
+    static constexpr std::uint32_t INPUT_RIGHT = 0x0002;
+    static constexpr std::uint32_t INPUT_MIDDLE = 0x0004;
+};
+
+// Records the keyboard state seen by System::Update() into a compact stream.
+// Each frame stores only the keys that toggled; unchanged frames collapse into runs.
+struct InputRecorder {
+    static void Start();
+    static std::vector<std::uint8_t> Stop();
+    static void Save(std::string_view path);
+    static bool IsRecording() noexcept;
+    static std::uint32_t GetFrameCount() noexcept;
+};
+
+// Feeds a recorded stream to Key instead of the device, one frame per System::Update().
+// Live input resumes once the stream is exhausted.
+struct InputReplayer {
+    static void Start(std::vector<std::uint8_t> data);
+    static void Load(std::string_view path);
+    static void Stop() noexcept;
+    static bool IsReplaying() noexcept;
+};
+
+// Bounded single-producer/single-consumer ring. Push and Pop never block; Push fails when the ring is full.
+template<typename T, std::size_t Capacity>
+struct SpscQueue {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two.");
+
+    bool Push(const T & value) noexcept {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        if (position - head_cache == Capacity) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (position - head_cache == Capacity)
+                return false;
+        }
+        items[position & (Capacity - 1)] = value;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T & value) noexcept {
+        std::size_t position = head.load(std::memory_order_relaxed);
+        if (position == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (position == tail_cache)
+                return false;
+        }
+        value = items[position & (Capacity - 1)];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool IsEmpty() const noexcept {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t GetCapacity() noexcept { return Capacity; }
+
+private:
+    alignas(64) std::atomic<std::size_t> head{};
+    std::size_t tail_cache{};
+    alignas(64) std::atomic<std::size_t> tail{};
+    std::size_t head_cache{};
+    alignas(64) std::array<T, Capacity> items{};
+};
+
+struct InputEvent {
+    int key_code{};
+    bool pressed{};
+    std::int64_t timestamp{}; // GetNowHiPerformanceCount() microseconds
+};
+
+// Timestamped key press/release events in the order they were sampled.
+// Without a polling thread, events are sampled by System::Update() and by Poll(); StartPolling() moves
+// sampling to a background thread (DxLib must be in multithread mode, see SetUseMultiThreadFlag) so taps
+// shorter than a frame are still seen. Pop() is meant to be called from the game thread only.
+struct InputEvents {
+    static constexpr std::size_t CAPACITY = 1024;
+
+    static void StartPolling(int interval_microseconds = 1000);
+    static void StopPolling();
+    static bool IsPolling() noexcept;
+    static void Poll();
+    static bool Pop(InputEvent & event) noexcept;
+    static std::uint64_t GetDroppedCount() noexcept;
+};
+
+// Binds up to 64 actions (an enum whose values are 0-based indices) to sets of keys. The binding table is a
+// flat array of key masks: it can be built as a constexpr value and rebound at runtime. Resolve() folds the
+// frame's snapshot into one action word, so IsDown/IsPressed/IsReleased are a single bit test.
+// An action is down while any of its keys is down; its edges are taken on the action, not on the keys.
+template<typename Action, std::size_t ActionCount = 64>
+struct ActionMap {
+    // down, pressed and released hold one bit per action in a single word.
+    static_assert(ActionCount > 0 && ActionCount <= 64, "ActionMap supports 1 to 64 actions.");
+
+    struct Binding {
+        Action action;
+        int key_code;
+    };
+
+    constexpr ActionMap() noexcept {}
+    constexpr ActionMap(std::initializer_list<Binding> bindings) noexcept {
+        for (const Binding & binding : bindings)
+            Bind(binding.action, binding.key_code);
+    }
+
+    constexpr void Bind(Action action, int key_code) noexcept {
+        if (valid(action, key_code))
+            masks[index(action)][static_cast<std::size_t>(key_code) >> 6] |= std::uint64_t{1} << (key_code & 63);
+    }
+
+    constexpr void Unbind(Action action, int key_code) noexcept {
+        if (valid(action, key_code))
+            masks[index(action)][static_cast<std::size_t>(key_code) >> 6] &= ~(std::uint64_t{1} << (key_code & 63));
+    }
+
+    constexpr void Clear(Action action) noexcept {
+        if (index(action) < ActionCount)
+            masks[index(action)] = InputSnapshot::bits_type{};
+    }
+
+    constexpr bool IsBound(Action action, int key_code) const noexcept {
+        return valid(action, key_code)
+            && ((masks[index(action)][static_cast<std::size_t>(key_code) >> 6] >> (key_code & 63)) & 1) != 0;
+    }
+
+    // Call once per frame, after System::Update().
+    void Resolve(const InputSnapshot & snapshot) noexcept {
+        const InputSnapshot::bits_type & keys = snapshot.GetDown();
+        std::uint64_t next = 0;
+        for (std::size_t i = 0; i < ActionCount; ++i) {
+            std::uint64_t hit = 0;
+            for (std::size_t word = 0; word < keys.size(); ++word)
+                hit |= masks[i][word] & keys[word];
+            next |= static_cast<std::uint64_t>(hit != 0) << i;
+        }
+        pressed = next & ~down;
+        released = ~next & down;
+        down = next;
+    }
+    void Resolve() noexcept { Resolve(Key::GetSnapshot()); }
+
+    bool IsDown(Action action) const noexcept { return test(down, action); }
+    bool IsPressed(Action action) const noexcept { return test(pressed, action); }
+    bool IsReleased(Action action) const noexcept { return test(released, action); }
+    std::uint64_t GetDown() const noexcept { return down; }
+
+private:
+    static constexpr std::size_t index(Action action) noexcept { return static_cast<std::size_t>(action); }
+    static constexpr bool valid(Action action, int key_code) noexcept {
+        return index(action) < ActionCount && static_cast<unsigned>(key_code) < 256;
+    }
+    // An action outside the map is never down rather than aliasing another action's bit.
+    static bool test(std::uint64_t bits, Action action) noexcept {
+        return index(action) < ActionCount && ((bits >> index(action)) & 1) != 0;
+    }
+
+    std::array<InputSnapshot::bits_type, ActionCount> masks{};
+    std::uint64_t down{}, pressed{}, released{};
+};
+
+struct CollisionGrid {
+    CollisionGrid() {}
+    CollisionGrid(int width, int height)
+        : width{width}
+        , height{height}
+        , stride{(static_cast<std::size_t>(width) + 63) / 64}
+        , words(stride * height)
+    {}
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+    // Cells outside the grid are reported as solid so that movement and rays stop at the map border.
+    bool IsSolid(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            return true;
+        return (words[y * stride + (x >> 6)] >> (x & 63)) & 1;
+    }
+
+    // Only an actual walkability flip bumps the revision, so caches survive purely cosmetic tile edits.
+    void SetSolid(int x, int y, bool solid) {
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            throw std::out_of_range("CollisionGrid cell is out of range.");
+        std::uint64_t bit = std::uint64_t{1} << (x & 63);
+        std::uint64_t & word = words[y * stride + (x >> 6)];
+        if (((word & bit) != 0) == solid)
+            return;
+        word ^= bit;
+        if (changes.empty())
+            changes.resize(CHANGE_LOG_SIZE);
+        changes[revision % CHANGE_LOG_SIZE] = static_cast<std::uint32_t>(y * width + x);
+        ++revision;
+    }
+
+    void Resize(int width, int height) {
+        this->width = width;
+        this->height = height;
+        stride = (static_cast<std::size_t>(width) + 63) / 64;
+        words.assign(stride * height, std::uint64_t{});
+        reset_revision = ++revision;
+    }
+
+    std::uint64_t GetRevision() const { return revision; }
+
+    // callback(x, y) for every walkability flip after revision `since`. Returns false when the log no longer
+    // reaches back that far or the grid was resized/cleared in between; the caller then has to start over.
+    template<typename Callback>
+    bool GetChanges(std::uint64_t since, Callback callback) const {
+        if (since < reset_revision || revision - since > CHANGE_LOG_SIZE)
+            return false;
+        for (std::uint64_t r = since; r < revision; ++r) {
+            std::uint32_t index = changes[r % CHANGE_LOG_SIZE];
+            callback(static_cast<int>(index % width), static_cast<int>(index / width));
+        }
+        return true;
+    }
+
+    static constexpr std::size_t CHANGE_LOG_SIZE = 1024;
+
+    // Inclusive cell range; tests 64 cells of a row per word.
+    bool AnySolid(int x0, int y0, int x1, int y1) const {
+        if (x0 > x1 || y0 > y1)
+            return false;
+        if (x0 < 0 || y0 < 0 || x1 >= width || y1 >= height)
+            return true;
+        std::size_t w0 = x0 >> 6, w1 = x1 >> 6;
+        std::uint64_t first = ~std::uint64_t{} << (x0 & 63);
+        std::uint64_t last = ~std::uint64_t{} >> (63 - (x1 & 63));
+        for (int y = y0; y <= y1; ++y) {
+            const std::uint64_t * row = &words[y * stride];
+            if (w0 == w1) {
+                if (row[w0] & first & last)
+                    return true;
+                continue;
+            }
+            if ((row[w0] & first) || (row[w1] & last))
+                return true;
+            for (std::size_t w = w0 + 1; w < w1; ++w)
+                if (row[w])
+                    return true;
+        }
+        return false;
+    }
+
+    void Clear() { std::fill(words.begin(), words.end(), std::uint64_t{}); reset_revision = ++revision; }
+
+private:
+    int width{}, height{};
+    std::size_t stride{};
+    std::vector<std::uint64_t> words;
+    std::uint64_t revision{}, reset_revision{};
+    std::vector<std::uint32_t> changes;
 };
 
 struct TiledMap : Object {
     TiledMap() {}
 
     TiledMap(std::size_t column_number, std::size_t row_number, double column_width, double row_height)
-        : column_number{column_number}
-        , row_number{row_number}
-        , column_width{column_width}
+        : column_width{column_width}
         , row_height{row_height}
-    {}
+        , column_number{column_number}
+        , row_number{row_number}
+    {
+        resize();
+    }
+
+    struct RaycastHit {
+        Point point;
+        std::ptrdiff_t column{}, row{};
+        double fraction{};
+        int normal_x{}, normal_y{};
+    };
 
+    struct SweepResult {
+        Point delta;
+        bool hit_x{}, hit_y{};
+    };
+
+    virtual double GetX() const override { return x; }
+    virtual double GetY() const override { return y; }
+    virtual void SetX(double x) override { this->x = x; }
+    virtual void SetY(double y) override { this->y = y; }
+    virtual double GetWidth() const override { return GetColumnWidth() * GetColumnNumber(); }
+    virtual double GetHeight() const override { return GetRowHeight() * GetRowNumber(); }
+    // The map keeps its cell count; the cells are stretched to cover the requested size.
+    virtual void SetWidth(double width) override;
+    virtual void SetHeight(double height) override;
+    virtual double GetTheta() const override { return theta; }
+    virtual void SetTheta(double theta) override { this->theta = theta; }
     virtual std::size_t GetColumnNumber() const { return column_number; }
-    virtual void SetColumnNumber(std::size_t column_number) {this->column_number = column_number; }
+    virtual void SetColumnNumber(std::size_t column_number) { this->column_number = column_number; resize(); }
     virtual std::size_t GetRowNumber() const { return row_number; }
-    virtual void set_row_number(std::size_t row_number) { this->row_number = row_number; }
+    virtual void set_row_number(std::size_t row_number) { this->row_number = row_number; resize(); }
     virtual double GetColumnWidth() const { return column_width; }
     virtual void SetColumnWidth(double column_width) { this->column_width = column_width; }
     virtual double GetRowHeight() const { return this->row_height; }
     virtual void SetRowHeight(double row_height) { this->row_height = row_height; }
     virtual std::size_t GetGraphIndex(std::size_t x, std::size_t y) const { return graph_indexes.at(GetColumnNumber() * y + x); }
-    virtual void SetGraphIndex(std::size_t x, std::size_t y, std::size_t graph_index) { graph_indexes.at(GetColumnNumber() * y + x) = graph_index; }
+
+    virtual void SetGraphIndex(std::size_t x, std::size_t y, std::size_t graph_index);
+
     virtual Graph GetGraph(std::size_t index) const { return graphs.at(index); }
     virtual void SetGraph(std::size_t index, const Graph & g) { graphs.at(index) = g; }
+    virtual std::size_t AddGraph(const Graph & g) { graphs.push_back(g); return graphs.size() - 1; }
+    virtual std::size_t GetGraphNumber() const { return graphs.size(); }
+
+    virtual unsigned GetTileFlags(std::size_t graph_index) const {
+        return graph_index < tile_flags.size() ? tile_flags[graph_index] : 0;
+    }
+
+    virtual void SetTileFlags(std::size_t graph_index, unsigned flags);
+    const CollisionGrid & GetCollisionGrid() const { return collision; }
+    bool IsSolidCell(std::ptrdiff_t column, std::ptrdiff_t row) const { return collision.IsSolid(static_cast<int>(column), static_cast<int>(row)); }
+    bool CheckCollision(const Rect & r) const;
+    std::optional<RaycastHit> Raycast(const Point & from, const Point & to) const;
+    SweepResult Sweep(const Rect & r, const Point & delta) const;
+
+    // callback(column, row) is called for every solid cell overlapped by r; returning false stops the query.
+    template<typename Callback>
+    void QueryCollision(const Rect & r, Callback callback) const {
+        int x0, y0, x1, y1;
+        get_cell_range(r, x0, y0, x1, y1);
+        for (int row = (std::max)(y0, 0); row <= (std::min)(y1, collision.GetHeight() - 1); ++row)
+            for (int column = (std::max)(x0, 0); column <= (std::min)(x1, collision.GetWidth() - 1); ++column)
+                if (collision.IsSolid(column, row) && !callback(static_cast<std::size_t>(column), static_cast<std::size_t>(row)))
+                    return;
+    }
 
 //    virtual void SetGraphs(Iterator<Graph> graph_iterator) {
 //        graphs.clear();
@@ -542,29 +1471,801 @@ struct TiledMap : Object {
             Graph.Update();
     }
 
-    virtual void Draw() const override {
-        for (std::size_t row = 0; row < GetRowNumber(); ++row) {
-            for (std::size_t column = 0; column < GetColumnNumber(); ++column) {
-                std::size_t graph_index = GetGraphIndex(row, column);
-                if (graph_index != EMPTY) {
-                    auto g = Graph(GetGraph(graph_index));
-                    g.SetX(GetColumnWidth() * column);
-                    g.SetY(GetRowHeight() * row);
-                    g.SetWidth(GetColumnWidth());
-                    g.SetHeight(GetRowHeight());
-                    g.Draw();
-                }
-            }
-        }
-    }
+    // Draws only the cells that overlap the camera's view.
+    virtual void Draw() const override;
 
     static constexpr std::size_t EMPTY = static_cast<std::size_t>(-1);
+    static constexpr unsigned TILE_SOLID = 1;
 
 private:
+    void resize();
+    void get_cell_range(const Rect & r, int & x0, int & y0, int & x1, int & y1) const;
+
+    double x{}, y{}, theta{};
     double column_width{}, row_height{};
     std::size_t column_number{}, row_number{};
     std::vector<std::size_t> graph_indexes;
     std::vector<Graph> graphs;
+    std::vector<unsigned> tile_flags;
+    CollisionGrid collision;
+};
+
+struct Cell {
+    int x{}, y{};
+    bool operator ==(const Cell & c) const { return x == c.x && y == c.y; }
+    bool operator !=(const Cell & c) const { return !(*this == c); }
+};
+
+struct FlowField {
+    static constexpr std::uint8_t NONE = 8;
+    Cell GetTarget() const { return target; }
+    bool IsReachable(Cell c) const { return contains(c) && costs[index(c)] != std::numeric_limits<float>::infinity(); }
+    float GetCost(Cell c) const { return contains(c) ? costs[index(c)] : std::numeric_limits<float>::infinity(); }
+    std::uint8_t GetDirection(Cell c) const { return contains(c) ? directions[index(c)] : NONE; }
+    Cell GetNext(Cell c) const;
+    std::uint64_t GetRevision() const { return revision; }
+
+private:
+    friend struct PathFinder;
+    bool contains(Cell c) const { return c.x >= 0 && c.y >= 0 && c.x < width && c.y < height; }
+    std::size_t index(Cell c) const { return static_cast<std::size_t>(c.y) * width + c.x; }
+
+    Cell target;
+    int width{}, height{};
+    std::uint64_t revision{};
+    std::vector<float> costs;
+    std::vector<std::uint8_t> directions;
+};
+
+// 8-connected grid search over a CollisionGrid; diagonal moves may not cut solid corners.
+// Scratch buffers are kept between queries, so a warmed-up PathFinder does not allocate.
+struct PathFinder {
+    PathFinder(const TiledMap & map) : PathFinder(map.GetCollisionGrid()) {}
+    PathFinder(const CollisionGrid & grid) : grid{&grid} {}
+
+    bool FindPath(Cell start, Cell goal, std::vector<Cell> & path);
+    bool FindJumpPath(Cell start, Cell goal, std::vector<Cell> & path);
+    // Fields are cached per target; after walkability flips a cached field is repaired around the flipped cells
+    // and only rebuilt when the grid's change log no longer covers it.
+    const FlowField & GetFlowField(Cell target);
+    std::size_t GetExpandedNodeCount() const { return expanded_node_count; }
+    // Bytes held by the search buffers and the cached flow fields.
+    std::size_t GetMemoryUsage() const;
+    void SetFlowFieldCacheSize(std::size_t size) { flow_field_cache_size = std::max<std::size_t>(size, 1); }
+
+private:
+    struct open_node_t {
+        float f, g;
+        int index;
+        bool operator <(const open_node_t & n) const { return f > n.f || (f == n.f && g < n.g); }
+    };
+
+    struct cached_flow_field_t {
+        std::unique_ptr<FlowField> field;
+        std::uint64_t last_use{};
+    };
+
+    bool solid(int x, int y) const { return grid->IsSolid(x, y); }
+    void begin_query();
+    bool visit(int index, float g, int parent);
+    bool closed(int index) const { return closed_stamps[index] == stamp; }
+    void push(int index, float g, float h);
+    void build_path(int goal_index, std::vector<Cell> & path) const;
+    int jump(int x, int y, int dx, int dy, Cell goal) const;
+    void build_flow_field(FlowField & field, Cell target);
+    void relax_flow_field(FlowField & field);
+    bool repair_flow_field(FlowField & field);
+
+    const CollisionGrid * grid;
+    std::vector<float> g_costs;
+    std::vector<int> parents;
+    std::vector<std::uint32_t> open_stamps, closed_stamps;
+    std::uint32_t stamp{};
+    std::vector<open_node_t> open_nodes;
+    std::vector<cached_flow_field_t> flow_fields;
+    std::vector<int> changed_cells, invalidated_cells;
+    std::size_t flow_field_cache_size{8};
+    std::uint64_t flow_field_clock{};
+    std::size_t expanded_node_count{};
+};
+
+// HPA*: the grid is split into square clusters, entrances along cluster borders form an abstract graph with
+// precomputed intra-cluster costs, and only the segments of the abstract path are refined by cluster-local
+// searches. Walkability flips repair just the borders and clusters they touch.
+struct HierarchicalPathFinder {
+    HierarchicalPathFinder(const TiledMap & map, int cluster_size = 16) : HierarchicalPathFinder(map.GetCollisionGrid(), cluster_size) {}
+    HierarchicalPathFinder(const CollisionGrid & grid, int cluster_size = 16);
+
+    bool FindPath(Cell start, Cell goal, std::vector<Cell> & path);
+    void Rebuild();
+    int GetClusterSize() const { return cluster_size; }
+    std::size_t GetAbstractNodeCount() const { return node_count; }
+    std::size_t GetAbstractEdgeCount() const;
+    // Bytes held by the abstract graph and the search buffers.
+    std::size_t GetMemoryUsage() const;
+    std::size_t GetRepairedClusterCount() const { return repaired_cluster_count; }
+
+private:
+    struct edge_t {
+        int to;
+        float cost;
+    };
+
+    struct node_t {
+        Cell cell;
+        int cluster{-1}, border{-1}, partner{-1};
+        std::vector<edge_t> edges;
+    };
+
+    struct open_node_t {
+        float f, g;
+        int index;
+        bool operator <(const open_node_t & n) const { return f > n.f || (f == n.f && g < n.g); }
+    };
+
+    int cluster_of(Cell c) const { return (c.y / cluster_size) * cluster_columns + c.x / cluster_size; }
+    void get_cluster_bounds(int cluster, int & x0, int & y0, int & x1, int & y1) const;
+    void sync();
+    int new_node(Cell cell, int cluster, int border);
+    void build_border(int border);
+    void remove_border(int border);
+    void connect_cluster(int cluster);
+    bool search_cluster(int cluster, Cell source, Cell target);
+    float get_local_cost(int cluster, Cell c) const;
+    bool append_local_path(int cluster, Cell from, Cell to, std::vector<Cell> & path);
+
+    const CollisionGrid * grid;
+    int cluster_size;
+    int cluster_columns{}, cluster_rows{};
+    int grid_width{}, grid_height{};
+    std::uint64_t revision{};
+    std::vector<node_t> nodes;
+    std::vector<int> free_nodes;
+    std::vector<std::vector<int>> cluster_nodes, border_nodes;
+    std::size_t node_count{};
+    std::size_t repaired_cluster_count{};
+
+    std::vector<float> local_costs;
+    std::vector<int> local_parents;
+    std::vector<open_node_t> local_open;
+    std::vector<float> abstract_costs;
+    std::vector<int> abstract_parents;
+    std::vector<std::uint32_t> abstract_stamps;
+    std::uint32_t abstract_stamp{};
+    std::vector<open_node_t> abstract_open;
+    std::vector<edge_t> start_links, goal_links;
+    std::vector<Cell> waypoints;
+};
+
+// Fixed set of threads that run task(worker_index, item_index) for every item of a batch.
+// Dispatch() returns immediately; Wait() blocks until every worker has left the batch and rethrows the
+// first exception a task threw.
+struct WorkerPool {
+    explicit WorkerPool(std::size_t thread_count = 0);
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator =(const WorkerPool &) = delete;
+    ~WorkerPool();
+    std::size_t GetThreadCount() const { return threads.size(); }
+    void Dispatch(std::size_t count, std::function<void(std::size_t, std::size_t)> task);
+    void Wait();
+    void Run(std::size_t count, std::function<void(std::size_t, std::size_t)> task) { Dispatch(count, std::move(task)); Wait(); }
+
+private:
+    void work(std::size_t worker);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::function<void(std::size_t, std::size_t)> task;
+    std::size_t count{};
+    std::atomic<std::size_t> next{};
+    std::size_t active{};
+    std::uint64_t generation{};
+    bool stopping{};
+    std::exception_ptr error;
+};
+
+// Counts unfinished jobs. Jobs queued with JobSystem::RunAfter() start once the counter reaches zero. The
+// first exception thrown by a counted job is kept here until JobSystem::Wait() rethrows it.
+struct JobCounter {
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter & operator =(const JobCounter &) = delete;
+    bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend struct JobSystem;
+    std::atomic<std::size_t> pending{};
+    std::mutex mutex;
+    std::vector<std::function<void()>> continuations;
+    std::exception_ptr error;
+};
+
+// Work-stealing job scheduler. Each thread owns a deque: it pushes and pops its own jobs at the back while
+// idle threads steal from the front of the others. Threads outside the system share one deque and, while
+// in Wait(), run jobs too. Jobs must not call DxLib; keep those calls on the main thread.
+struct JobSystem {
+    using Job = std::function<void()>;
+
+    // thread_count workers are started besides the threads that call Wait(); 0 starts one per hardware
+    // thread but one.
+    explicit JobSystem(std::size_t thread_count = 0);
+    JobSystem(const JobSystem &) = delete;
+    JobSystem & operator =(const JobSystem &) = delete;
+    ~JobSystem();
+    std::size_t GetWorkerCount() const { return threads.size(); }
+    // 1 to GetWorkerCount() on the system's workers, 0 on any other thread.
+    std::size_t GetCurrentThreadIndex() const { return current_queue(); }
+
+    // Queues job; counter, if given, counts it until it has run. A job without a counter must not throw: as
+    // with std::thread, an exception leaving it calls std::terminate().
+    void Run(Job job, JobCounter * counter = nullptr);
+    // Queues job once dependency reaches zero.
+    void RunAfter(JobCounter & dependency, Job job, JobCounter * counter = nullptr);
+    // Runs queued jobs until counter reaches zero, then rethrows the first exception one of its jobs threw.
+    void Wait(JobCounter & counter);
+    // Calls body(first, last) over [begin, end) split into ranges of grain items, and waits for them. grain 0
+    // picks about four ranges per thread.
+    void ParallelFor(std::size_t begin, std::size_t end, const std::function<void(std::size_t, std::size_t)> & body, std::size_t grain = 0);
+
+private:
+    struct job_t {
+        Job job;
+        JobCounter * counter;
+    };
+    struct queue_t {
+        std::mutex mutex;
+        std::deque<job_t> jobs;
+    };
+
+    std::size_t current_queue() const;
+    void push(job_t job);
+    bool try_run(std::size_t queue);
+    void finish(JobCounter * counter);
+    void work(std::size_t queue);
+
+    std::vector<std::unique_ptr<queue_t>> queues; // queues[0] is shared by threads outside the system
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> queued{};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping{};
+};
+
+// One DrawCommandBuffer per thread of a JobSystem, so that jobs can Submit() drawables without locking.
+// GetLocal() returns the calling thread's buffer; all threads outside the system share slot 0, so only one
+// of them may record at a time. Flush() runs on the main thread once the jobs are done: it merges the
+// buffers and replays them as one. Layer, depth and state set through GetLocal() stay with that thread's
+// buffer across jobs, so a job should set whatever it relies on. Commands with equal keys recorded on
+// different threads replay in an order that depends on scheduling; put overlapping sprites on different
+// layers (depth only separates commands whose state and texture match as well).
+struct ThreadDrawCommandBuffers {
+    explicit ThreadDrawCommandBuffers(const JobSystem & jobs) : jobs{&jobs}, buffers(jobs.GetWorkerCount() + 1) {}
+
+    DrawCommandBuffer & GetLocal() { return buffers[jobs->GetCurrentThreadIndex()]; }
+    DrawCommandBuffer & Get(std::size_t thread) { return buffers.at(thread); }
+    std::size_t GetThreadCount() const { return buffers.size(); }
+    std::size_t GetSize() const;
+
+    void Flush();
+    void Clear();
+    const DrawCommandBuffer::Stats & GetStats() const { return buffers[0].GetStats(); } // of the last Flush()
+
+private:
+    const JobSystem * jobs;
+    std::vector<DrawCommandBuffer> buffers;
+};
+
+template<typename T> void Global::Update(JobSystem & jobs) {
+    // Reused between calls; bound to a reference because jobs on other threads would see their own copy.
+    thread_local std::vector<T *> thread_parallel;
+    std::vector<T *> & parallel = thread_parallel;
+    auto & objects = list<T>();
+    parallel.clear();
+    for (auto & object : objects)
+        if (object->IsThreadSafe())
+            parallel.push_back(object.get());
+    jobs.ParallelFor(0, parallel.size(), [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            parallel[i]->Update();
+    });
+    for (auto & object : objects)
+        if (!object->IsThreadSafe())
+            object->Update();
+}
+
+template<typename T, typename Predicate>
+void Global::PrepareDrawList(JobSystem & jobs, std::vector<const T *> & drawables, Predicate visible) {
+    constexpr std::size_t grain = 1024;
+    thread_local std::vector<const T *> thread_all;
+    thread_local std::vector<std::vector<const T *>> thread_ranges;
+    std::vector<const T *> & all = thread_all;
+    std::vector<std::vector<const T *>> & ranges = thread_ranges;
+    all.clear();
+    for (auto & object : list<T>())
+        all.push_back(object.get());
+    std::size_t range_count = (all.size() + grain - 1) / grain;
+    if (ranges.size() < range_count)
+        ranges.resize(range_count);
+    jobs.ParallelFor(0, range_count, [&](std::size_t first, std::size_t last) {
+        for (std::size_t range = first; range < last; ++range) {
+            ranges[range].clear();
+            for (std::size_t i = range * grain; i < (std::min)((range + 1) * grain, all.size()); ++i)
+                if (visible(*all[i]))
+                    ranges[range].push_back(all[i]);
+        }
+    }, 1);
+    drawables.clear();
+    for (std::size_t range = 0; range < range_count; ++range)
+        drawables.insert(drawables.end(), ranges[range].begin(), ranges[range].end());
+}
+
+struct PathResult {
+    std::uint64_t ticket{};
+    Cell start, goal;
+    bool found{};
+    std::vector<Cell> path;
+};
+
+// Batches path queries and solves them on a WorkerPool against a snapshot of the collision grid taken at
+// Dispatch(), so the map may change while a batch is in flight. Typical use per frame: Collect() the
+// previous batch, Submit() new queries, Dispatch(). Collected results stay valid until the next Collect().
+// Given a JobSystem, the batch runs as jobs on its threads instead, so that a game already using one does
+// not start a second set of threads; the JobSystem must outlive the service.
+struct PathQueryService {
+    PathQueryService(const TiledMap & map, std::size_t thread_count = 0) : PathQueryService(map.GetCollisionGrid(), thread_count) {}
+    PathQueryService(const CollisionGrid & grid, std::size_t thread_count = 0);
+    PathQueryService(const TiledMap & map, JobSystem & jobs) : PathQueryService(map.GetCollisionGrid(), jobs) {}
+    PathQueryService(const CollisionGrid & grid, JobSystem & jobs);
+    ~PathQueryService();
+
+    std::uint64_t Submit(Cell start, Cell goal);
+    void Dispatch();
+    const std::vector<PathResult> & Collect();
+    bool IsDispatched() const { return dispatched; }
+    std::size_t GetThreadCount() const { return pool ? pool->GetThreadCount() : jobs->GetWorkerCount() + 1; }
+    // Deterministic results come back in submission order; otherwise in completion order.
+    bool IsDeterministic() const { return deterministic; }
+    void SetDeterministic(bool deterministic) { this->deterministic = deterministic; }
+
+private:
+    struct request_t {
+        std::uint64_t ticket;
+        Cell start, goal;
+    };
+
+    void solve(std::size_t worker, std::size_t item);
+
+    const CollisionGrid * grid;
+    CollisionGrid snapshot;
+    bool has_snapshot{};
+    std::unique_ptr<WorkerPool> pool;
+    JobSystem * jobs{};
+    JobCounter batch;
+    std::atomic<std::size_t> next_item{};
+    std::vector<std::unique_ptr<PathFinder>> finders;
+    std::vector<std::vector<Cell>> worker_paths;
+    std::vector<request_t> pending, in_flight;
+    std::vector<PathResult> batch_results, collected_results;
+    std::atomic<std::size_t> completed{};
+    std::uint64_t next_ticket{};
+    bool deterministic{true}, batch_deterministic{true};
+    bool dispatched{};
+};
+
+template<typename T>
+struct AabbTree {
+    using value_type = T;
+    static constexpr int NIL = -1;
+
+    AabbTree(double margin = 4.0) : margin{margin} {}
+
+    int Insert(const Rect & bounds, const value_type & value) {
+        int proxy = allocate_node();
+        nodes[proxy].box = fatten(to_box(bounds));
+        nodes[proxy].height = 0;
+        values[proxy] = value;
+        insert_leaf(proxy);
+        ++size;
+        return proxy;
+    }
+
+    int Insert(const Object & object, const value_type & value) { return Insert(GetBounds(object), value); }
+
+    void Remove(int proxy) {
+        check_proxy(proxy);
+        remove_leaf(proxy);
+        values[proxy] = value_type{};
+        free_node(proxy);
+        --size;
+    }
+
+    // Returns false while the new bounds still fit in the fattened ones, in which case the tree is untouched.
+    bool Move(int proxy, const Rect & bounds, const Point & displacement = {}) {
+        check_proxy(proxy);
+        box_t box = to_box(bounds);
+        if (contains(nodes[proxy].box, box))
+            return false;
+        remove_leaf(proxy);
+        box = fatten(box);
+        double dx = displacement.x * 2, dy = displacement.y * 2;
+        (dx < 0 ? box.x1 : box.x2) += dx;
+        (dy < 0 ? box.y1 : box.y2) += dy;
+        nodes[proxy].box = box;
+        insert_leaf(proxy);
+        return true;
+    }
+
+    bool Move(int proxy, const Object & object) { return Move(proxy, GetBounds(object)); }
+
+    const value_type & Get(int proxy) const { check_proxy(proxy); return values[proxy]; }
+
+    Rect GetFatBounds(int proxy) const {
+        check_proxy(proxy);
+        const box_t & b = nodes[proxy].box;
+        return Rect{b.x1, b.y1, b.x2 - b.x1, b.y2 - b.y1};
+    }
+
+    std::size_t GetSize() const { return size; }
+    int GetHeight() const { return root == NIL ? 0 : nodes[root].height; }
+
+    void Clear() {
+        nodes.clear();
+        values.clear();
+        root = free_list = NIL;
+        size = 0;
+    }
+
+    // callback(proxy, value) is called for every fattened leaf overlapping bounds; returning false stops the query.
+    template<typename Callback>
+    void Query(const Rect & bounds, Callback callback) const {
+        box_t box = to_box(bounds);
+        traverse([&](int index) { return overlaps(nodes[index].box, box); }, [&](int index) {
+            return callback(index, values[index]);
+        });
+    }
+
+    // callback(proxy, value, max_fraction) returns the new max fraction along from->to:
+    // 0 terminates, the passed value continues, anything smaller clips the ray.
+    template<typename Callback>
+    void Raycast(const Point & from, const Point & to, Callback callback) const {
+        double px = from.x, py = from.y, dx = to.x - from.x, dy = to.y - from.y;
+        double max_fraction = 1.0;
+        traverse([&](int index) { return intersects(nodes[index].box, px, py, dx, dy, max_fraction); }, [&](int index) {
+            max_fraction = callback(index, values[index], max_fraction);
+            return max_fraction > 0;
+        });
+    }
+
+    static Rect GetBounds(const Object & object) {
+        return Rect{object.GetX(), object.GetY(), object.GetWidth(), object.GetHeight()};
+    }
+
+private:
+    struct box_t { double x1, y1, x2, y2; };
+
+    struct node_t {
+        box_t box;
+        int parent;
+        int child1, child2;
+        int height;
+    };
+
+    static box_t to_box(const Rect & r) { return {r.GetX(), r.GetY(), r.GetX() + r.GetWidth(), r.GetY() + r.GetHeight()}; }
+    static box_t combine(const box_t & a, const box_t & b) {
+        return {(std::min)(a.x1, b.x1), (std::min)(a.y1, b.y1), (std::max)(a.x2, b.x2), (std::max)(a.y2, b.y2)};
+    }
+    static double perimeter(const box_t & b) { return 2 * ((b.x2 - b.x1) + (b.y2 - b.y1)); }
+    static bool contains(const box_t & a, const box_t & b) { return a.x1 <= b.x1 && a.y1 <= b.y1 && b.x2 <= a.x2 && b.y2 <= a.y2; }
+    static bool overlaps(const box_t & a, const box_t & b) { return a.x1 <= b.x2 && a.y1 <= b.y2 && b.x1 <= a.x2 && b.y1 <= a.y2; }
+
+    static bool intersects(const box_t & b, double px, double py, double dx, double dy, double max_fraction) {
+        double tmin = 0, tmax = max_fraction;
+        auto slab = [&](double p, double d, double lo, double hi) {
+            if (d == 0)
+                return lo <= p && p <= hi;
+            double t1 = (lo - p) / d, t2 = (hi - p) / d;
+            if (t1 > t2) std::swap(t1, t2);
+            tmin = (std::max)(tmin, t1);
+            tmax = (std::min)(tmax, t2);
+            return tmin <= tmax;
+        };
+        return slab(px, dx, b.x1, b.x2) && slab(py, dy, b.y1, b.y2);
+    }
+
+    box_t fatten(const box_t & b) const { return {b.x1 - margin, b.y1 - margin, b.x2 + margin, b.y2 + margin}; }
+    bool is_leaf(int index) const { return nodes[index].child1 == NIL; }
+
+    void check_proxy(int proxy) const {
+        if (proxy < 0 || proxy >= static_cast<int>(nodes.size()) || nodes[proxy].height != 0)
+            throw std::runtime_error("AabbTree proxy is invalid.");
+    }
+
+    template<typename Predicate, typename Visitor>
+    void traverse(Predicate predicate, Visitor visitor) const {
+        if (root == NIL)
+            return;
+        int stack_buffer[64];
+        std::vector<int> stack_heap;
+        int * stack = stack_buffer;
+        if (nodes[root].height + 2 > static_cast<int>(std::size(stack_buffer))) {
+            stack_heap.resize(nodes[root].height + 2);
+            stack = stack_heap.data();
+        }
+        int count = 0;
+        stack[count++] = root;
+        while (count > 0) {
+            int index = stack[--count];
+            if (!predicate(index))
+                continue;
+            if (is_leaf(index)) {
+                if (!visitor(index))
+                    return;
+            } else {
+                stack[count++] = nodes[index].child1;
+                stack[count++] = nodes[index].child2;
+            }
+        }
+    }
+
+    int allocate_node() {
+        int index;
+        if (free_list == NIL) {
+            index = static_cast<int>(nodes.size());
+            nodes.emplace_back();
+            values.emplace_back();
+        } else {
+            index = free_list;
+            free_list = nodes[index].parent;
+        }
+        nodes[index] = node_t{{}, NIL, NIL, NIL, 0};
+        return index;
+    }
+
+    void free_node(int index) {
+        nodes[index].parent = free_list;
+        nodes[index].height = -1;
+        free_list = index;
+    }
+
+    void insert_leaf(int leaf) {
+        if (root == NIL) {
+            root = leaf;
+            nodes[root].parent = NIL;
+            return;
+        }
+        box_t leaf_box = nodes[leaf].box;
+        int index = root;
+        while (!is_leaf(index)) {
+            const node_t & node = nodes[index];
+            double area = perimeter(node.box);
+            double combined_area = perimeter(combine(node.box, leaf_box));
+            double cost = 2 * combined_area;
+            double inheritance = 2 * (combined_area - area);
+            auto descend_cost = [&](int child) {
+                double enlarged = perimeter(combine(leaf_box, nodes[child].box));
+                return is_leaf(child) ? enlarged + inheritance : enlarged - perimeter(nodes[child].box) + inheritance;
+            };
+            double cost1 = descend_cost(node.child1);
+            double cost2 = descend_cost(node.child2);
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        int sibling = index;
+        int new_parent = allocate_node();
+        int old_parent = nodes[sibling].parent;
+        nodes[new_parent].parent = old_parent;
+        nodes[new_parent].box = combine(leaf_box, nodes[sibling].box);
+        nodes[new_parent].height = nodes[sibling].height + 1;
+        nodes[new_parent].child1 = sibling;
+        nodes[new_parent].child2 = leaf;
+        if (old_parent == NIL)
+            root = new_parent;
+        else if (nodes[old_parent].child1 == sibling)
+            nodes[old_parent].child1 = new_parent;
+        else
+            nodes[old_parent].child2 = new_parent;
+        nodes[sibling].parent = new_parent;
+        nodes[leaf].parent = new_parent;
+        refit(nodes[leaf].parent);
+    }
+
+    void remove_leaf(int leaf) {
+        if (leaf == root) {
+            root = NIL;
+            return;
+        }
+        int parent = nodes[leaf].parent;
+        int grand_parent = nodes[parent].parent;
+        int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+        nodes[sibling].parent = grand_parent;
+        if (grand_parent == NIL) {
+            root = sibling;
+        } else {
+            if (nodes[grand_parent].child1 == parent)
+                nodes[grand_parent].child1 = sibling;
+            else
+                nodes[grand_parent].child2 = sibling;
+        }
+        free_node(parent);
+        refit(grand_parent);
+    }
+
+    void refit(int index) {
+        while (index != NIL) {
+            index = balance(index);
+            node_t & node = nodes[index];
+            node.height = 1 + (std::max)(nodes[node.child1].height, nodes[node.child2].height);
+            node.box = combine(nodes[node.child1].box, nodes[node.child2].box);
+            index = node.parent;
+        }
+    }
+
+    void replace_child(int parent, int old_child, int new_child) {
+        if (parent == NIL)
+            root = new_child;
+        else if (nodes[parent].child1 == old_child)
+            nodes[parent].child1 = new_child;
+        else
+            nodes[parent].child2 = new_child;
+    }
+
+    // Single AVL-style rotation; returns the index of the new subtree root.
+    int balance(int ia) {
+        node_t & a = nodes[ia];
+        if (is_leaf(ia) || a.height < 2)
+            return ia;
+        int ib = a.child1, ic = a.child2;
+        node_t & b = nodes[ib];
+        node_t & c = nodes[ic];
+        int difference = c.height - b.height;
+        if (difference > 1) {
+            int if_ = c.child1, ig = c.child2;
+            node_t & f = nodes[if_];
+            node_t & g = nodes[ig];
+            c.child1 = ia;
+            c.parent = a.parent;
+            a.parent = ic;
+            replace_child(c.parent, ia, ic);
+            if (f.height > g.height) {
+                c.child2 = if_;
+                a.child2 = ig;
+                g.parent = ia;
+                a.box = combine(b.box, g.box);
+                c.box = combine(a.box, f.box);
+                a.height = 1 + (std::max)(b.height, g.height);
+                c.height = 1 + (std::max)(a.height, f.height);
+            } else {
+                c.child2 = ig;
+                a.child2 = if_;
+                f.parent = ia;
+                a.box = combine(b.box, f.box);
+                c.box = combine(a.box, g.box);
+                a.height = 1 + (std::max)(b.height, f.height);
+                c.height = 1 + (std::max)(a.height, g.height);
+            }
+            return ic;
+        }
+        if (difference < -1) {
+            int id = b.child1, ie = b.child2;
+            node_t & d = nodes[id];
+            node_t & e = nodes[ie];
+            b.child1 = ia;
+            b.parent = a.parent;
+            a.parent = ib;
+            replace_child(b.parent, ia, ib);
+            if (d.height > e.height) {
+                b.child2 = id;
+                a.child1 = ie;
+                e.parent = ia;
+                a.box = combine(c.box, e.box);
+                b.box = combine(a.box, d.box);
+                a.height = 1 + (std::max)(c.height, e.height);
+                b.height = 1 + (std::max)(a.height, d.height);
+            } else {
+                b.child2 = ie;
+                a.child1 = id;
+                d.parent = ia;
+                a.box = combine(c.box, d.box);
+                b.box = combine(a.box, e.box);
+                a.height = 1 + (std::max)(c.height, d.height);
+                b.height = 1 + (std::max)(a.height, e.height);
+            }
+            return ib;
+        }
+        return ia;
+    }
+
+    double margin;
+    std::vector<node_t> nodes;
+    std::vector<value_type> values;
+    int root{NIL};
+    int free_list{NIL};
+    std::size_t size{};
+};
+
+// Where and how a ParticleSystem spawns particles. Positions are in pixels, speeds in pixels per second and
+// angles in radians.
+struct ParticleEmitter {
+    double x{}, y{};
+    double rate{};                      // particles per second while enabled; 0 for bursts only
+    double life_min{1.0}, life_max{1.0}; // seconds
+    double speed_min{}, speed_max{};
+    double direction{}, spread{};       // particles leave within direction +- spread
+    unsigned int color{0xffffffffu};    // 0xAARRGGBB at birth; alpha fades to 0 over the particle's life
+    float size{4.0f};                   // quad edge length
+    bool enabled{true};
+};
+
+// Fixed-capacity particle pool stored as parallel arrays, updated by an SSE2 kernel where available and
+// drawn as DrawPrimitive2D triangle lists. Nothing is allocated after construction: spawns beyond capacity
+// are dropped, and dead particles are replaced by live ones from the end of the pool. The fade only shows
+// under an alpha blend mode.
+//
+// Work is split into chunks of CHUNK_SIZE particles. With more than one thread the chunks are updated, and
+// their vertices written, on a WorkerPool, or on a JobSystem shared with the rest of the game; each chunk's
+// random numbers come from its own seed, so results do not depend on the thread count.
+struct ParticleSystem {
+    static constexpr std::size_t BATCH_QUADS = 4096;  // quads per DrawPrimitive2D call on one thread
+    static constexpr std::size_t CHUNK_SIZE = 16384;  // particles per work item
+
+    // thread_count 1 works on the calling thread; 0 uses one worker per hardware thread.
+    explicit ParticleSystem(std::size_t capacity, std::size_t thread_count = 1);
+    // Runs the chunks as jobs instead of on threads of its own; jobs must outlive the system.
+    ParticleSystem(std::size_t capacity, JobSystem & jobs);
+    ParticleSystem(const ParticleSystem &) = delete;
+    ParticleSystem & operator =(const ParticleSystem &) = delete;
+    ~ParticleSystem();
+
+    std::size_t AddEmitter(const ParticleEmitter & emitter);
+    ParticleEmitter & GetEmitter(std::size_t id) { return emitters[id]; }
+    const ParticleEmitter & GetEmitter(std::size_t id) const { return emitters[id]; }
+    std::size_t GetEmitterNumber() const { return emitters.size(); }
+    // Spawns count particles at once and returns how many fit in the pool.
+    std::size_t Emit(const ParticleEmitter & emitter, std::size_t count);
+
+    // Spawns from the enabled emitters, then moves every particle and retires the dead ones.
+    void Update(double seconds);
+    // On one thread, submits the particles in batches of BATCH_QUADS; with workers, the chunks write their
+    // vertices into one buffer in parallel and it is submitted with a single call.
+    void Draw() const;
+    void Clear();
+
+    std::size_t GetCount() const { return count; }
+    std::size_t GetCapacity() const { return capacity; }
+    std::size_t GetThreadCount() const { return pool ? pool->GetThreadCount() : jobs ? jobs->GetWorkerCount() + 1 : 1; }
+    std::uint64_t GetDroppedCount() const { return dropped; }
+    void SetGravity(double x, double y) { gravity_x = static_cast<float>(x); gravity_y = static_cast<float>(y); }
+    double GetGravityX() const { return gravity_x; }
+    double GetGravityY() const { return gravity_y; }
+    // Textures every quad with the whole graph; without one, quads are filled with the particle color.
+    void SetGraph(const Graph & graph) { this->graph = graph; }
+    void SetSeed(std::uint64_t seed) { random = seed; }
+
+private:
+    void run(std::size_t count, const std::function<void(std::size_t)> & task) const;
+    void spawn(const ParticleEmitter & emitter, std::size_t first, std::size_t count, std::uint64_t seed);
+    std::size_t retire(std::size_t first, std::size_t count);
+    void move(std::size_t from, std::size_t to);
+    void write_vertices(std::size_t first, std::size_t count, void * output) const;
+
+    std::size_t capacity;
+    std::size_t count{};
+    std::vector<float> x, y, vx, vy, life, inverse_max_life, sizes;
+    std::vector<std::uint32_t> colors;
+    std::vector<ParticleEmitter> emitters;
+    std::vector<double> emitter_backlog; // fractional particles owed by each emitter
+    std::vector<std::size_t> chunk_live;
+    float gravity_x{}, gravity_y{};
+    Graph graph;
+    std::uint64_t random{0x9e3779b97f4a7c15u};
+    std::uint64_t dropped{};
+    std::unique_ptr<WorkerPool> pool;
+    JobSystem * jobs{};
+    struct vertex_buffer_t;
+    std::unique_ptr<vertex_buffer_t> vertices;
 };
 
 } //namespace DxLibPp
@@ -0,0 +1,644 @@
+#include "Headless.hpp"
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+using DxLibPp::Headless::CommandType;
+using DxLibPp::Headless::DrawCommand;
+using DxLibPp::Headless::Framebuffer;
+
+struct image_t {
+    int width{}, height{};
+    std::vector<std::uint32_t> pixels;
+};
+
+// A graph is a rectangle of an image; LoadDivGraph handles share their parent's image.
+struct graph_t {
+    std::shared_ptr<const image_t> image;
+    int x{}, y{}, width{}, height{};
+    int group{}; // handle of the first graph made by the same load, for DeleteSharingGraph
+};
+
+struct font_t {
+    int size{};
+    int thick{};
+};
+
+struct pad_t {
+    std::uint32_t buttons{};
+    int x{}, y{};
+};
+
+struct state_t {
+    bool initialized = false;
+    bool quit_requested = false;
+    int screen_width = 640, screen_height = 480;
+
+    std::unordered_map<std::string, std::shared_ptr<const image_t>> images;
+    std::vector<std::unique_ptr<graph_t>> graphs;
+    std::vector<std::unique_ptr<font_t>> fonts;
+    std::vector<int> sounds; // play type while playing, -1 when stopped, -2 when deleted
+
+    std::vector<DrawCommand> commands, presented_commands;
+    std::uint64_t presented_frames = 0;
+
+    bool rasterize = false;
+    Framebuffer back, front;
+
+    std::atomic<char> keys[256]{}; // set by the test thread while InputEvents polls from its own thread
+    int joypad_count = 0;
+    pad_t pads[4];
+    int mouse_x = 0, mouse_y = 0;
+    std::uint32_t mouse_buttons = 0;
+
+    int blend_mode = DX_BLENDMODE_NOBLEND, blend_param = 255;
+    int draw_mode = DX_DRAWMODE_NEAREST;
+    int area_x1 = 0, area_y1 = 0, area_x2 = 640, area_y2 = 480;
+};
+
+// Constructed on first use: DxLibPp calls DxLib_Init from static initializers in other translation units.
+state_t & state() {
+    static state_t instance;
+    return instance;
+}
+
+// Handles are 1-based indices so that 0 and -1 never name a live object.
+template<typename T>
+T * find(std::vector<std::unique_ptr<T>> & table, int handle) {
+    if (handle <= 0 || static_cast<std::size_t>(handle) > table.size())
+        return nullptr;
+    return table[handle - 1].get();
+}
+
+// Released handles at the end of the table are reused, so that load/release cycles do not grow it.
+template<typename T>
+int add(std::vector<std::unique_ptr<T>> & table, std::unique_ptr<T> item) {
+    while (!table.empty() && !table.back())
+        table.pop_back();
+    table.push_back(std::move(item));
+    return static_cast<int>(table.size());
+}
+
+void resize(Framebuffer & framebuffer, int width, int height) {
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.pixels.assign(static_cast<std::size_t>(width) * height, 0xff000000u);
+}
+
+void clear(Framebuffer & framebuffer) {
+    std::fill(framebuffer.pixels.begin(), framebuffer.pixels.end(), 0xff000000u);
+}
+
+void blend(std::uint32_t & destination, std::uint32_t source, bool transparent) {
+    std::uint32_t alpha = source >> 24;
+    if (!transparent || alpha == 255) {
+        destination = source | 0xff000000u;
+        return;
+    }
+    if (alpha == 0)
+        return;
+    std::uint32_t result = 0xff000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+        std::uint32_t s = (source >> shift) & 0xff, d = (destination >> shift) & 0xff;
+        result |= ((s * alpha + d * (255 - alpha)) / 255) << shift;
+    }
+    destination = result;
+}
+
+// Stamps the current draw state on a command and appends it to the frame.
+void record(state_t & s, DrawCommand command) {
+    command.blend_mode = s.blend_mode;
+    command.blend_param = s.blend_param;
+    s.commands.push_back(std::move(command));
+}
+
+// Inverse-maps every pixel of the rotated quad's bounding box back into the source rectangle.
+void rasterize_graph(Framebuffer & target, const graph_t & graph, const DrawCommand & command) {
+    if (command.scale_x == 0.0 || command.scale_y == 0.0)
+        return;
+    int src_x = command.src_x, src_y = command.src_y, width = command.src_width, height = command.src_height;
+    double c = std::cos(command.angle), s = std::sin(command.angle);
+    double corners_x[4], corners_y[4];
+    for (int i = 0; i < 4; ++i) {
+        double local_x = ((i & 1) ? width : 0) - command.center_x;
+        double local_y = ((i & 2) ? height : 0) - command.center_y;
+        local_x *= command.scale_x;
+        local_y *= command.scale_y;
+        corners_x[i] = command.x + local_x * c - local_y * s;
+        corners_y[i] = command.y + local_x * s + local_y * c;
+    }
+    int min_x = (std::max)(0, static_cast<int>(std::floor(*std::min_element(corners_x, corners_x + 4))));
+    int max_x = (std::min)(target.width, static_cast<int>(std::ceil(*std::max_element(corners_x, corners_x + 4))));
+    int min_y = (std::max)(0, static_cast<int>(std::floor(*std::min_element(corners_y, corners_y + 4))));
+    int max_y = (std::min)(target.height, static_cast<int>(std::ceil(*std::max_element(corners_y, corners_y + 4))));
+    const image_t & image = *graph.image;
+    for (int py = min_y; py < max_y; ++py) {
+        for (int px = min_x; px < max_x; ++px) {
+            double dx = px + 0.5 - command.x, dy = py + 0.5 - command.y;
+            double u = (dx * c + dy * s) / command.scale_x + command.center_x;
+            double v = (-dx * s + dy * c) / command.scale_y + command.center_y;
+            if (u < 0.0 || v < 0.0 || u >= width || v >= height)
+                continue;
+            int sx = graph.x + src_x + static_cast<int>(u), sy = graph.y + src_y + static_cast<int>(v);
+            std::uint32_t texel = image.pixels.empty() ? 0xffffffffu : image.pixels[static_cast<std::size_t>(sy) * image.width + sx];
+            blend(target.pixels[static_cast<std::size_t>(py) * target.width + px], texel, command.transparent);
+        }
+    }
+}
+
+// Triangles are filled with their first vertex's color; textures are not sampled.
+void rasterize_triangles(Framebuffer & target, const VERTEX2D * vertices, int count, bool transparent) {
+    for (int t = 0; t + 3 <= count; t += 3) {
+        const VERTEX2D * v = vertices + t;
+        float area = (v[1].pos.x - v[0].pos.x) * (v[2].pos.y - v[0].pos.y) - (v[2].pos.x - v[0].pos.x) * (v[1].pos.y - v[0].pos.y);
+        if (area == 0.0f)
+            continue;
+        int min_x = (std::max)(0, static_cast<int>(std::floor((std::min)({v[0].pos.x, v[1].pos.x, v[2].pos.x}))));
+        int max_x = (std::min)(target.width, static_cast<int>(std::ceil((std::max)({v[0].pos.x, v[1].pos.x, v[2].pos.x}))));
+        int min_y = (std::max)(0, static_cast<int>(std::floor((std::min)({v[0].pos.y, v[1].pos.y, v[2].pos.y}))));
+        int max_y = (std::min)(target.height, static_cast<int>(std::ceil((std::max)({v[0].pos.y, v[1].pos.y, v[2].pos.y}))));
+        std::uint32_t color = static_cast<std::uint32_t>(v[0].dif.a) << 24 | static_cast<std::uint32_t>(v[0].dif.r) << 16
+            | static_cast<std::uint32_t>(v[0].dif.g) << 8 | v[0].dif.b;
+        for (int py = min_y; py < max_y; ++py) {
+            for (int px = min_x; px < max_x; ++px) {
+                float sx = px + 0.5f, sy = py + 0.5f;
+                bool inside = true;
+                for (int edge = 0; edge < 3 && inside; ++edge) {
+                    const VECTOR & a = v[edge].pos, & b = v[(edge + 1) % 3].pos;
+                    float side = (b.x - a.x) * (sy - a.y) - (sx - a.x) * (b.y - a.y);
+                    inside = area > 0.0f ? side >= 0.0f : side <= 0.0f;
+                }
+                if (inside)
+                    blend(target.pixels[static_cast<std::size_t>(py) * target.width + px], color, transparent);
+            }
+        }
+    }
+}
+
+// Glyphs are drawn as solid cells: enough to check where text lands, not what it says.
+void rasterize_string(Framebuffer & target, const DrawCommand & command, int size) {
+    int advance = (std::max)(size / 2, 1);
+    int cursor = command.x;
+    for (char character : command.text) {
+        if (character != ' ') {
+            for (int py = (std::max)(command.y + 1, 0); py < (std::min)(command.y + size - 1, target.height); ++py)
+                for (int px = (std::max)(cursor, 0); px < (std::min)(cursor + advance - 1, target.width); ++px)
+                    target.pixels[static_cast<std::size_t>(py) * target.width + px] = command.color | 0xff000000u;
+        }
+        cursor += advance;
+    }
+}
+
+int draw_string(int x, int y, const char * text, unsigned int color, int font_handle, int size) {
+    DrawCommand command;
+    command.type = CommandType::STRING;
+    command.handle = font_handle;
+    command.x = x;
+    command.y = y;
+    command.color = color;
+    command.text = text;
+    state_t & s = state();
+    if (s.rasterize)
+        rasterize_string(s.back, command, size);
+    record(s, std::move(command));
+    return 0;
+}
+
+int font_size(int size) {
+    return size > 0 ? size : 16;
+}
+
+}
+
+int DxLib_Init() {
+    state_t & s = state();
+    s.initialized = true;
+    s.quit_requested = false;
+    return 0;
+}
+
+int DxLib_End() {
+    state().initialized = false;
+    return 0;
+}
+
+int ChangeWindowMode(int) { return 0; }
+int SetDrawScreen(int) { return 0; }
+int SetOutApplicationLogValidFlag(int) { return 0; }
+
+int ScreenFlip() {
+    state_t & s = state();
+    std::swap(s.commands, s.presented_commands);
+    s.commands.clear();
+    if (s.rasterize)
+        std::swap(s.back, s.front);
+    ++s.presented_frames;
+    return 0;
+}
+
+int ProcessMessage() {
+    return state().quit_requested ? -1 : 0;
+}
+
+int ClearDrawScreen() {
+    state_t & s = state();
+    s.commands.clear();
+    if (s.rasterize)
+        clear(s.back);
+    return 0;
+}
+
+int GetScreenState(int * SizeX, int * SizeY, int * ColorBitDepth) {
+    const state_t & s = state();
+    if (SizeX) *SizeX = s.screen_width;
+    if (SizeY) *SizeY = s.screen_height;
+    if (ColorBitDepth) *ColorBitDepth = 32;
+    return 0;
+}
+
+unsigned int GetColor(int Red, int Green, int Blue) {
+    return (static_cast<unsigned int>(Red & 255) << 16) | (static_cast<unsigned int>(Green & 255) << 8) | static_cast<unsigned int>(Blue & 255);
+}
+
+LONGLONG GetNowHiPerformanceCount(int) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int LoadGraph(const char * FileName, int) {
+    state_t & s = state();
+    auto found = s.images.find(FileName ? FileName : "");
+    if (found == s.images.end())
+        return -1;
+    auto graph = std::make_unique<graph_t>();
+    graph->image = found->second;
+    graph->width = found->second->width;
+    graph->height = found->second->height;
+    int handle = add(s.graphs, std::move(graph));
+    s.graphs[handle - 1]->group = handle;
+    return handle;
+}
+
+int LoadDivGraph(const char * FileName, int AllNum, int XNum, int YNum, int XSize, int YSize, int * HandleArray, int) {
+    state_t & s = state();
+    auto found = s.images.find(FileName ? FileName : "");
+    if (found == s.images.end() || XNum <= 0 || YNum <= 0 || AllNum > XNum * YNum
+        || XNum * XSize > found->second->width || YNum * YSize > found->second->height)
+        return -1;
+    for (int i = 0; i < AllNum; ++i) {
+        auto graph = std::make_unique<graph_t>();
+        graph->image = found->second;
+        graph->x = i % XNum * XSize;
+        graph->y = i / XNum * YSize;
+        graph->width = XSize;
+        graph->height = YSize;
+        HandleArray[i] = add(s.graphs, std::move(graph));
+    }
+    // Grouped only once every handle is known: add() may first drop released slots from the end.
+    for (int i = 0; i < AllNum; ++i)
+        s.graphs[HandleArray[i] - 1]->group = HandleArray[0];
+    return 0;
+}
+
+int GetGraphSize(int GrHandle, int * SizeXBuf, int * SizeYBuf) {
+    const graph_t * graph = find(state().graphs, GrHandle);
+    if (!graph)
+        return -1;
+    if (SizeXBuf) *SizeXBuf = graph->width;
+    if (SizeYBuf) *SizeYBuf = graph->height;
+    return 0;
+}
+
+int DeleteGraph(int GrHandle, int) {
+    state_t & s = state();
+    if (!find(s.graphs, GrHandle))
+        return -1;
+    s.graphs[GrHandle - 1].reset();
+    return 0;
+}
+
+int SetDrawBlendMode(int BlendMode, int BlendParam) {
+    state_t & s = state();
+    s.blend_mode = BlendMode;
+    s.blend_param = BlendParam;
+    return 0;
+}
+
+int SetDrawMode(int DrawMode) {
+    state().draw_mode = DrawMode;
+    return 0;
+}
+
+int SetDrawArea(int x1, int y1, int x2, int y2) {
+    state_t & s = state();
+    s.area_x1 = x1;
+    s.area_y1 = y1;
+    s.area_x2 = x2;
+    s.area_y2 = y2;
+    return 0;
+}
+
+int DeleteSharingGraph(int GrHandle) {
+    state_t & s = state();
+    const graph_t * graph = find(s.graphs, GrHandle);
+    if (!graph)
+        return -1;
+    int group = graph->group;
+    for (auto & entry : s.graphs)
+        if (entry && entry->group == group)
+            entry.reset();
+    return 0;
+}
+
+int DrawRectGraph(int DestX, int DestY, int SrcX, int SrcY, int Width, int Height, int GraphHandle, int TransFlag, int, int) {
+    state_t & s = state();
+    const graph_t * graph = find(s.graphs, GraphHandle);
+    if (!graph || SrcX < 0 || SrcY < 0 || Width <= 0 || Height <= 0 || SrcX + Width > graph->width || SrcY + Height > graph->height)
+        return -1;
+    DrawCommand command;
+    command.type = CommandType::RECT_GRAPH;
+    command.handle = GraphHandle;
+    command.x = DestX;
+    command.y = DestY;
+    command.src_x = SrcX;
+    command.src_y = SrcY;
+    command.src_width = Width;
+    command.src_height = Height;
+    command.transparent = TransFlag != FALSE;
+    if (s.rasterize)
+        rasterize_graph(s.back, *graph, command);
+    record(s, std::move(command));
+    return 0;
+}
+
+int DrawPrimitive2D(const VERTEX2D * Vertex, int VertexNum, int PrimitiveType, int GrHandle, int TransFlag) {
+    state_t & s = state();
+    if (!Vertex || VertexNum < 0 || PrimitiveType != DX_PRIMTYPE_TRIANGLELIST || (GrHandle != DX_NONE_GRAPH && !find(s.graphs, GrHandle)))
+        return -1;
+    DrawCommand command;
+    command.type = CommandType::PRIMITIVE;
+    command.handle = GrHandle;
+    command.vertex_count = VertexNum;
+    command.transparent = TransFlag != FALSE;
+    if (s.rasterize)
+        rasterize_triangles(s.back, Vertex, VertexNum, command.transparent);
+    record(s, std::move(command));
+    return 0;
+}
+
+int DrawRotaGraph3(int x, int y, int cx, int cy, double ExtRateX, double ExtRateY, double Angle, int GrHandle, int TransFlag, int, int) {
+    state_t & s = state();
+    const graph_t * graph = find(s.graphs, GrHandle);
+    if (!graph)
+        return -1;
+    DrawCommand command;
+    command.type = CommandType::ROTA_GRAPH;
+    command.handle = GrHandle;
+    command.x = x;
+    command.y = y;
+    command.center_x = cx;
+    command.center_y = cy;
+    command.src_width = graph->width;
+    command.src_height = graph->height;
+    command.scale_x = ExtRateX;
+    command.scale_y = ExtRateY;
+    command.angle = Angle;
+    command.transparent = TransFlag != FALSE;
+    if (s.rasterize)
+        rasterize_graph(s.back, *graph, command);
+    record(s, std::move(command));
+    return 0;
+}
+
+int DrawRectRotaGraph3(int x, int y, int SrcX, int SrcY, int Width, int Height, int cx, int cy, double ExtRateX, double ExtRateY, double Angle, int GrHandle, int TransFlag, int, int) {
+    state_t & s = state();
+    const graph_t * graph = find(s.graphs, GrHandle);
+    if (!graph || SrcX < 0 || SrcY < 0 || Width <= 0 || Height <= 0 || SrcX + Width > graph->width || SrcY + Height > graph->height)
+        return -1;
+    DrawCommand command;
+    command.type = CommandType::RECT_ROTA_GRAPH;
+    command.handle = GrHandle;
+    command.x = x;
+    command.y = y;
+    command.center_x = cx;
+    command.center_y = cy;
+    command.src_x = SrcX;
+    command.src_y = SrcY;
+    command.src_width = Width;
+    command.src_height = Height;
+    command.scale_x = ExtRateX;
+    command.scale_y = ExtRateY;
+    command.angle = Angle;
+    command.transparent = TransFlag != FALSE;
+    if (s.rasterize)
+        rasterize_graph(s.back, *graph, command);
+    record(s, std::move(command));
+    return 0;
+}
+
+int CreateFontToHandle(const char *, int Size, int Thick, int, int, int, int, int) {
+    auto font = std::make_unique<font_t>();
+    font->size = font_size(Size);
+    font->thick = Thick > 0 ? Thick : 6;
+    return add(state().fonts, std::move(font));
+}
+
+int GetDrawStringWidthToHandle(const char * String, int StrLen, int FontHandle, int) {
+    const font_t * font = find(state().fonts, FontHandle);
+    if (!font || !String)
+        return -1;
+    return StrLen * (std::max)(font->size / 2, 1);
+}
+
+int GetFontStateToHandle(char * FontName, int * Size, int * Thick, int FontHandle, int * FontType, int * CharSet, int * EdgeSize, int * Italic) {
+    const font_t * font = find(state().fonts, FontHandle);
+    if (!font)
+        return -1;
+    if (FontName) FontName[0] = '\0';
+    if (Size) *Size = font->size;
+    if (Thick) *Thick = font->thick;
+    if (FontType) *FontType = DX_FONTTYPE_ANTIALIASING;
+    if (CharSet) *CharSet = 0;
+    if (EdgeSize) *EdgeSize = 0;
+    if (Italic) *Italic = FALSE;
+    return 0;
+}
+
+int DeleteFontToHandle(int FontHandle) {
+    state_t & s = state();
+    if (!find(s.fonts, FontHandle))
+        return -1;
+    s.fonts[FontHandle - 1].reset();
+    return 0;
+}
+
+int DrawStringToHandle(int x, int y, const char * String, unsigned int Color, int FontHandle, unsigned int, int) {
+    const font_t * font = find(state().fonts, FontHandle);
+    if (!font || !String)
+        return -1;
+    return draw_string(x, y, String, Color, FontHandle, font->size);
+}
+
+int DrawString(int x, int y, const char * String, unsigned int Color, unsigned int) {
+    if (!String)
+        return -1;
+    return draw_string(x, y, String, Color, -1, font_size(-1));
+}
+
+int LoadSoundMem(const char *, int, int) {
+    state_t & s = state();
+    s.sounds.push_back(-1);
+    return static_cast<int>(s.sounds.size());
+}
+
+int PlaySoundMem(int SoundHandle, int PlayType, int) {
+    state_t & s = state();
+    if (SoundHandle <= 0 || static_cast<std::size_t>(SoundHandle) > s.sounds.size() || s.sounds[SoundHandle - 1] == -2)
+        return -1;
+    // Nothing is audible, so non-looping sounds finish immediately.
+    s.sounds[SoundHandle - 1] = PlayType == DX_PLAYTYPE_LOOP ? PlayType : -1;
+    return 0;
+}
+
+int CheckSoundMem(int SoundHandle) {
+    const state_t & s = state();
+    if (SoundHandle <= 0 || static_cast<std::size_t>(SoundHandle) > s.sounds.size() || s.sounds[SoundHandle - 1] == -2)
+        return -1;
+    return s.sounds[SoundHandle - 1] >= 0 ? 1 : 0;
+}
+
+int StopSoundMem(int SoundHandle) {
+    state_t & s = state();
+    if (SoundHandle <= 0 || static_cast<std::size_t>(SoundHandle) > s.sounds.size() || s.sounds[SoundHandle - 1] == -2)
+        return -1;
+    s.sounds[SoundHandle - 1] = -1;
+    return 0;
+}
+
+int DeleteSoundMem(int SoundHandle, int) {
+    state_t & s = state();
+    if (SoundHandle <= 0 || static_cast<std::size_t>(SoundHandle) > s.sounds.size() || s.sounds[SoundHandle - 1] == -2)
+        return -1;
+    s.sounds[SoundHandle - 1] = -2;
+    return 0;
+}
+
+int GetHitKeyStateAll(char * KeyStateArray) {
+    const state_t & s = state();
+    for (int i = 0; i < 256; ++i)
+        KeyStateArray[i] = s.keys[i].load(std::memory_order_relaxed);
+    return 0;
+}
+
+int GetJoypadNum() {
+    return state().joypad_count;
+}
+
+int GetJoypadInputState(int InputType) {
+    const state_t & s = state();
+    if (InputType < DX_INPUT_PAD1 || InputType > DX_INPUT_PAD4 || InputType > s.joypad_count)
+        return 0;
+    return static_cast<int>(s.pads[InputType - DX_INPUT_PAD1].buttons);
+}
+
+int GetJoypadAnalogInput(int * XBuf, int * YBuf, int InputType) {
+    const state_t & s = state();
+    bool connected = InputType >= DX_INPUT_PAD1 && InputType <= DX_INPUT_PAD4 && InputType <= s.joypad_count;
+    if (XBuf) *XBuf = connected ? s.pads[InputType - DX_INPUT_PAD1].x : 0;
+    if (YBuf) *YBuf = connected ? s.pads[InputType - DX_INPUT_PAD1].y : 0;
+    return 0;
+}
+
+int GetMousePoint(int * XBuf, int * YBuf) {
+    const state_t & s = state();
+    if (XBuf) *XBuf = s.mouse_x;
+    if (YBuf) *YBuf = s.mouse_y;
+    return 0;
+}
+
+int GetMouseInput() {
+    return static_cast<int>(state().mouse_buttons);
+}
+
+const std::vector<DrawCommand> & DxLibPp::Headless::GetCommands() {
+    return state().commands;
+}
+
+const std::vector<DrawCommand> & DxLibPp::Headless::GetPresentedCommands() {
+    return state().presented_commands;
+}
+
+std::uint64_t DxLibPp::Headless::GetPresentedFrameCount() {
+    return state().presented_frames;
+}
+
+void DxLibPp::Headless::SetRasterizerEnabled(bool enabled) {
+    state_t & s = state();
+    if (enabled && !s.rasterize) {
+        resize(s.back, s.screen_width, s.screen_height);
+        resize(s.front, s.screen_width, s.screen_height);
+    }
+    s.rasterize = enabled;
+}
+
+bool DxLibPp::Headless::IsRasterizerEnabled() {
+    return state().rasterize;
+}
+
+const Framebuffer & DxLibPp::Headless::GetFramebuffer() {
+    return state().back;
+}
+
+const Framebuffer & DxLibPp::Headless::GetPresentedFramebuffer() {
+    return state().front;
+}
+
+void DxLibPp::Headless::SetScreenSize(int width, int height) {
+    state_t & s = state();
+    s.screen_width = width;
+    s.screen_height = height;
+    SetDrawArea(0, 0, width, height);
+    if (s.rasterize) {
+        resize(s.back, width, height);
+        resize(s.front, width, height);
+    }
+}
+
+void DxLibPp::Headless::RegisterImage(const std::string & path, int width, int height, std::vector<std::uint32_t> pixels) {
+    auto image = std::make_shared<image_t>();
+    image->width = width;
+    image->height = height;
+    image->pixels = std::move(pixels);
+    if (!image->pixels.empty())
+        image->pixels.resize(static_cast<std::size_t>(width) * height, 0xffffffffu);
+    state().images[path] = std::move(image);
+}
+
+void DxLibPp::Headless::SetKey(int key_code, bool down) {
+    if (key_code >= 0 && key_code < 256)
+        state().keys[key_code].store(down ? 1 : 0, std::memory_order_relaxed);
+}
+
+void DxLibPp::Headless::SetJoypadCount(int count) {
+    state().joypad_count = (std::min)((std::max)(count, 0), 4);
+}
+
+void DxLibPp::Headless::SetJoypad(int pad, std::uint32_t buttons, int x, int y) {
+    if (pad >= 0 && pad < 4)
+        state().pads[pad] = pad_t{buttons, x, y};
+}
+
+void DxLibPp::Headless::SetMouse(int x, int y, std::uint32_t buttons) {
+    state_t & s = state();
+    s.mouse_x = x;
+    s.mouse_y = y;
+    s.mouse_buttons = buttons;
+}
+
+void DxLibPp::Headless::RequestQuit() {
+    state().quit_requested = true;
+}
@@ -0,0 +1,294 @@
+#ifndef DXLIBPP_HEADLESS_HPP
+#define DXLIBPP_HEADLESS_HPP
+
+// In-memory stand-in for the part of DxLib that DxLibPp uses. Build DxLibPp with DXLIBPP_HEADLESS to use it
+// in place of DxLib.h: draw calls are recorded as commands (and optionally rasterized), input comes from the
+// setters in DxLibPp::Headless, and nothing touches a window or GPU.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#ifndef TRUE
+#    define TRUE (1)
+#endif
+#ifndef FALSE
+#    define FALSE (0)
+#endif
+
+typedef long long LONGLONG;
+typedef unsigned char BYTE;
+
+struct VECTOR {
+    float x, y, z;
+};
+
+struct COLOR_U8 {
+    BYTE b, g, r, a;
+};
+
+struct VERTEX2D {
+    VECTOR pos;
+    float rhw;
+    COLOR_U8 dif;
+    float u, v;
+};
+
+#define DX_SCREEN_BACK (-2)
+#define DX_FONTTYPE_NORMAL (0x00)
+#define DX_FONTTYPE_ANTIALIASING (0x02)
+
+#define DX_BLENDMODE_NOBLEND (0)
+#define DX_BLENDMODE_ALPHA (1)
+#define DX_BLENDMODE_ADD (2)
+#define DX_BLENDMODE_SUB (3)
+
+#define DX_DRAWMODE_NEAREST (0)
+#define DX_DRAWMODE_BILINEAR (1)
+
+#define DX_NONE_GRAPH (-1)
+#define DX_PRIMTYPE_TRIANGLELIST (4)
+
+#define DX_PLAYTYPE_NORMAL (0)
+#define DX_PLAYTYPE_BACK (1)
+#define DX_PLAYTYPE_LOOP (3)
+
+#define DX_INPUT_PAD1 (0x0001)
+#define DX_INPUT_PAD2 (0x0002)
+#define DX_INPUT_PAD3 (0x0003)
+#define DX_INPUT_PAD4 (0x0004)
+
+#define PAD_INPUT_DOWN (0x00000001)
+#define PAD_INPUT_LEFT (0x00000002)
+#define PAD_INPUT_RIGHT (0x00000004)
+#define PAD_INPUT_UP (0x00000008)
+#define PAD_INPUT_A (0x00000010)
+#define PAD_INPUT_B (0x00000020)
+#define PAD_INPUT_C (0x00000040)
+#define PAD_INPUT_X (0x00000080)
+#define PAD_INPUT_Y (0x00000100)
+#define PAD_INPUT_Z (0x00000200)
+#define PAD_INPUT_L (0x00000400)
+#define PAD_INPUT_R (0x00000800)
+#define PAD_INPUT_START (0x00001000)
+#define PAD_INPUT_M (0x00002000)
+
+#define MOUSE_INPUT_LEFT (0x0001)
+#define MOUSE_INPUT_RIGHT (0x0002)
+#define MOUSE_INPUT_MIDDLE (0x0004)
+
+#define KEY_INPUT_BACK (0x0E)
+#define KEY_INPUT_TAB (0x0F)
+#define KEY_INPUT_RETURN (0x1C)
+
+#define KEY_INPUT_LSHIFT (0x2A)
+#define KEY_INPUT_RSHIFT (0x36)
+#define KEY_INPUT_LCONTROL (0x1D)
+#define KEY_INPUT_RCONTROL (0x9D)
+#define KEY_INPUT_ESCAPE (0x01)
+#define KEY_INPUT_SPACE (0x39)
+#define KEY_INPUT_PGUP (0xC9)
+#define KEY_INPUT_PGDN (0xD1)
+#define KEY_INPUT_END (0xCF)
+#define KEY_INPUT_HOME (0xC7)
+#define KEY_INPUT_LEFT (0xCB)
+#define KEY_INPUT_UP (0xC8)
+#define KEY_INPUT_RIGHT (0xCD)
+#define KEY_INPUT_DOWN (0xD0)
+#define KEY_INPUT_INSERT (0xD2)
+#define KEY_INPUT_DELETE (0xD3)
+
+#define KEY_INPUT_MINUS (0x0C)
+#define KEY_INPUT_YEN (0x7D)
+#define KEY_INPUT_PREVTRACK (0x90)
+#define KEY_INPUT_PERIOD (0x34)
+#define KEY_INPUT_SLASH (0x35)
+#define KEY_INPUT_LALT (0x38)
+#define KEY_INPUT_RALT (0xB8)
+#define KEY_INPUT_SCROLL (0x46)
+#define KEY_INPUT_SEMICOLON (0x27)
+#define KEY_INPUT_COLON (0x92)
+#define KEY_INPUT_LBRACKET (0x1A)
+#define KEY_INPUT_RBRACKET (0x1B)
+#define KEY_INPUT_AT (0x91)
+#define KEY_INPUT_BACKSLASH (0x2B)
+#define KEY_INPUT_COMMA (0x33)
+#define KEY_INPUT_CAPSLOCK (0x3A)
+#define KEY_INPUT_PAUSE (0xC5)
+
+#define KEY_INPUT_NUMPAD0 (0x52)
+#define KEY_INPUT_NUMPAD1 (0x4F)
+#define KEY_INPUT_NUMPAD2 (0x50)
+#define KEY_INPUT_NUMPAD3 (0x51)
+#define KEY_INPUT_NUMPAD4 (0x4B)
+#define KEY_INPUT_NUMPAD5 (0x4C)
+#define KEY_INPUT_NUMPAD6 (0x4D)
+#define KEY_INPUT_NUMPAD7 (0x47)
+#define KEY_INPUT_NUMPAD8 (0x48)
+#define KEY_INPUT_NUMPAD9 (0x49)
+#define KEY_INPUT_MULTIPLY (0x37)
+#define KEY_INPUT_ADD (0x4E)
+#define KEY_INPUT_SUBTRACT (0x4A)
+#define KEY_INPUT_DECIMAL (0x53)
+#define KEY_INPUT_DIVIDE (0xB5)
+#define KEY_INPUT_NUMPADENTER (0x9C)
+
+#define KEY_INPUT_F1 (0x3B)
+#define KEY_INPUT_F2 (0x3C)
+#define KEY_INPUT_F3 (0x3D)
+#define KEY_INPUT_F4 (0x3E)
+#define KEY_INPUT_F5 (0x3F)
+#define KEY_INPUT_F6 (0x40)
+#define KEY_INPUT_F7 (0x41)
+#define KEY_INPUT_F8 (0x42)
+#define KEY_INPUT_F9 (0x43)
+#define KEY_INPUT_F10 (0x44)
+#define KEY_INPUT_F11 (0x57)
+#define KEY_INPUT_F12 (0x58)
+
+#define KEY_INPUT_A (0x1E)
+#define KEY_INPUT_B (0x30)
+#define KEY_INPUT_C (0x2E)
+#define KEY_INPUT_D (0x20)
+#define KEY_INPUT_E (0x12)
+#define KEY_INPUT_F (0x21)
+#define KEY_INPUT_G (0x22)
+#define KEY_INPUT_H (0x23)
+#define KEY_INPUT_I (0x17)
+#define KEY_INPUT_J (0x24)
+#define KEY_INPUT_K (0x25)
+#define KEY_INPUT_L (0x26)
+#define KEY_INPUT_M (0x32)
+#define KEY_INPUT_N (0x31)
+#define KEY_INPUT_O (0x18)
+#define KEY_INPUT_P (0x19)
+#define KEY_INPUT_Q (0x10)
+#define KEY_INPUT_R (0x13)
+#define KEY_INPUT_S (0x1F)
+#define KEY_INPUT_T (0x14)
+#define KEY_INPUT_U (0x16)
+#define KEY_INPUT_V (0x2F)
+#define KEY_INPUT_W (0x11)
+#define KEY_INPUT_X (0x2D)
+#define KEY_INPUT_Y (0x15)
+#define KEY_INPUT_Z (0x2C)
+#define KEY_INPUT_0 (0x0B)
+#define KEY_INPUT_1 (0x02)
+#define KEY_INPUT_2 (0x03)
+#define KEY_INPUT_3 (0x04)
+#define KEY_INPUT_4 (0x05)
+#define KEY_INPUT_5 (0x06)
+#define KEY_INPUT_6 (0x07)
+#define KEY_INPUT_7 (0x08)
+#define KEY_INPUT_8 (0x09)
+#define KEY_INPUT_9 (0x0A)
+
+int DxLib_Init();
+int DxLib_End();
+int ChangeWindowMode(int Flag);
+int SetDrawScreen(int DrawScreen);
+int SetOutApplicationLogValidFlag(int Flag);
+int ScreenFlip();
+int ProcessMessage();
+int ClearDrawScreen();
+int GetScreenState(int * SizeX, int * SizeY, int * ColorBitDepth);
+unsigned int GetColor(int Red, int Green, int Blue);
+LONGLONG GetNowHiPerformanceCount(int UseRDTSCFlag = FALSE);
+
+int SetDrawBlendMode(int BlendMode, int BlendParam);
+int SetDrawMode(int DrawMode);
+int SetDrawArea(int x1, int y1, int x2, int y2);
+
+int LoadGraph(const char * FileName, int NotUse3DFlag = FALSE);
+int LoadDivGraph(const char * FileName, int AllNum, int XNum, int YNum, int XSize, int YSize, int * HandleArray, int NotUse3DFlag = FALSE);
+int GetGraphSize(int GrHandle, int * SizeXBuf, int * SizeYBuf);
+int DeleteGraph(int GrHandle, int LogOutFlag = FALSE);
+int DeleteSharingGraph(int GrHandle);
+int DrawRotaGraph3(int x, int y, int cx, int cy, double ExtRateX, double ExtRateY, double Angle, int GrHandle, int TransFlag, int ReverseXFlag = FALSE, int ReverseYFlag = FALSE);
+int DrawRectGraph(int DestX, int DestY, int SrcX, int SrcY, int Width, int Height, int GraphHandle, int TransFlag, int ReverseXFlag = FALSE, int ReverseYFlag = FALSE);
+int DrawRectRotaGraph3(int x, int y, int SrcX, int SrcY, int Width, int Height, int cx, int cy, double ExtRateX, double ExtRateY, double Angle, int GrHandle, int TransFlag, int ReverseXFlag = FALSE, int ReverseYFlag = FALSE);
+int DrawPrimitive2D(const VERTEX2D * Vertex, int VertexNum, int PrimitiveType, int GrHandle, int TransFlag);
+
+int CreateFontToHandle(const char * FontName, int Size, int Thick, int FontType = -1, int CharSet = -1, int EdgeSize = -1, int Italic = FALSE, int Handle = -1);
+int GetDrawStringWidthToHandle(const char * String, int StrLen, int FontHandle, int VerticalFlag = FALSE);
+int GetFontStateToHandle(char * FontName, int * Size, int * Thick, int FontHandle, int * FontType = nullptr, int * CharSet = nullptr, int * EdgeSize = nullptr, int * Italic = nullptr);
+int DeleteFontToHandle(int FontHandle);
+int DrawStringToHandle(int x, int y, const char * String, unsigned int Color, int FontHandle, unsigned int EdgeColor = 0, int VerticalFlag = FALSE);
+int DrawString(int x, int y, const char * String, unsigned int Color, unsigned int EdgeColor = 0);
+
+int LoadSoundMem(const char * FileName, int BufferNum = 3, int UnionHandle = -1);
+int PlaySoundMem(int SoundHandle, int PlayType, int TopPositionFlag = TRUE);
+int CheckSoundMem(int SoundHandle);
+int StopSoundMem(int SoundHandle);
+int DeleteSoundMem(int SoundHandle, int LogOutFlag = FALSE);
+
+int GetHitKeyStateAll(char * KeyStateArray);
+int GetJoypadNum();
+int GetJoypadInputState(int InputType);
+int GetJoypadAnalogInput(int * XBuf, int * YBuf, int InputType);
+int GetMousePoint(int * XBuf, int * YBuf);
+int GetMouseInput();
+
+namespace DxLibPp {
+namespace Headless {
+
+enum class CommandType {
+    ROTA_GRAPH,
+    RECT_GRAPH,
+    RECT_ROTA_GRAPH,
+    PRIMITIVE,
+    STRING
+};
+
+// One recorded draw call. Fields a command type does not use are left at their defaults.
+struct DrawCommand {
+    CommandType type{};
+    int handle{-1};           // graph or font handle; -1 for DrawString
+    int x{}, y{};             // destination
+    int center_x{}, center_y{}; // point of the source placed at (x, y)
+    int src_x{}, src_y{}, src_width{}, src_height{}; // RECT_*: source rectangle within the graph
+    double scale_x{1.0}, scale_y{1.0}, angle{};
+    int vertex_count{};       // PRIMITIVE
+    int blend_mode{}, blend_param{}; // SetDrawBlendMode state at the time of the call
+    bool transparent{};
+    unsigned int color{};
+    std::string text;
+};
+
+// 0xAARRGGBB pixels, row-major.
+struct Framebuffer {
+    int width{}, height{};
+    std::vector<std::uint32_t> pixels;
+    std::uint32_t GetPixel(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height ? pixels[static_cast<std::size_t>(y) * width + x] : 0;
+    }
+};
+
+// Commands drawn since the last ClearDrawScreen().
+const std::vector<DrawCommand> & GetCommands();
+// Commands of the frame shown by the last ScreenFlip().
+const std::vector<DrawCommand> & GetPresentedCommands();
+std::uint64_t GetPresentedFrameCount();
+
+// Rasterizing is off by default so benchmarks only pay for recording.
+void SetRasterizerEnabled(bool enabled);
+bool IsRasterizerEnabled();
+const Framebuffer & GetFramebuffer();
+const Framebuffer & GetPresentedFramebuffer();
+void SetScreenSize(int width, int height);
+
+// LoadGraph/LoadDivGraph only find registered images. Empty pixels mean opaque white.
+void RegisterImage(const std::string & path, int width, int height, std::vector<std::uint32_t> pixels = {});
+
+void SetKey(int key_code, bool down);
+void SetJoypadCount(int count);
+void SetJoypad(int pad, std::uint32_t buttons, int x, int y);
+void SetMouse(int x, int y, std::uint32_t buttons);
+
+// Makes the next ProcessMessage() fail, as closing the window would.
+void RequestQuit();
+
+} //namespace Headless
+} //namespace DxLibPp
+
+#endif
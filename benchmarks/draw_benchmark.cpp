@@ -0,0 +1,333 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+
+using namespace DxLibPp;
+
+namespace {
+
+void record_commands(benchmark::State & state) {
+    state.counters["commands/frame"] = static_cast<double>(Headless::GetPresentedCommands().size());
+}
+
+void BM_GraphDraw(benchmark::State & state) {
+    Headless::RegisterImage("sprite.png", 32, 32);
+    std::vector<Graph> graphs(static_cast<std::size_t>(state.range(0)), Graph{});
+    for (std::size_t i = 0; i < graphs.size(); ++i) {
+        graphs[i].Load("sprite.png");
+        graphs[i].SetX(static_cast<double>(i % 20 * 32));
+        graphs[i].SetY(static_cast<double>(i / 20 % 15 * 32));
+    }
+    for (auto _ : state) {
+        for (const Graph & graph : graphs)
+            graph.Draw();
+        System::Update();
+    }
+    record_commands(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GraphDraw)->Arg(100)->Arg(1000)->Arg(10000);
+
+void BM_GraphCopy(benchmark::State & state) {
+    Headless::RegisterImage("sprite.png", 32, 32);
+    Graph source{"sprite.png"};
+    std::vector<Graph> graphs;
+    graphs.reserve(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        graphs.clear();
+        for (int i = 0; i < state.range(0); ++i)
+            graphs.push_back(source);
+        benchmark::DoNotOptimize(graphs.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GraphCopy)->Arg(100)->Arg(10000);
+
+void BM_GraphAssign(benchmark::State & state) {
+    Headless::RegisterImage("sprite.png", 32, 32);
+    Graph source{"sprite.png"};
+    std::vector<Graph> graphs(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        for (Graph & graph : graphs)
+            graph = source;
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GraphAssign)->Arg(100)->Arg(10000);
+
+// 4096 16x16 cells on a 1024x1024 sheet.
+void BM_LoadDivGraph(benchmark::State & state) {
+    Headless::RegisterImage("sheet.png", 1024, 1024);
+    for (auto _ : state) {
+        auto cells = Graph::LoadDivGraph("sheet.png", 4096, 64, 64, 16, 16);
+        benchmark::DoNotOptimize(cells.HasNext());
+    }
+    state.SetItemsProcessed(state.iterations() * 4096);
+}
+BENCHMARK(BM_LoadDivGraph);
+
+void BM_SpriteSheetLoad(benchmark::State & state) {
+    Headless::RegisterImage("sheet.png", 1024, 1024);
+    for (auto _ : state) {
+        SpriteSheet sheet{"sheet.png", 4096, 64, 64, 16, 16};
+        benchmark::DoNotOptimize(sheet.GetCell(4095));
+    }
+    state.SetItemsProcessed(state.iterations() * 4096);
+}
+BENCHMARK(BM_SpriteSheetLoad);
+
+void BM_SpriteSheetDraw(benchmark::State & state) {
+    Headless::RegisterImage("sheet.png", 1024, 1024);
+    SpriteSheet sheet{"sheet.png", 4096, 64, 64, 16, 16};
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i)
+            sheet.Draw(static_cast<std::size_t>(i) % sheet.GetCellNumber(), i % 40 * 16, i / 40 % 30 * 16);
+        System::Update();
+    }
+    record_commands(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SpriteSheetDraw)->Arg(10000);
+
+// Sprites from four textures, alternating between alpha and additive blending, drawn in scene order.
+std::vector<Graph> make_mixed_sprites(std::size_t count) {
+    const char * paths[] = {"a.png", "b.png", "c.png", "d.png"};
+    for (const char * path : paths)
+        Headless::RegisterImage(path, 32, 32);
+    std::vector<Graph> graphs;
+    for (std::size_t i = 0; i < count; ++i) {
+        graphs.emplace_back(paths[i % 4]);
+        graphs.back().SetX(static_cast<double>(i % 20 * 32));
+        graphs.back().SetY(static_cast<double>(i / 20 % 15 * 32));
+    }
+    return graphs;
+}
+
+void BM_DrawImmediate(benchmark::State & state) {
+    std::vector<Graph> graphs = make_mixed_sprites(static_cast<std::size_t>(state.range(0)));
+    std::size_t state_changes = 0;
+    for (auto _ : state) {
+        int current = -1;
+        for (std::size_t i = 0; i < graphs.size(); ++i) {
+            int mode = i % 2 ? DX_BLENDMODE_ADD : DX_BLENDMODE_ALPHA;
+            if (mode != current) {
+                SetDrawBlendMode(mode, 255);
+                current = mode;
+                ++state_changes;
+            }
+            graphs[i].Draw();
+        }
+        SetDrawBlendMode(DX_BLENDMODE_NOBLEND, 255);
+        System::Update();
+    }
+    state.counters["state_changes/frame"] = static_cast<double>(state_changes) / state.iterations();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DrawImmediate)->Arg(10000);
+
+void BM_DrawCommandBuffer(benchmark::State & state) {
+    std::vector<Graph> graphs = make_mixed_sprites(static_cast<std::size_t>(state.range(0)));
+    DrawCommandBuffer buffer;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < graphs.size(); ++i) {
+            buffer.SetBlendMode(i % 2 ? BlendMode::ADD : BlendMode::ALPHA);
+            graphs[i].Submit(buffer);
+        }
+        buffer.Flush();
+        System::Update();
+    }
+    state.counters["state_changes/frame"] = static_cast<double>(buffer.GetStats().state_changes);
+    state.counters["elided/frame"] = static_cast<double>(buffer.GetStats().elided);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DrawCommandBuffer)->Arg(10000);
+
+struct NullDrawable : Drawable {
+    void Draw() const override {}
+};
+
+// 100k drawables on four layers; range(0) of them change z each frame.
+void BM_LayeredDrawListRefresh(benchmark::State & state) {
+    std::vector<NullDrawable> drawables(100000);
+    LayeredDrawList list;
+    std::vector<std::size_t> ids;
+    for (std::size_t i = 0; i < drawables.size(); ++i)
+        ids.push_back(list.Add(drawables[i], static_cast<std::uint8_t>(i % 4), static_cast<double>(i * 7919 % 100000)));
+    list.Refresh();
+    std::size_t next = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i) {
+            std::size_t id = ids[next++ % ids.size()];
+            list.SetZ(id, list.GetZ(id) + 0.5);
+        }
+        list.Draw();
+    }
+    state.counters["moved/frame"] = static_cast<double>(list.GetMovedCount());
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(drawables.size()));
+}
+BENCHMARK(BM_LayeredDrawListRefresh)->Arg(0)->Arg(100)->Arg(1000)->Arg(10000);
+
+// The baseline: the same 100k drawables sorted by layer and z from scratch every frame.
+void BM_FullSortDrawOrder(benchmark::State & state) {
+    struct entry_t {
+        std::uint8_t layer;
+        double z;
+        const Drawable * drawable;
+    };
+    std::vector<NullDrawable> drawables(100000);
+    std::vector<entry_t> entries;
+    for (std::size_t i = 0; i < drawables.size(); ++i)
+        entries.push_back(entry_t{static_cast<std::uint8_t>(i % 4), static_cast<double>(i * 7919 % 100000), &drawables[i]});
+    std::vector<entry_t> sorted;
+    std::size_t next = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i)
+            entries[next++ % entries.size()].z += 0.5;
+        sorted = entries;
+        std::sort(sorted.begin(), sorted.end(), [](const entry_t & a, const entry_t & b) {
+            return a.layer < b.layer || (a.layer == b.layer && a.z < b.z);
+        });
+        for (const entry_t & entry : sorted)
+            entry.drawable->Draw();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(drawables.size()));
+}
+BENCHMARK(BM_FullSortDrawOrder)->Arg(100)->Arg(10000);
+
+// A 32000x32000 world of 1M sprites on a 32 px grid, built once and shared by the camera benchmarks.
+const std::vector<Graph> & camera_world() {
+    static std::vector<Graph> graphs = [] {
+        Headless::RegisterImage("world.png", 32, 32);
+        Graph prototype{"world.png"};
+        std::vector<Graph> graphs(1000000, prototype);
+        for (std::size_t i = 0; i < graphs.size(); ++i) {
+            graphs[i].SetX(static_cast<double>(i % 1000 * 32));
+            graphs[i].SetY(static_cast<double>(i / 1000 * 32));
+        }
+        return graphs;
+    }();
+    return graphs;
+}
+
+void record_cull_stats(benchmark::State & state) {
+    state.counters["drawn/frame"] = static_cast<double>(Screen::GetCullStats().drawn);
+    state.counters["culled/frame"] = static_cast<double>(Screen::GetCullStats().culled);
+}
+
+// range(0) is the zoom in percent; the camera pans across the world, turned slightly.
+void BM_CameraCullDraw(benchmark::State & state) {
+    const std::vector<Graph> & graphs = camera_world();
+    double pan = 0.0;
+    for (auto _ : state) {
+        Screen::SetCamera(Camera{Point{16000.0 + pan, 16000.0}, state.range(0) / 100.0, 0.1, Point{320.0, 240.0}});
+        pan = pan < 1000.0 ? pan + 4.0 : 0.0;
+        for (const Graph & graph : graphs)
+            graph.Draw();
+        System::Update();
+    }
+    record_cull_stats(state);
+    Screen::ResetCamera();
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(graphs.size()));
+}
+BENCHMARK(BM_CameraCullDraw)->Arg(100)->Arg(25)->Unit(benchmark::kMillisecond);
+
+void BM_CameraCullSubmit(benchmark::State & state) {
+    const std::vector<Graph> & graphs = camera_world();
+    DrawCommandBuffer buffer;
+    double pan = 0.0;
+    for (auto _ : state) {
+        Screen::SetCamera(Camera{Point{16000.0 + pan, 16000.0}, state.range(0) / 100.0, 0.1, Point{320.0, 240.0}});
+        pan = pan < 1000.0 ? pan + 4.0 : 0.0;
+        for (const Graph & graph : graphs)
+            graph.Submit(buffer);
+        buffer.Flush();
+        System::Update();
+    }
+    record_cull_stats(state);
+    Screen::ResetCamera();
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(graphs.size()));
+}
+BENCHMARK(BM_CameraCullSubmit)->Arg(100)->Arg(25)->Unit(benchmark::kMillisecond);
+
+// The tile map behind a camera: only the cells in view are visited.
+void BM_TiledMapCameraDraw(benchmark::State & state) {
+    Headless::RegisterImage("tile.png", 32, 32);
+    TiledMap map{1000, 1000, 32, 32};
+    map.AddGraph(Graph{"tile.png"});
+    for (std::size_t row = 0; row < 1000; ++row)
+        for (std::size_t column = 0; column < 1000; ++column)
+            map.SetGraphIndex(column, row, 0);
+    Screen::SetCamera(Camera{Point{16000.0, 16000.0}, 1.0, 0.0, Point{320.0, 240.0}});
+    for (auto _ : state) {
+        map.Draw();
+        System::Update();
+    }
+    record_cull_stats(state);
+    record_commands(state);
+    Screen::ResetCamera();
+}
+BENCHMARK(BM_TiledMapCameraDraw);
+
+void BM_FontDraw(benchmark::State & state) {
+    Font font;
+    font.SetText("The quick brown fox");
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i) {
+            font.SetY(i * 16 % 480);
+            font.Draw();
+        }
+        System::Update();
+    }
+    record_commands(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FontDraw)->Arg(100)->Arg(1000);
+
+void BM_FontGetWidth(benchmark::State & state) {
+    Font font;
+    font.SetText("The quick brown fox");
+    for (auto _ : state) {
+        double width = 0.0;
+        for (int i = 0; i < state.range(0); ++i)
+            width += font.GetWidth();
+        benchmark::DoNotOptimize(width);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FontGetWidth)->Arg(100)->Arg(1000);
+
+void BM_TiledMapDraw(benchmark::State & state) {
+    Headless::RegisterImage("tiles.png", 32, 32);
+    std::size_t size = static_cast<std::size_t>(state.range(0));
+    TiledMap map{size, size, 32.0, 32.0};
+    map.AddGraph(Graph{"tiles.png"});
+    for (std::size_t row = 0; row < size; ++row)
+        for (std::size_t column = 0; column < size; ++column)
+            map.SetGraphIndex(column, row, 0);
+    for (auto _ : state) {
+        map.Draw();
+        System::Update();
+    }
+    record_commands(state);
+}
+BENCHMARK(BM_TiledMapDraw)->Arg(32)->Arg(128);
+
+void BM_RasterizeGraph(benchmark::State & state) {
+    Headless::RegisterImage("sprite.png", 32, 32);
+    Headless::SetRasterizerEnabled(true);
+    Graph graph{"sprite.png"};
+    graph.SetTheta(0.5);
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i) {
+            graph.SetX(i * 7 % 600);
+            graph.Draw();
+        }
+        System::Update();
+    }
+    Headless::SetRasterizerEnabled(false);
+    record_commands(state);
+}
+BENCHMARK(BM_RasterizeGraph)->Arg(100);
+
+}
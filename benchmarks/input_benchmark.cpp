@@ -0,0 +1,175 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DxLibPp;
+
+namespace {
+
+void BM_KeyStateUpdate(benchmark::State & state) {
+    std::mt19937 random{1};
+    for (auto _ : state) {
+        Headless::SetKey(static_cast<int>(random() % 256), random() % 2 != 0);
+        System::Update();
+    }
+}
+BENCHMARK(BM_KeyStateUpdate);
+
+void BM_InputSnapshot(benchmark::State & state) {
+    char keys[256]{};
+    InputSnapshot previous;
+    std::mt19937 random{1};
+    for (auto _ : state) {
+        keys[random() % 256] ^= 1;
+        previous = InputSnapshot{previous, keys};
+        benchmark::DoNotOptimize(previous.GetDown());
+    }
+}
+BENCHMARK(BM_InputSnapshot);
+
+void BM_KeyCheckHit(benchmark::State & state) {
+    for (auto _ : state) {
+        int hits = 0;
+        for (int key_code = 0; key_code < 256; ++key_code)
+            hits += Key::CheckHit(key_code) + Key::GetTimer(key_code);
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(BM_KeyCheckHit);
+
+enum class Action { LEFT, RIGHT, UP, DOWN, JUMP, FIRE, PAUSE, MENU };
+
+constexpr ActionMap<Action, 8> default_actions{
+    {Action::LEFT, Key::INPUT_LEFT}, {Action::LEFT, Key::INPUT_A},
+    {Action::RIGHT, Key::INPUT_RIGHT}, {Action::RIGHT, Key::INPUT_D},
+    {Action::UP, Key::INPUT_UP}, {Action::UP, Key::INPUT_W},
+    {Action::DOWN, Key::INPUT_DOWN}, {Action::DOWN, Key::INPUT_S},
+    {Action::JUMP, Key::INPUT_SPACE}, {Action::FIRE, Key::INPUT_Z},
+    {Action::PAUSE, Key::INPUT_ESCAPE}, {Action::MENU, Key::INPUT_TAB},
+};
+
+// One frame's worth of action handling: resolve once, then query every action state.range(0) times.
+void BM_ActionMapFrame(benchmark::State & state) {
+    ActionMap<Action, 8> actions = default_actions;
+    Headless::SetKey(Key::INPUT_SPACE, true);
+    System::Update();
+    for (auto _ : state) {
+        actions.Resolve();
+        int active = 0;
+        for (int i = 0; i < state.range(0); ++i) {
+            for (int action = 0; action < 8; ++action)
+                active += actions.IsDown(static_cast<Action>(action)) + actions.IsPressed(static_cast<Action>(action));
+            benchmark::DoNotOptimize(actions);
+        }
+        benchmark::DoNotOptimize(active);
+    }
+    Headless::SetKey(Key::INPUT_SPACE, false);
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 8);
+}
+BENCHMARK(BM_ActionMapFrame)->Arg(1)->Arg(100);
+
+void BM_InputReplay(benchmark::State & state) {
+    std::mt19937 random{1};
+    InputRecorder::Start();
+    for (int frame = 0; frame < 10000; ++frame) {
+        if (random() % 8 == 0)
+            Headless::SetKey(static_cast<int>(random() % 256), random() % 2 != 0);
+        System::Update();
+    }
+    std::vector<std::uint8_t> recording = InputRecorder::Stop();
+    for (int key_code = 0; key_code < 256; ++key_code)
+        Headless::SetKey(key_code, false);
+    for (auto _ : state) {
+        state.PauseTiming();
+        InputReplayer::Start(recording);
+        state.ResumeTiming();
+        while (InputReplayer::IsReplaying())
+            System::Update();
+    }
+    state.counters["bytes"] = static_cast<double>(recording.size());
+    state.SetItemsProcessed(state.iterations() * 10000);
+}
+BENCHMARK(BM_InputReplay);
+
+void BM_SpscQueue(benchmark::State & state) {
+    static SpscQueue<InputEvent, 1024> queue;
+    InputEvent event{};
+    for (auto _ : state) {
+        for (int i = 0; i < 512; ++i)
+            queue.Push(InputEvent{i, true, i});
+        while (queue.Pop(event))
+            benchmark::DoNotOptimize(event);
+    }
+    state.SetItemsProcessed(state.iterations() * 512);
+}
+BENCHMARK(BM_SpscQueue);
+
+// Input-to-logic latency for taps shorter than a frame: 64 taps of 8 ms at random phases against a 30 fps
+// frame loop. state.range(0) == 0 samples the keys once per frame (InputEvents::Poll, as System::Update does);
+// otherwise a polling thread samples them every state.range(0) microseconds. taps_seen counts the taps that
+// produced a press event, latency_us is the mean time from the key going down to its event's timestamp.
+void BM_InputTapLatency(benchmark::State & state) {
+    constexpr int TAPS = 64;
+    constexpr std::int64_t TAP_MICROSECONDS = 8000, FRAME_MICROSECONDS = 33333;
+    const int polling_interval = static_cast<int>(state.range(0));
+    InputEvent event{};
+    int seen_taps = 0;
+    std::int64_t latency = 0;
+    for (auto _ : state) {
+        while (InputEvents::Pop(event))
+            ;
+        if (polling_interval != 0)
+            InputEvents::StartPolling(polling_interval);
+        const auto start = std::chrono::steady_clock::now();
+        std::int64_t next_frame = 0;
+        // Sleeps until the given time since start, running every frame that falls before it.
+        auto wait_until = [&](std::int64_t microseconds) {
+            for (; polling_interval == 0 && next_frame <= microseconds; next_frame += FRAME_MICROSECONDS) {
+                std::this_thread::sleep_until(start + std::chrono::microseconds{next_frame});
+                InputEvents::Poll();
+            }
+            std::this_thread::sleep_until(start + std::chrono::microseconds{microseconds});
+        };
+        std::mt19937 random{1};
+        std::vector<std::int64_t> presses;
+        std::int64_t time = 0;
+        for (int tap = 0; tap < TAPS; ++tap) {
+            time += FRAME_MICROSECONDS / 2 + static_cast<std::int64_t>(random() % FRAME_MICROSECONDS);
+            wait_until(time);
+            presses.push_back(GetNowHiPerformanceCount());
+            Headless::SetKey(Key::INPUT_SPACE, true);
+            wait_until(time + TAP_MICROSECONDS);
+            Headless::SetKey(Key::INPUT_SPACE, false);
+            time += TAP_MICROSECONDS;
+        }
+        wait_until(time + FRAME_MICROSECONDS);
+        if (polling_interval != 0)
+            InputEvents::StopPolling();
+
+        // A press event belongs to the last tap that went down before it was sampled.
+        std::vector<bool> seen(TAPS, false);
+        seen_taps = 0;
+        latency = 0;
+        while (InputEvents::Pop(event)) {
+            if (event.key_code != Key::INPUT_SPACE || !event.pressed)
+                continue;
+            auto tap = std::upper_bound(presses.begin(), presses.end(), event.timestamp) - presses.begin() - 1;
+            if (tap < 0 || seen[tap])
+                continue;
+            seen[tap] = true;
+            ++seen_taps;
+            latency += event.timestamp - presses[tap];
+        }
+    }
+    state.counters["taps_seen"] = static_cast<double>(seen_taps);
+    state.counters["latency_us"] = seen_taps == 0 ? 0.0 : static_cast<double>(latency) / seen_taps;
+}
+BENCHMARK(BM_InputTapLatency)->Arg(0)->Arg(1000)->Iterations(1)->Repetitions(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}
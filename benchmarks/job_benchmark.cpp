@@ -0,0 +1,148 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+#include <cmath>
+
+using namespace DxLibPp;
+
+namespace {
+
+struct Mover : Object {
+    double x{}, y{}, vx{1.0}, vy{0.5}, theta{};
+    void Update() override {
+        x += vx;
+        y += vy;
+        theta = std::atan2(vy, vx);
+    }
+    bool IsThreadSafe() const override { return true; }
+    double GetX() const override { return x; }
+    double GetY() const override { return y; }
+    void SetX(double x) override { this->x = x; }
+    void SetY(double y) override { this->y = y; }
+    double GetWidth() const override { return 8.0; }
+    double GetHeight() const override { return 8.0; }
+    void SetWidth(double) override {}
+    void SetHeight(double) override {}
+    double GetTheta() const override { return theta; }
+    void SetTheta(double theta) override { this->theta = theta; }
+};
+
+// range(0) is the total thread count, the benchmark thread included.
+void BM_JobParallelFor(benchmark::State & state) {
+    JobSystem jobs{static_cast<std::size_t>(state.range(0) - 1)};
+    std::vector<double> values(1 << 20, 1.0);
+    for (auto _ : state) {
+        jobs.ParallelFor(0, values.size(), [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i)
+                values[i] = std::sqrt(values[i] + static_cast<double>(i));
+        });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(values.size()));
+}
+BENCHMARK(BM_JobParallelFor)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+void BM_JobDependencyChain(benchmark::State & state) {
+    JobSystem jobs{3};
+    for (auto _ : state) {
+        std::vector<std::unique_ptr<JobCounter>> counters;
+        counters.push_back(std::make_unique<JobCounter>());
+        jobs.Run([] {}, counters.back().get());
+        for (int i = 1; i < state.range(0); ++i) {
+            counters.push_back(std::make_unique<JobCounter>());
+            jobs.RunAfter(*counters[counters.size() - 2], [] {}, counters.back().get());
+        }
+        jobs.Wait(*counters.back());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JobDependencyChain)->Arg(1000)->UseRealTime();
+
+void BM_GlobalUpdateSerial(benchmark::State & state) {
+    for (int i = 0; i < 100000; ++i)
+        Global::Create<Mover>();
+    for (auto _ : state)
+        for (auto & mover : Global::list<Mover>())
+            mover->Update();
+    Global::list<Mover>().clear();
+    state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_GlobalUpdateSerial);
+
+void BM_GlobalUpdateParallel(benchmark::State & state) {
+    JobSystem jobs{static_cast<std::size_t>(state.range(0) - 1)};
+    for (int i = 0; i < 100000; ++i)
+        Global::Create<Mover>();
+    for (auto _ : state)
+        Global::Update<Mover>(jobs);
+    Global::list<Mover>().clear();
+    state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_GlobalUpdateParallel)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+void BM_PrepareDrawList(benchmark::State & state) {
+    JobSystem jobs{static_cast<std::size_t>(state.range(0) - 1)};
+    for (int i = 0; i < 100000; ++i)
+        Global::Create<Mover>()->SetX(i % 2000);
+    std::vector<const Mover *> drawables;
+    for (auto _ : state)
+        Global::PrepareDrawList<Mover>(jobs, drawables, [](const Mover & mover) { return mover.GetX() < 640.0; });
+    Global::list<Mover>().clear();
+    state.counters["visible"] = static_cast<double>(drawables.size());
+    state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_PrepareDrawList)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+std::vector<Graph> make_sprites(std::size_t count) {
+    const char * paths[] = {"a.png", "b.png", "c.png", "d.png"};
+    for (const char * path : paths)
+        Headless::RegisterImage(path, 32, 32);
+    std::vector<Graph> graphs;
+    for (std::size_t i = 0; i < count; ++i) {
+        graphs.emplace_back(paths[i % 4]);
+        graphs.back().SetX(static_cast<double>(i % 20 * 32));
+        graphs.back().SetY(static_cast<double>(i / 20 % 15 * 32));
+    }
+    return graphs;
+}
+
+// Recording only: 200k sprites submitted from jobs into per-thread buffers, which are then dropped.
+void BM_ThreadDrawRecord(benchmark::State & state) {
+    JobSystem jobs{static_cast<std::size_t>(state.range(0) - 1)};
+    std::vector<Graph> graphs = make_sprites(200000);
+    ThreadDrawCommandBuffers buffers{jobs};
+    std::size_t recorded = 0;
+    for (auto _ : state) {
+        jobs.ParallelFor(0, graphs.size(), [&](std::size_t first, std::size_t last) {
+            DrawCommandBuffer & buffer = buffers.GetLocal();
+            for (std::size_t i = first; i < last; ++i)
+                graphs[i].Submit(buffer);
+        });
+        recorded = buffers.GetSize();
+        buffers.Clear();
+    }
+    state.counters["commands/frame"] = static_cast<double>(recorded);
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(graphs.size()));
+}
+BENCHMARK(BM_ThreadDrawRecord)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+// Recording plus the merge, sort and replay on the benchmark thread.
+void BM_ThreadDrawFlush(benchmark::State & state) {
+    JobSystem jobs{static_cast<std::size_t>(state.range(0) - 1)};
+    std::vector<Graph> graphs = make_sprites(200000);
+    ThreadDrawCommandBuffers buffers{jobs};
+    for (auto _ : state) {
+        jobs.ParallelFor(0, graphs.size(), [&](std::size_t first, std::size_t last) {
+            DrawCommandBuffer & buffer = buffers.GetLocal();
+            for (std::size_t i = first; i < last; ++i)
+                graphs[i].Submit(buffer);
+        });
+        buffers.Flush();
+        System::Update();
+    }
+    state.counters["state_changes/frame"] = static_cast<double>(buffers.GetStats().state_changes);
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(graphs.size()));
+}
+BENCHMARK(BM_ThreadDrawFlush)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+}
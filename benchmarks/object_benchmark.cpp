@@ -0,0 +1,123 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+
+using namespace DxLibPp;
+
+namespace {
+
+struct FrameIterator : Iterator<std::shared_ptr<Animation::frame>>::Implement {
+    explicit FrameIterator(std::vector<std::shared_ptr<Animation::frame>> frames) : frames{std::move(frames)} {}
+    bool HasNext() const override { return next < frames.size(); }
+    std::shared_ptr<Animation::frame> Next() override { return frames.at(next++); }
+    void Remove() override {}
+    std::vector<std::shared_ptr<Animation::frame>> frames;
+    std::size_t next = 0;
+};
+
+// One 32x32 graph cut into frame_count 32x4 strips, four 60 Hz ticks each.
+std::shared_ptr<const AnimationClip> make_clip(std::size_t frame_count) {
+    Headless::RegisterImage("anim.png", 32, 32);
+    Graph graph{"anim.png"};
+    std::vector<AnimationClip::Frame> frames;
+    for (std::size_t i = 0; i < frame_count; ++i)
+        frames.push_back(AnimationClip::Frame{graph.GetHandle(), 0, static_cast<int>(i % 8) * 4, 32, 4, 4.0 / 60.0});
+    return std::make_shared<const AnimationClip>(std::move(frames), std::vector<Graph>{graph});
+}
+
+void BM_AnimationUpdate(benchmark::State & state) {
+    auto clip = make_clip(8);
+    std::vector<Animation> animations(static_cast<std::size_t>(state.range(0)), Animation{clip});
+    for (auto _ : state) {
+        for (Animation & animation : animations)
+            animation.Advance(1.0 / 60.0);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::size_t clip_bytes = sizeof(AnimationClip) + clip->GetFrameNumber() * sizeof(AnimationClip::Frame);
+    state.counters["bytes_per_instance"] = static_cast<double>(sizeof(Animation)) + static_cast<double>(clip_bytes) / state.range(0);
+}
+BENCHMARK(BM_AnimationUpdate)->Arg(100)->Arg(10000)->Arg(100000);
+
+// Frames last four ticks. The cursors are added in four groups with a tick of playback after each group, so
+// their boundaries are a tick apart and a quarter of them cross one each tick, as in a real scene. The final
+// half tick keeps every boundary clear of the tick instants.
+void BM_AnimationBatchUpdate(benchmark::State & state) {
+    auto clip = make_clip(8);
+    AnimationBatch batch;
+    const AnimationMode modes[] = {AnimationMode::LOOP, AnimationMode::PING_PONG};
+    for (int group = 0; group < 4; ++group) {
+        for (int i = group; i < state.range(0); i += 4) {
+            std::size_t id = batch.Add(clip, modes[i % 2]);
+            batch.SetFrameIndex(id, static_cast<std::size_t>(i));
+        }
+        batch.Update(1.0 / 60.0);
+    }
+    batch.Update(0.5 / 60.0);
+    std::size_t events = 0;
+    for (auto _ : state) {
+        batch.Update(1.0 / 60.0);
+        events += batch.GetEvents().size();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["events_per_update"] = static_cast<double>(events) / state.iterations();
+}
+BENCHMARK(BM_AnimationBatchUpdate)->Arg(10000)->Arg(100000);
+
+void BM_AnimationCreate(benchmark::State & state) {
+    auto clip = make_clip(8);
+    for (auto _ : state) {
+        std::vector<Animation> animations;
+        animations.reserve(static_cast<std::size_t>(state.range(0)));
+        for (int i = 0; i < state.range(0); ++i)
+            animations.emplace_back(clip);
+        benchmark::DoNotOptimize(animations.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AnimationCreate)->Arg(10000);
+
+// The legacy path: every instance builds its own clip from a frame iterator.
+void BM_AnimationCreateFromIterator(benchmark::State & state) {
+    Headless::RegisterImage("anim.png", 32, 32);
+    auto graph = std::make_shared<Graph>("anim.png");
+    std::vector<std::shared_ptr<Animation::frame>> frames;
+    for (std::size_t i = 0; i < 8; ++i)
+        frames.push_back(std::make_shared<Animation::frame>(graph, 4));
+    for (auto _ : state) {
+        std::vector<Animation> animations;
+        animations.reserve(static_cast<std::size_t>(state.range(0)));
+        for (int i = 0; i < state.range(0); ++i)
+            animations.emplace_back(std::make_shared<Iterator<std::shared_ptr<Animation::frame>>>(std::make_shared<FrameIterator>(frames)));
+        benchmark::DoNotOptimize(animations.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AnimationCreateFromIterator)->Arg(10000);
+
+void BM_IteratorTraversal(benchmark::State & state) {
+    std::vector<int> values(static_cast<std::size_t>(state.range(0)), 1);
+    for (auto _ : state) {
+        auto iterator = GetIterator(values);
+        long long sum = 0;
+        while (iterator.HasNext())
+            sum += iterator.Next();
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IteratorTraversal)->Arg(100)->Arg(10000);
+
+void BM_GlobalCreate(benchmark::State & state) {
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i)
+            benchmark::DoNotOptimize(Global::Create<Font>());
+        state.PauseTiming();
+        Global::list<Font>().clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GlobalCreate)->Arg(100)->Arg(1000);
+
+}
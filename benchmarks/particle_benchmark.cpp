@@ -0,0 +1,85 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+
+using namespace DxLibPp;
+
+namespace {
+
+ParticleEmitter make_emitter() {
+    ParticleEmitter emitter;
+    emitter.x = 320.0;
+    emitter.y = 240.0;
+    emitter.life_min = 1.0e6;
+    emitter.life_max = 1.0e6;
+    emitter.speed_min = 10.0;
+    emitter.speed_max = 100.0;
+    emitter.spread = 3.14159265358979;
+    emitter.color = 0xffffa040u;
+    return emitter;
+}
+
+void BM_ParticleUpdate(benchmark::State & state) {
+    auto count = static_cast<std::size_t>(state.range(0));
+    ParticleSystem particles{count};
+    particles.SetGravity(0.0, 98.0);
+    particles.Emit(make_emitter(), count);
+    for (auto _ : state) {
+        particles.Update(1.0 / 60.0);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParticleUpdate)->Arg(10000)->Arg(1000000);
+
+void BM_ParticleUpdateDraw(benchmark::State & state) {
+    auto count = static_cast<std::size_t>(state.range(0));
+    ParticleSystem particles{count};
+    particles.SetGravity(0.0, 98.0);
+    particles.Emit(make_emitter(), count);
+    for (auto _ : state) {
+        particles.Update(1.0 / 60.0);
+        particles.Draw();
+        System::Update();
+    }
+    state.counters["commands/frame"] = static_cast<double>(Headless::GetPresentedCommands().size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParticleUpdateDraw)->Arg(10000)->Arg(1000000);
+
+// One million particles updated and drawn on range(0) workers. Real time, since the work happens off the
+// benchmark thread.
+void BM_ParticleThreads(benchmark::State & state) {
+    ParticleSystem particles{1000000, static_cast<std::size_t>(state.range(0))};
+    particles.SetGravity(0.0, 98.0);
+    particles.Emit(make_emitter(), particles.GetCapacity());
+    for (auto _ : state) {
+        particles.Update(1.0 / 60.0);
+        particles.Draw();
+        System::Update();
+    }
+    state.counters["commands/frame"] = static_cast<double>(Headless::GetPresentedCommands().size());
+    state.SetItemsProcessed(state.iterations() * 1000000);
+}
+BENCHMARK(BM_ParticleThreads)->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// A continuous emitter at steady state: 60k particles a second living one second, so spawns and retirements
+// balance at about 60k live particles.
+void BM_ParticleEmitterSteadyState(benchmark::State & state) {
+    ParticleSystem particles{100000};
+    ParticleEmitter emitter = make_emitter();
+    emitter.rate = 60000.0;
+    emitter.life_min = 0.5;
+    emitter.life_max = 1.5;
+    particles.AddEmitter(emitter);
+    for (int i = 0; i < 120; ++i)
+        particles.Update(1.0 / 60.0);
+    for (auto _ : state) {
+        particles.Update(1.0 / 60.0);
+        benchmark::ClobberMemory();
+    }
+    state.counters["live"] = static_cast<double>(particles.GetCount());
+}
+BENCHMARK(BM_ParticleEmitterSteadyState);
+
+}
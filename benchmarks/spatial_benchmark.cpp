@@ -0,0 +1,268 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+
+using namespace DxLibPp;
+
+namespace {
+
+CollisionGrid make_grid(int size, double density, unsigned seed = 1) {
+    CollisionGrid grid{size, size};
+    std::mt19937 random{seed};
+    std::bernoulli_distribution solid{density};
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            grid.SetSolid(x, y, solid(random));
+    return grid;
+}
+
+std::vector<std::pair<Cell, Cell>> make_queries(const CollisionGrid & grid, std::size_t count, unsigned seed = 2) {
+    std::mt19937 random{seed};
+    std::uniform_int_distribution<int> column{0, grid.GetWidth() - 1}, row{0, grid.GetHeight() - 1};
+    auto open_cell = [&] {
+        Cell cell;
+        do cell = Cell{column(random), row(random)}; while (grid.IsSolid(cell.x, cell.y));
+        return cell;
+    };
+    std::vector<std::pair<Cell, Cell>> queries;
+    for (std::size_t i = 0; i < count; ++i)
+        queries.emplace_back(open_cell(), open_cell());
+    return queries;
+}
+
+void BM_AabbTreeQuery(benchmark::State & state) {
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 4096.0};
+    AabbTree<int> tree;
+    for (int i = 0; i < state.range(0); ++i)
+        tree.Insert(Rect{position(random), position(random), 16.0, 16.0}, i);
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        Rect view{position(random), position(random), 640.0, 480.0};
+        tree.Query(view, [&](int, int) { ++hits; return true; });
+    }
+    benchmark::DoNotOptimize(hits);
+    state.counters["height"] = static_cast<double>(tree.GetHeight());
+}
+BENCHMARK(BM_AabbTreeQuery)->Arg(1000)->Arg(100000);
+
+// The same rects and views as BM_AabbTreeQuery, tested one by one.
+void BM_BruteForceQuery(benchmark::State & state) {
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 4096.0};
+    std::vector<Rect> rects;
+    for (int i = 0; i < state.range(0); ++i)
+        rects.emplace_back(position(random), position(random), 16.0, 16.0);
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        double x = position(random), y = position(random);
+        for (const Rect & r : rects)
+            hits += r.GetX() <= x + 640.0 && x <= r.GetX() + r.GetWidth() && r.GetY() <= y + 480.0 && y <= r.GetY() + r.GetHeight();
+    }
+    benchmark::DoNotOptimize(hits);
+}
+BENCHMARK(BM_BruteForceQuery)->Arg(1000)->Arg(100000);
+
+// Whether the segment from + t * (to - from), 0 <= t <= 1, touches r.
+bool segment_hits(const Rect & r, const Point & from, const Point & to) {
+    double tmin = 0, tmax = 1;
+    auto slab = [&](double p, double d, double lo, double hi) {
+        if (d == 0)
+            return lo <= p && p <= hi;
+        double t1 = (lo - p) / d, t2 = (hi - p) / d;
+        if (t1 > t2) std::swap(t1, t2);
+        tmin = (std::max)(tmin, t1);
+        tmax = (std::min)(tmax, t2);
+        return tmin <= tmax;
+    };
+    return slab(from.x, to.x - from.x, r.GetX(), r.GetX() + r.GetWidth())
+        && slab(from.y, to.y - from.y, r.GetY(), r.GetY() + r.GetHeight());
+}
+
+// 512 pixel rays at random angles; every rect along the ray is reported.
+void BM_AabbTreeRaycast(benchmark::State & state) {
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 4096.0}, angle{0.0, 6.28318530717958647692};
+    AabbTree<int> tree;
+    for (int i = 0; i < state.range(0); ++i)
+        tree.Insert(Rect{position(random), position(random), 16.0, 16.0}, i);
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        Point from{position(random), position(random)};
+        double a = angle(random);
+        tree.Raycast(from, Point{from.x + 512.0 * std::cos(a), from.y + 512.0 * std::sin(a)}, [&](int, int, double max_fraction) {
+            ++hits;
+            return max_fraction;
+        });
+    }
+    benchmark::DoNotOptimize(hits);
+}
+BENCHMARK(BM_AabbTreeRaycast)->Arg(1000)->Arg(100000);
+
+void BM_BruteForceRaycast(benchmark::State & state) {
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 4096.0}, angle{0.0, 6.28318530717958647692};
+    std::vector<Rect> rects;
+    for (int i = 0; i < state.range(0); ++i)
+        rects.emplace_back(position(random), position(random), 16.0, 16.0);
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        Point from{position(random), position(random)};
+        double a = angle(random);
+        Point to{from.x + 512.0 * std::cos(a), from.y + 512.0 * std::sin(a)};
+        for (const Rect & r : rects)
+            hits += segment_hits(r, from, to);
+    }
+    benchmark::DoNotOptimize(hits);
+}
+BENCHMARK(BM_BruteForceRaycast)->Arg(1000)->Arg(100000);
+
+void BM_AabbTreeMove(benchmark::State & state) {
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 4096.0}, step{-2.0, 2.0};
+    AabbTree<int> tree;
+    std::vector<Rect> bounds;
+    std::vector<int> proxies;
+    for (int i = 0; i < state.range(0); ++i) {
+        bounds.emplace_back(position(random), position(random), 16.0, 16.0);
+        proxies.push_back(tree.Insert(bounds.back(), i));
+    }
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < bounds.size(); ++i) {
+            Point delta{step(random), step(random)};
+            bounds[i].SetX(bounds[i].GetX() + delta.x);
+            bounds[i].SetY(bounds[i].GetY() + delta.y);
+            tree.Move(proxies[i], bounds[i], delta);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AabbTreeMove)->Arg(1000)->Arg(10000);
+
+TiledMap make_map(std::size_t size, unsigned solid_one_in) {
+    TiledMap map{size, size, 16.0, 16.0};
+    map.SetTileFlags(0, TiledMap::TILE_SOLID);
+    std::mt19937 random{1};
+    for (std::size_t row = 0; row < size; ++row)
+        for (std::size_t column = 0; column < size; ++column)
+            if (random() % solid_one_in == 0)
+                map.SetGraphIndex(column, row, 0);
+    return map;
+}
+
+// The map size is the argument and the query stays 64x64, so the timing shows how queries scale with the map.
+void BM_TiledMapCheckCollision(benchmark::State & state) {
+    TiledMap map = make_map(static_cast<std::size_t>(state.range(0)), 4);
+    std::mt19937 random{2};
+    std::uniform_real_distribution<double> position{0.0, map.GetWidth() - 64.0};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(map.CheckCollision(Rect{position(random), position(random), 64.0, 64.0}));
+}
+BENCHMARK(BM_TiledMapCheckCollision)->Arg(64)->Arg(256)->Arg(1024);
+
+// Rays are 512 pixels long at a random angle, whatever the map size.
+void BM_TiledMapRaycast(benchmark::State & state) {
+    TiledMap map = make_map(static_cast<std::size_t>(state.range(0)), 64);
+    std::mt19937 random{2};
+    std::uniform_real_distribution<double> position{0.0, map.GetWidth()}, angle{0.0, 6.28318530717958647692};
+    for (auto _ : state) {
+        Point from{position(random), position(random)};
+        double a = angle(random);
+        benchmark::DoNotOptimize(map.Raycast(from, Point{from.x + 512.0 * std::cos(a), from.y + 512.0 * std::sin(a)}));
+    }
+}
+BENCHMARK(BM_TiledMapRaycast)->Arg(64)->Arg(256)->Arg(1024);
+
+void BM_PathFinderAStar(benchmark::State & state) {
+    CollisionGrid grid = make_grid(static_cast<int>(state.range(0)), 0.25);
+    auto queries = make_queries(grid, 64);
+    PathFinder finder{grid};
+    std::vector<Cell> path;
+    std::size_t next = 0, expanded = 0;
+    for (auto _ : state) {
+        auto & query = queries[next++ % queries.size()];
+        finder.FindPath(query.first, query.second, path);
+        expanded += finder.GetExpandedNodeCount();
+    }
+    state.counters["expanded"] = benchmark::Counter(static_cast<double>(expanded), benchmark::Counter::kAvgIterations);
+    state.counters["bytes"] = static_cast<double>(finder.GetMemoryUsage());
+}
+BENCHMARK(BM_PathFinderAStar)->Arg(64)->Arg(256)->Arg(1024);
+
+void BM_PathFinderJump(benchmark::State & state) {
+    CollisionGrid grid = make_grid(static_cast<int>(state.range(0)), 0.25);
+    auto queries = make_queries(grid, 64);
+    PathFinder finder{grid};
+    std::vector<Cell> path;
+    std::size_t next = 0, expanded = 0;
+    for (auto _ : state) {
+        auto & query = queries[next++ % queries.size()];
+        finder.FindJumpPath(query.first, query.second, path);
+        expanded += finder.GetExpandedNodeCount();
+    }
+    state.counters["expanded"] = benchmark::Counter(static_cast<double>(expanded), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PathFinderJump)->Arg(64)->Arg(256)->Arg(1024);
+
+void BM_FlowField(benchmark::State & state) {
+    CollisionGrid grid = make_grid(static_cast<int>(state.range(0)), 0.25);
+    auto queries = make_queries(grid, 64);
+    PathFinder finder{grid};
+    finder.SetFlowFieldCacheSize(1);
+    std::size_t next = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(&finder.GetFlowField(queries[next++ % queries.size()].second));
+}
+BENCHMARK(BM_FlowField)->Arg(64)->Arg(256)->Arg(1024);
+
+// One walkability flip per iteration; the cached field is repaired around it rather than rebuilt.
+void BM_FlowFieldRepair(benchmark::State & state) {
+    int size = static_cast<int>(state.range(0));
+    CollisionGrid grid = make_grid(size, 0.25);
+    Cell target = make_queries(grid, 1)[0].second;
+    PathFinder finder{grid};
+    finder.GetFlowField(target);
+    std::mt19937 random{3};
+    std::uniform_int_distribution<int> cell{0, size - 1};
+    for (auto _ : state) {
+        int x = cell(random), y = cell(random);
+        if (Cell{x, y} != target)
+            grid.SetSolid(x, y, !grid.IsSolid(x, y));
+        benchmark::DoNotOptimize(&finder.GetFlowField(target));
+    }
+}
+BENCHMARK(BM_FlowFieldRepair)->Arg(64)->Arg(256)->Arg(1024);
+
+// The same grids and queries as BM_PathFinderAStar, so latency and bytes compare directly with flat A*.
+void BM_HierarchicalPathFinder(benchmark::State & state) {
+    CollisionGrid grid = make_grid(static_cast<int>(state.range(0)), 0.25);
+    auto queries = make_queries(grid, 64);
+    HierarchicalPathFinder finder{grid};
+    std::vector<Cell> path;
+    std::size_t next = 0;
+    for (auto _ : state) {
+        auto & query = queries[next++ % queries.size()];
+        finder.FindPath(query.first, query.second, path);
+    }
+    state.counters["nodes"] = static_cast<double>(finder.GetAbstractNodeCount());
+    state.counters["bytes"] = static_cast<double>(finder.GetMemoryUsage());
+}
+BENCHMARK(BM_HierarchicalPathFinder)->Arg(64)->Arg(256)->Arg(1024);
+
+void BM_PathQueryService(benchmark::State & state) {
+    CollisionGrid grid = make_grid(256, 0.25);
+    auto queries = make_queries(grid, 256);
+    PathQueryService service{grid, static_cast<std::size_t>(state.range(0))};
+    for (auto _ : state) {
+        for (auto & query : queries)
+            service.Submit(query.first, query.second);
+        service.Dispatch();
+        benchmark::DoNotOptimize(service.Collect().size());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(queries.size()));
+}
+BENCHMARK(BM_PathQueryService)->Arg(1)->Arg(4)->UseRealTime();
+
+}
@@ -0,0 +1,37 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include <benchmark/benchmark.h>
+
+using namespace DxLibPp;
+
+namespace {
+
+void BM_ProfileScope(benchmark::State & state) {
+    Profiler::SetEnabled(state.range(0) != 0);
+    for (auto _ : state) {
+        ProfileScope scope{"benchmark"};
+        benchmark::ClobberMemory();
+        if (Profiler::GetZones().size() > 0)
+            Profiler::Clear();
+    }
+    Profiler::SetEnabled(true);
+    Profiler::Clear();
+}
+BENCHMARK(BM_ProfileScope)->Arg(0)->Arg(1);
+
+// Graph::Draw makes two wrapped DxLib calls, so this shows the per-call cost of frame stats.
+void BM_FrameStats(benchmark::State & state) {
+    Headless::RegisterImage("sprite.png", 32, 32);
+    Graph graph{"sprite.png"};
+    System::SetFrameStatsEnabled(state.range(0) != 0);
+    for (auto _ : state) {
+        for (int i = 0; i < 1000; ++i)
+            graph.Draw();
+        System::Update();
+    }
+    System::SetFrameStatsEnabled(false);
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+BENCHMARK(BM_FrameStats)->Arg(0)->Arg(1);
+
+}
@@ -0,0 +1,146 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace DxLibPp;
+
+namespace {
+
+struct Box {
+    double x1, y1, x2, y2;
+};
+
+Box fat_box(const AabbTree<int> & tree, int proxy) {
+    Rect r = tree.GetFatBounds(proxy);
+    return Box{r.GetX(), r.GetY(), r.GetX() + r.GetWidth(), r.GetY() + r.GetHeight()};
+}
+
+bool overlaps(const Box & a, const Box & b) { return a.x1 <= b.x2 && a.y1 <= b.y2 && b.x1 <= a.x2 && b.y1 <= a.y2; }
+
+// Whether the segment p + t * d, 0 <= t <= 1, touches b.
+bool intersects(const Box & b, double px, double py, double dx, double dy) {
+    double tmin = 0, tmax = 1;
+    auto slab = [&](double p, double d, double lo, double hi) {
+        if (d == 0)
+            return lo <= p && p <= hi;
+        double t1 = (lo - p) / d, t2 = (hi - p) / d;
+        if (t1 > t2) std::swap(t1, t2);
+        tmin = (std::max)(tmin, t1);
+        tmax = (std::min)(tmax, t2);
+        return tmin <= tmax;
+    };
+    return slab(px, dx, b.x1, b.x2) && slab(py, dy, b.y1, b.y2);
+}
+
+// Random inserts, moves and removes; after each round, queries and rays must report exactly the leaves a
+// linear scan over the fattened bounds finds, and the fattened bounds must still cover the exact ones.
+TEST(QueryAndRaycastMatchALinearScan) {
+    AabbTree<int> tree{2.0};
+    std::mt19937 random{1};
+    std::uniform_real_distribution<double> position{0.0, 1000.0}, size{1.0, 40.0}, step{-6.0, 6.0};
+    std::vector<int> proxies;
+    std::vector<Rect> bounds;
+    for (int round = 0; round < 60; ++round) {
+        for (int i = 0; i < 40; ++i) {
+            bounds.emplace_back(position(random), position(random), size(random), size(random));
+            proxies.push_back(tree.Insert(bounds.back(), static_cast<int>(proxies.size())));
+        }
+        for (std::size_t i = 0; i < proxies.size(); ++i) {
+            if (random() % 3 != 0)
+                continue;
+            Point delta{step(random), step(random)};
+            bounds[i].SetX(bounds[i].GetX() + delta.x);
+            bounds[i].SetY(bounds[i].GetY() + delta.y);
+            tree.Move(proxies[i], bounds[i], delta);
+        }
+        for (int i = 0; i < 25 && !proxies.empty(); ++i) {
+            std::size_t victim = random() % proxies.size();
+            tree.Remove(proxies[victim]);
+            proxies[victim] = proxies.back();
+            bounds[victim] = bounds.back();
+            proxies.pop_back();
+            bounds.pop_back();
+        }
+        CHECK_EQ(tree.GetSize(), proxies.size());
+        CHECK(tree.GetHeight() <= 2 * static_cast<int>(std::log2(proxies.size() + 1)) + 2);
+        for (std::size_t i = 0; i < proxies.size(); ++i) {
+            Box fat = fat_box(tree, proxies[i]);
+            const Rect & r = bounds[i];
+            CHECK(fat.x1 <= r.GetX() && fat.y1 <= r.GetY() && r.GetX() + r.GetWidth() <= fat.x2 && r.GetY() + r.GetHeight() <= fat.y2);
+        }
+
+        for (int query = 0; query < 20; ++query) {
+            Rect view{position(random), position(random), 120.0, 90.0};
+            Box box{view.GetX(), view.GetY(), view.GetX() + 120.0, view.GetY() + 90.0};
+            std::vector<int> found, expected;
+            tree.Query(view, [&](int proxy, int) { found.push_back(proxy); return true; });
+            for (int proxy : proxies)
+                if (overlaps(fat_box(tree, proxy), box))
+                    expected.push_back(proxy);
+            std::sort(found.begin(), found.end());
+            std::sort(expected.begin(), expected.end());
+            CHECK(found == expected);
+
+            Point from{position(random), position(random)}, to{position(random), position(random)};
+            found.clear();
+            expected.clear();
+            tree.Raycast(from, to, [&](int proxy, int, double max_fraction) { found.push_back(proxy); return max_fraction; });
+            for (int proxy : proxies)
+                if (intersects(fat_box(tree, proxy), from.x, from.y, to.x - from.x, to.y - from.y))
+                    expected.push_back(proxy);
+            std::sort(found.begin(), found.end());
+            std::sort(expected.begin(), expected.end());
+            CHECK(found == expected);
+        }
+    }
+}
+
+TEST(MoveWithinTheMarginLeavesTheTreeAlone) {
+    AabbTree<int> tree{4.0};
+    int proxy = tree.Insert(Rect{10.0, 10.0, 8.0, 8.0}, 7);
+    CHECK(!tree.Move(proxy, Rect{12.0, 13.0, 8.0, 8.0}));
+    CHECK(tree.Move(proxy, Rect{20.0, 10.0, 8.0, 8.0}, Point{8.0, 0.0}));
+    Rect fat = tree.GetFatBounds(proxy);
+    CHECK_EQ(fat.GetX(), 16.0);
+    CHECK_EQ(fat.GetX() + fat.GetWidth(), 48.0);
+    CHECK_EQ(tree.Get(proxy), 7);
+}
+
+TEST(RemovedProxiesAreRejectedAndReused) {
+    AabbTree<int> tree;
+    int a = tree.Insert(Rect{0.0, 0.0, 1.0, 1.0}, 1);
+    int b = tree.Insert(Rect{5.0, 5.0, 1.0, 1.0}, 2);
+    tree.Remove(a);
+    CHECK_THROWS(tree.Remove(a), std::runtime_error);
+    CHECK_THROWS(tree.Get(a), std::runtime_error);
+    CHECK_THROWS(tree.Move(a, Rect{0.0, 0.0, 1.0, 1.0}), std::runtime_error);
+    CHECK_EQ(tree.Insert(Rect{9.0, 9.0, 1.0, 1.0}, 3), a);
+    CHECK_EQ(tree.Get(b), 2);
+    CHECK_EQ(tree.GetSize(), std::size_t{2});
+}
+
+TEST(RaycastClipsToTheReturnedFraction) {
+    AabbTree<int> tree{0.0};
+    for (int i = 0; i < 10; ++i)
+        tree.Insert(Rect{10.0 + i * 20.0, -5.0, 10.0, 10.0}, i);
+    int nearest = -1;
+    double nearest_fraction = 2.0;
+    tree.Raycast(Point{0.0, 0.0}, Point{250.0, 0.0}, [&](int, int value, double) {
+        double fraction = (10.0 + value * 20.0) / 250.0;
+        if (fraction < nearest_fraction) {
+            nearest_fraction = fraction;
+            nearest = value;
+        }
+        return fraction;
+    });
+    CHECK_EQ(nearest, 0);
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
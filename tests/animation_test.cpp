@@ -0,0 +1,103 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+
+using namespace DxLibPp;
+
+namespace {
+
+struct FrameIterator : Iterator<std::shared_ptr<Animation::frame>>::Implement {
+    explicit FrameIterator(std::vector<std::shared_ptr<Animation::frame>> frames) : frames{std::move(frames)} {}
+    bool HasNext() const override { return next < frames.size(); }
+    std::shared_ptr<Animation::frame> Next() override { return frames.at(next++); }
+    void Remove() override {}
+    std::vector<std::shared_ptr<Animation::frame>> frames;
+    std::size_t next = 0;
+};
+
+// Three 8x8 frames cut from one 8x24 strip, a second each.
+std::shared_ptr<const AnimationClip> make_clip() {
+    Headless::RegisterImage("strip.png", 8, 24);
+    Graph graph{"strip.png"};
+    std::vector<AnimationClip::Frame> frames;
+    for (int i = 0; i < 3; ++i)
+        frames.push_back(AnimationClip::Frame{graph.GetHandle(), 0, i * 8, 8, 8, 1.0});
+    return std::make_shared<const AnimationClip>(std::move(frames), std::vector<Graph>{graph});
+}
+
+TEST(FinishedAnimationResumesWhenSwitchedToLoop) {
+    Animation animation{make_clip(), AnimationMode::ONCE};
+    animation.Advance(5.0);
+    CHECK(animation.IsFinished());
+    CHECK_EQ(animation.GetFrameIndex(), std::size_t{2});
+    animation.SetMode(AnimationMode::LOOP);
+    CHECK(!animation.IsFinished());
+    animation.Advance(1.5);
+    CHECK_EQ(animation.GetFrameIndex(), std::size_t{0});
+}
+
+TEST(FinishedAnimationResumesWhenSwitchedToPingPong) {
+    Animation animation{make_clip(), AnimationMode::ONCE};
+    animation.Advance(5.0);
+    animation.SetMode(AnimationMode::PING_PONG);
+    CHECK(!animation.IsFinished());
+    animation.Advance(1.5);
+    CHECK_EQ(animation.GetFrameIndex(), std::size_t{1});
+    animation.SetMode(AnimationMode::ONCE);
+    CHECK(!animation.IsFinished());
+}
+
+TEST(FinishedBatchCursorResumesWhenSwitchedToLoop) {
+    AnimationBatch batch;
+    std::size_t once = batch.Add(make_clip(), AnimationMode::ONCE);
+    std::size_t loop = batch.Add(make_clip(), AnimationMode::LOOP);
+    batch.Update(5.0);
+    CHECK(batch.IsFinished(once));
+    CHECK(!batch.IsFinished(loop));
+    batch.SetMode(once, AnimationMode::LOOP);
+    CHECK(!batch.IsFinished(once));
+    batch.Update(1.5);
+    CHECK_EQ(batch.GetFrameIndex(once), std::size_t{0});
+    CHECK(!batch.GetEvents().empty());
+}
+
+// Legacy callers placed an animation by placing the graphs it was built from.
+TEST(IteratorAnimationStartsWhereTheFirstGraphIs) {
+    Headless::RegisterImage("frame.png", 8, 8);
+    auto first = std::make_shared<Graph>("frame.png"), second = std::make_shared<Graph>("frame.png");
+    first->SetX(100.0);
+    first->SetY(50.0);
+    first->SetTheta(0.5);
+    std::vector<std::shared_ptr<Animation::frame>> frames{
+        std::make_shared<Animation::frame>(first, 0), std::make_shared<Animation::frame>(second, 0)};
+    Animation animation{std::make_shared<Iterator<std::shared_ptr<Animation::frame>>>(std::make_shared<FrameIterator>(frames))};
+    CHECK_EQ(animation.GetX(), 100.0);
+    CHECK_EQ(animation.GetY(), 50.0);
+    CHECK_EQ(animation.GetTheta(), 0.5);
+    CHECK_EQ(animation.GetWidth(), 8.0);
+
+    first->SetWidth(16.0);
+    first->SetHeight(24.0);
+    Animation scaled{std::make_shared<Iterator<std::shared_ptr<Animation::frame>>>(std::make_shared<FrameIterator>(frames))};
+    CHECK_EQ(scaled.GetWidth(), 16.0);
+    CHECK_EQ(scaled.GetHeight(), 24.0);
+
+#if defined(__GNUC__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+    std::shared_ptr<Graph> current = scaled.GetCurrentGraph();
+#if defined(__GNUC__)
+#    pragma GCC diagnostic pop
+#endif
+    CHECK(current != nullptr);
+    CHECK_EQ(current->GetX(), 100.0);
+    CHECK_EQ(current->GetWidth(), 16.0);
+    CHECK_EQ(current->GetHeight(), 24.0);
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,204 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <random>
+
+using namespace DxLibPp;
+
+namespace {
+
+std::vector<int> drawn;
+
+struct Mark : Drawable {
+    explicit Mark(int tag) : tag{tag} {}
+    virtual void Draw() const override { drawn.push_back(tag); }
+    int tag;
+};
+
+std::vector<int> draw(LayeredDrawList & list) {
+    drawn.clear();
+    list.Draw();
+    return drawn;
+}
+
+TEST(LayeredDrawListOrdersByLayerThenZ) {
+    Mark a{0}, b{1}, c{2}, d{3};
+    LayeredDrawList list;
+    list.Add(a, 1, 0.0);
+    list.Add(b, 0, 5.0);
+    list.Add(c, 0, -1.0);
+    list.Add(d, 1, -2.0);
+    CHECK(draw(list) == (std::vector<int>{2, 1, 3, 0}));
+    CHECK_EQ(list.GetMovedCount(), std::size_t{4});
+    CHECK(draw(list) == (std::vector<int>{2, 1, 3, 0}));
+    CHECK_EQ(list.GetMovedCount(), std::size_t{0});
+}
+
+TEST(LayeredDrawListAddRemoveAndReAddInOneFrame) {
+    Mark a{0}, b{1}, c{2}, d{3};
+    LayeredDrawList list;
+    std::size_t ia = list.Add(a, 0, 1.0), ib = list.Add(b, 0, 2.0);
+    list.Add(c, 0, 3.0);
+    draw(list);
+    list.Remove(ib);
+    std::size_t id = list.Add(d, 0, 0.0);
+    CHECK_EQ(id, ib);
+    list.Remove(ia);
+    ia = list.Add(a, 0, 2.5);
+    CHECK_EQ(list.GetSize(), std::size_t{3});
+    CHECK(draw(list) == (std::vector<int>{3, 0, 2}));
+    list.Remove(id);
+    list.Remove(ia);
+    std::size_t ib2 = list.Add(b, 1, 0.0);
+    CHECK(draw(list) == (std::vector<int>{2, 1}));
+    CHECK_EQ(&list.Get(ib2), static_cast<const Drawable *>(&b));
+}
+
+TEST(LayeredDrawListSetLayerThenSetZ) {
+    Mark a{0}, b{1}, c{2};
+    LayeredDrawList list;
+    std::size_t ia = list.Add(a, 0, 0.0);
+    list.Add(b, 1, 1.0);
+    list.Add(c, 1, 2.0);
+    draw(list);
+    list.SetLayer(ia, 1);
+    list.SetZ(ia, 1.5);
+    CHECK(draw(list) == (std::vector<int>{1, 0, 2}));
+    CHECK_EQ(list.GetMovedCount(), std::size_t{1});
+    CHECK(list.GetOrder(0).empty());
+    list.SetZ(ia, 9.0);
+    list.SetLayer(ia, 0);
+    CHECK(draw(list) == (std::vector<int>{0, 1, 2}));
+}
+
+TEST(LayeredDrawListSkipsDisabledLayers) {
+    Mark a{0}, b{1}, c{2};
+    LayeredDrawList list;
+    list.Add(a, 0, 0.0);
+    std::size_t ib = list.Add(b, 2, 0.0);
+    list.Add(c, 2, 1.0);
+    list.SetLayerEnabled(2, false);
+    CHECK(draw(list) == (std::vector<int>{0}));
+    list.SetZ(ib, 2.0);
+    draw(list);
+    CHECK(list.GetOrder(2) == (std::vector<std::uint32_t>{2, 1}));
+    list.SetLayerEnabled(2, true);
+    CHECK(draw(list) == (std::vector<int>{0, 2, 1}));
+}
+
+TEST(LayeredDrawListRejectsIdsThatAreNotLive) {
+    Mark a{0}, b{1}, c{2};
+    LayeredDrawList list;
+    std::size_t ia = list.Add(a);
+    list.Remove(ia);
+    CHECK_THROWS(list.Remove(ia), std::runtime_error);
+    CHECK_THROWS(list.SetZ(ia, 1.0), std::runtime_error);
+    CHECK_THROWS(list.SetLayer(ia, 1), std::runtime_error);
+    CHECK_THROWS(list.Get(ia), std::runtime_error);
+    CHECK_THROWS(list.Get(42), std::runtime_error);
+    CHECK_EQ(list.GetSize(), std::size_t{0});
+    std::size_t ib = list.Add(b), ic = list.Add(c);
+    CHECK(ib != ic);
+    CHECK(draw(list) == (std::vector<int>{1, 2}));
+}
+
+// Random edits spread over frames must leave every layer in the order a full sort would give.
+TEST(LayeredDrawListMatchesAFullSort) {
+    std::vector<Mark> marks;
+    for (int i = 0; i < 200; ++i)
+        marks.emplace_back(i);
+    LayeredDrawList list;
+    std::vector<std::size_t> ids(marks.size(), static_cast<std::size_t>(-1));
+    std::mt19937 random{1};
+    std::uniform_int_distribution<int> pick{0, 199}, layer{0, 3}, z{0, 20}, action{0, 3};
+    for (int frame = 0; frame < 100; ++frame) {
+        for (int edit = 0; edit < 30; ++edit) {
+            int m = pick(random);
+            bool live = ids[m] != static_cast<std::size_t>(-1);
+            switch (live ? action(random) : 0) {
+            case 0:
+                if (live)
+                    list.Remove(ids[m]);
+                ids[m] = list.Add(marks[m], static_cast<std::uint8_t>(layer(random)), z(random));
+                break;
+            case 1: list.Remove(ids[m]); ids[m] = static_cast<std::size_t>(-1); break;
+            case 2: list.SetLayer(ids[m], static_cast<std::uint8_t>(layer(random))); break;
+            default: list.SetZ(ids[m], z(random)); break;
+            }
+        }
+        list.Refresh();
+        for (int l = 0; l < 4; ++l) {
+            std::vector<std::uint32_t> expected;
+            for (std::size_t m = 0; m < ids.size(); ++m)
+                if (ids[m] != static_cast<std::size_t>(-1) && list.GetLayer(ids[m]) == l)
+                    expected.push_back(static_cast<std::uint32_t>(ids[m]));
+            std::sort(expected.begin(), expected.end(), [&](std::uint32_t a, std::uint32_t b) {
+                return list.GetZ(a) < list.GetZ(b) || (list.GetZ(a) == list.GetZ(b) && a < b);
+            });
+            CHECK(list.GetOrder(static_cast<std::uint8_t>(l)) == expected);
+        }
+    }
+}
+
+// Records DrawRectGraph at (x, 0) so that the headless command log shows the replay order by x.
+void record(DrawCommandBuffer & buffer, std::uint8_t layer, BlendMode blend, int handle, std::uint32_t depth, int x) {
+    buffer.SetLayer(layer);
+    buffer.SetBlendMode(blend, blend == BlendMode::NOBLEND ? 255 : 128);
+    buffer.SetDepth(depth);
+    buffer.DrawRectGraph(x, 0.0, 0, 0, 4, 4, handle);
+}
+
+TEST(DrawCommandBufferSortsByLayerStateTextureThenDepth) {
+    Headless::RegisterImage("a.png", 4, 4);
+    Headless::RegisterImage("b.png", 4, 4);
+    Graph a{"a.png"}, b{"b.png"};
+    CHECK(a.GetHandle() < b.GetHandle());
+    DrawCommandBuffer buffer;
+    record(buffer, 1, BlendMode::NOBLEND, a.GetHandle(), 0, 1);
+    record(buffer, 0, BlendMode::ALPHA, b.GetHandle(), 0, 2);
+    record(buffer, 0, BlendMode::NOBLEND, b.GetHandle(), 5, 3);
+    record(buffer, 0, BlendMode::NOBLEND, a.GetHandle(), 0, 4);
+    record(buffer, 0, BlendMode::NOBLEND, b.GetHandle(), 1, 5);
+    record(buffer, 0, BlendMode::ALPHA, a.GetHandle(), 0, 6);
+    ClearDrawScreen();
+    buffer.Flush();
+
+    const auto & commands = Headless::GetCommands();
+    std::vector<int> xs;
+    for (const auto & command : commands)
+        xs.push_back(command.x);
+    CHECK(xs == (std::vector<int>{4, 5, 3, 6, 2, 1}));
+    CHECK_EQ(commands[3].blend_mode, DX_BLENDMODE_ALPHA);
+    CHECK_EQ(commands[3].blend_param, 128);
+    CHECK_EQ(commands[5].blend_mode, DX_BLENDMODE_NOBLEND);
+
+    // Blend, draw mode and area are set by the first command; after that only the two blend switches are issued.
+    const auto & stats = buffer.GetStats();
+    CHECK_EQ(stats.commands, std::size_t{6});
+    CHECK_EQ(stats.state_changes, std::size_t{5});
+    CHECK_EQ(stats.elided, std::size_t{13});
+}
+
+TEST(DrawCommandBufferRestoresDefaultsOutsideItsStats) {
+    Headless::RegisterImage("a.png", 4, 4);
+    Graph a{"a.png"};
+    DrawCommandBuffer buffer;
+    record(buffer, 0, BlendMode::ADD, a.GetHandle(), 0, 1);
+    record(buffer, 0, BlendMode::ADD, a.GetHandle(), 0, 2);
+    ClearDrawScreen();
+    buffer.Flush();
+    CHECK_EQ(buffer.GetStats().state_changes, std::size_t{3});
+    CHECK_EQ(buffer.GetStats().elided, std::size_t{3});
+    a.Draw();
+    const auto & commands = Headless::GetCommands();
+    CHECK_EQ(commands.size(), std::size_t{3});
+    CHECK_EQ(commands[1].blend_mode, DX_BLENDMODE_ADD);
+    CHECK_EQ(commands[2].blend_mode, DX_BLENDMODE_NOBLEND);
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,207 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+
+using namespace DxLibPp;
+
+namespace {
+
+constexpr std::uint32_t BLACK = 0xff000000u;
+constexpr std::uint32_t RED = 0xffff0000u;
+constexpr std::uint32_t GREEN = 0xff00ff00u;
+constexpr std::uint32_t BLUE = 0xff0000ffu;
+constexpr std::uint32_t WHITE = 0xffffffffu;
+
+// A 4x4 image split into 2x2 quadrants: red, green / blue, white.
+void register_quadrants(const char * path) {
+    std::vector<std::uint32_t> pixels(16);
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x)
+            pixels[y * 4 + x] = y < 2 ? (x < 2 ? RED : GREEN) : (x < 2 ? BLUE : WHITE);
+    Headless::RegisterImage(path, 4, 4, pixels);
+}
+
+bool is_loaded(int handle) {
+    int width{}, height{};
+    return GetGraphSize(handle, &width, &height) == 0;
+}
+
+// Rasterizes onto a 64x64 screen with the quadrant image loaded, and restores the defaults afterwards.
+struct Rasterizer {
+    Rasterizer() {
+        Headless::SetScreenSize(64, 64);
+        Headless::SetRasterizerEnabled(true);
+        ClearDrawScreen();
+        register_quadrants("quadrants.png");
+        handle = LoadGraph("quadrants.png");
+    }
+    ~Rasterizer() {
+        DeleteGraph(handle);
+        Headless::SetRasterizerEnabled(false);
+        Headless::SetScreenSize(640, 480);
+    }
+    std::uint32_t pixel(int x, int y) const { return Headless::GetFramebuffer().GetPixel(x, y); }
+    int handle{-1};
+};
+
+TEST(DrawRotaGraph3PlacesTheCenterOnTheDestination) {
+    Rasterizer r;
+    DrawRotaGraph3(10, 10, 2, 2, 1.0, 1.0, 0.0, r.handle, TRUE);
+    CHECK_EQ(r.pixel(8, 8), RED);
+    CHECK_EQ(r.pixel(11, 8), GREEN);
+    CHECK_EQ(r.pixel(8, 11), BLUE);
+    CHECK_EQ(r.pixel(11, 11), WHITE);
+    CHECK_EQ(r.pixel(7, 7), BLACK);
+    CHECK_EQ(r.pixel(12, 12), BLACK);
+}
+
+TEST(DrawRotaGraph3Scales) {
+    Rasterizer r;
+    DrawRotaGraph3(10, 10, 2, 2, 2.0, 2.0, 0.0, r.handle, TRUE);
+    CHECK_EQ(r.pixel(6, 6), RED);
+    CHECK_EQ(r.pixel(9, 9), RED);
+    CHECK_EQ(r.pixel(13, 13), WHITE);
+    CHECK_EQ(r.pixel(5, 5), BLACK);
+    CHECK_EQ(r.pixel(14, 14), BLACK);
+}
+
+TEST(DrawRotaGraph3RotatesClockwise) {
+    Rasterizer r;
+    DrawRotaGraph3(10, 10, 2, 2, 1.0, 1.0, 3.14159265358979323846 / 2, r.handle, TRUE);
+    CHECK_EQ(r.pixel(11, 8), RED);
+    CHECK_EQ(r.pixel(11, 11), GREEN);
+    CHECK_EQ(r.pixel(8, 8), BLUE);
+    CHECK_EQ(r.pixel(8, 11), WHITE);
+}
+
+TEST(DrawRectRotaGraph3SamplesOnlyTheSourceRectangle) {
+    Rasterizer r;
+    DrawRectRotaGraph3(20, 20, 2, 0, 2, 2, 0, 0, 1.0, 1.0, 0.0, r.handle, TRUE);
+    CHECK_EQ(r.pixel(20, 20), GREEN);
+    CHECK_EQ(r.pixel(21, 21), GREEN);
+    CHECK_EQ(r.pixel(22, 20), BLACK);
+    CHECK_EQ(r.pixel(20, 22), BLACK);
+    CHECK_EQ(r.pixel(19, 19), BLACK);
+}
+
+TEST(DrawPrimitive2DFillsAndBlendsTriangles) {
+    Rasterizer r;
+    COLOR_U8 opaque{255, 0, 0, 255}, half{0, 0, 255, 128}; // b, g, r, a: opaque blue, half-transparent red
+    auto quad = [](float left, float top, float size, COLOR_U8 color, VERTEX2D * out) {
+        VECTOR a{left, top, 0.0f}, b{left + size, top, 0.0f}, c{left, top + size, 0.0f}, d{left + size, top + size, 0.0f};
+        VECTOR corners[] = {a, b, c, b, d, c};
+        for (int i = 0; i < 6; ++i)
+            out[i] = VERTEX2D{corners[i], 1.0f, color, 0.0f, 0.0f};
+    };
+    VERTEX2D vertices[12];
+    quad(30.0f, 30.0f, 4.0f, opaque, vertices);
+    quad(40.0f, 30.0f, 4.0f, half, vertices + 6);
+    CHECK_EQ(DrawPrimitive2D(vertices, 12, DX_PRIMTYPE_TRIANGLELIST, DX_NONE_GRAPH, TRUE), 0);
+    CHECK_EQ(r.pixel(30, 30), BLUE);
+    CHECK_EQ(r.pixel(33, 33), BLUE);
+    CHECK_EQ(r.pixel(34, 30), BLACK);
+    CHECK_EQ(r.pixel(29, 30), BLACK);
+    CHECK_EQ(r.pixel(41, 31), 0xff800000u);
+}
+
+TEST(ScreenFlipPresentsTheBackBuffer) {
+    Rasterizer r;
+    DrawRotaGraph3(10, 10, 2, 2, 1.0, 1.0, 0.0, r.handle, TRUE);
+    ScreenFlip();
+    ClearDrawScreen();
+    CHECK_EQ(Headless::GetPresentedFramebuffer().GetPixel(8, 8), RED);
+    CHECK_EQ(r.pixel(8, 8), BLACK);
+}
+
+TEST(DeleteGraphReleasesOnlyItsHandle) {
+    register_quadrants("quadrants.png");
+    int a = LoadGraph("quadrants.png"), b = LoadGraph("quadrants.png");
+    CHECK_EQ(DeleteGraph(a), 0);
+    CHECK(!is_loaded(a));
+    CHECK(is_loaded(b));
+    CHECK_EQ(DeleteGraph(a), -1);
+    DeleteGraph(b);
+}
+
+TEST(DeleteSharingGraphReleasesTheWholeDivision) {
+    register_quadrants("quadrants.png");
+    int single = LoadGraph("quadrants.png");
+    int handles[4];
+    CHECK_EQ(LoadDivGraph("quadrants.png", 4, 2, 2, 2, 2, handles), 0);
+    int after = LoadGraph("quadrants.png");
+    CHECK_EQ(DeleteSharingGraph(handles[2]), 0);
+    for (int handle : handles)
+        CHECK(!is_loaded(handle));
+    CHECK(is_loaded(single));
+    CHECK(is_loaded(after));
+    DeleteGraph(single);
+    DeleteGraph(after);
+}
+
+// Released handles at the end of the table are reused, which must not split a division into groups.
+TEST(DeleteSharingGraphAfterHandlesWereReused) {
+    register_quadrants("quadrants.png");
+    int kept = LoadGraph("quadrants.png");
+    int first = LoadGraph("quadrants.png"), second = LoadGraph("quadrants.png");
+    DeleteGraph(second);
+    DeleteGraph(first);
+    int handles[4];
+    CHECK_EQ(LoadDivGraph("quadrants.png", 4, 2, 2, 2, 2, handles), 0);
+    CHECK_EQ(handles[0], first);
+    CHECK_EQ(DeleteSharingGraph(handles[0]), 0);
+    for (int handle : handles)
+        CHECK(!is_loaded(handle));
+    CHECK(is_loaded(kept));
+
+    int reused = LoadGraph("quadrants.png");
+    CHECK_EQ(LoadDivGraph("quadrants.png", 4, 2, 2, 2, 2, handles), 0);
+    CHECK_EQ(DeleteSharingGraph(handles[0]), 0);
+    CHECK(is_loaded(reused));
+    DeleteGraph(reused);
+    DeleteGraph(kept);
+}
+
+TEST(GraphCopiesShareTheirHandle) {
+    register_quadrants("quadrants.png");
+    int handle;
+    {
+        Graph graph{"quadrants.png"};
+        handle = graph.GetHandle();
+        {
+            Graph copy = graph;
+            CHECK_EQ(copy.GetHandle(), handle);
+        }
+        CHECK(is_loaded(handle));
+    }
+    CHECK(!is_loaded(handle));
+}
+
+TEST(SpriteSheetReleasesItsGraphWithTheLastCopy) {
+    register_quadrants("quadrants.png");
+    int handle;
+    {
+        SpriteSheet sheet{"quadrants.png", 4, 2, 2, 2, 2};
+        handle = sheet.GetHandle();
+        {
+            SpriteSheet copy = sheet;
+        }
+        CHECK(is_loaded(handle));
+    }
+    CHECK(!is_loaded(handle));
+}
+
+TEST(SpriteSheetRejectsCellsPastItsNumber) {
+    register_quadrants("quadrants.png");
+    SpriteSheet sheet{"quadrants.png", 3, 2, 2, 2, 2};
+    CHECK_EQ(sheet.GetCell(2).y, 2);
+    CHECK_THROWS(sheet.GetCell(3), std::out_of_range);
+    CHECK_THROWS(sheet.Draw(3, 0.0, 0.0), std::out_of_range);
+    DrawCommandBuffer buffer;
+    CHECK_THROWS(sheet.Submit(buffer, 4, 0.0, 0.0), std::out_of_range);
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
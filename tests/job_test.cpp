@@ -0,0 +1,210 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+#include <numeric>
+#include <stdexcept>
+
+using namespace DxLibPp;
+
+namespace {
+
+struct Mover : Object {
+    explicit Mover(bool thread_safe = true) : thread_safe{thread_safe} {}
+    void Update() override {
+        ++updates;
+        thread = std::this_thread::get_id();
+    }
+    bool IsThreadSafe() const override { return thread_safe; }
+    double GetX() const override { return x; }
+    double GetY() const override { return 0.0; }
+    void SetX(double x) override { this->x = x; }
+    void SetY(double) override {}
+    double GetWidth() const override { return 1.0; }
+    double GetHeight() const override { return 1.0; }
+    void SetWidth(double) override {}
+    void SetHeight(double) override {}
+    double GetTheta() const override { return 0.0; }
+    void SetTheta(double) override {}
+
+    bool thread_safe;
+    double x{};
+    int updates{};
+    std::thread::id thread;
+};
+
+const std::size_t thread_counts[] = {0, 1, 3};
+
+TEST(ParallelForSums) {
+    for (std::size_t threads : thread_counts) {
+        JobSystem jobs{threads};
+        std::vector<std::uint64_t> values(100000);
+        std::iota(values.begin(), values.end(), std::uint64_t{1});
+        std::atomic<std::uint64_t> sum{};
+        jobs.ParallelFor(0, values.size(), [&](std::size_t first, std::size_t last) {
+            std::uint64_t partial = 0;
+            for (std::size_t i = first; i < last; ++i)
+                partial += values[i];
+            sum += partial;
+        }, 1000);
+        CHECK_EQ(sum.load(), std::uint64_t{100000} * 100001 / 2);
+    }
+}
+
+TEST(ParallelForVisitsEveryIndexOnce) {
+    JobSystem jobs{3};
+    std::vector<std::atomic<int>> visits(10007);
+    jobs.ParallelFor(0, visits.size(), [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            ++visits[i];
+    });
+    bool once = true;
+    for (auto & visit : visits)
+        once = once && visit.load() == 1;
+    CHECK(once);
+}
+
+TEST(RunAfterWaitsForTheWholeDependency) {
+    JobSystem jobs{3};
+    for (int round = 0; round < 100; ++round) {
+        JobCounter first, second;
+        std::atomic<int> done{};
+        std::atomic<bool> early{};
+        for (int i = 0; i < 16; ++i)
+            jobs.Run([&] { ++done; }, &first);
+        jobs.RunAfter(first, [&] { early = early || done.load() != 16; }, &second);
+        jobs.Wait(second);
+        CHECK(!early.load());
+    }
+}
+
+TEST(RunAfterChainsRunInOrder) {
+    JobSystem jobs{3};
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::unique_ptr<JobCounter>> counters;
+    counters.push_back(std::make_unique<JobCounter>());
+    jobs.Run([&] { std::lock_guard<std::mutex> lock{mutex}; order.push_back(0); }, counters.back().get());
+    for (int i = 1; i < 50; ++i) {
+        counters.push_back(std::make_unique<JobCounter>());
+        jobs.RunAfter(*counters[counters.size() - 2], [&, i] { std::lock_guard<std::mutex> lock{mutex}; order.push_back(i); }, counters.back().get());
+    }
+    jobs.Wait(*counters.back());
+    std::vector<int> expected(50);
+    std::iota(expected.begin(), expected.end(), 0);
+    CHECK(order == expected);
+}
+
+TEST(RunAfterADoneCounterRunsAtOnce) {
+    JobSystem jobs{1};
+    JobCounter done, counter;
+    std::atomic<bool> ran{};
+    jobs.RunAfter(done, [&] { ran = true; }, &counter);
+    jobs.Wait(counter);
+    CHECK(ran.load());
+}
+
+TEST(NestedParallelFor) {
+    for (std::size_t threads : thread_counts) {
+        JobSystem jobs{threads};
+        std::atomic<std::size_t> count{};
+        jobs.ParallelFor(0, 32, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i)
+                jobs.ParallelFor(0, 1000, [&](std::size_t inner_first, std::size_t inner_last) {
+                    count += inner_last - inner_first;
+                }, 100);
+        }, 1);
+        CHECK_EQ(count.load(), std::size_t{32000});
+    }
+}
+
+TEST(WaitRethrowsTheCountersException) {
+    JobSystem jobs{3};
+    JobCounter counter;
+    std::atomic<int> ran{};
+    for (int i = 0; i < 8; ++i)
+        jobs.Run([&, i] {
+            ++ran;
+            if (i == 3)
+                throw std::runtime_error("job failed");
+        }, &counter);
+    CHECK_THROWS(jobs.Wait(counter), std::runtime_error);
+    CHECK_EQ(ran.load(), 8);
+    // Rethrown once only.
+    jobs.Wait(counter);
+}
+
+TEST(ExceptionsStayWithTheirCounter) {
+    JobSystem jobs{3};
+    JobCounter failing, passing;
+    jobs.Run([] { throw std::runtime_error("job failed"); }, &failing);
+    for (int i = 0; i < 8; ++i)
+        jobs.Run([] {}, &passing);
+    while (!failing.IsDone())
+        std::this_thread::yield();
+    jobs.Wait(passing);
+    CHECK_THROWS(jobs.Wait(failing), std::runtime_error);
+}
+
+TEST(ParallelForRethrows) {
+    JobSystem jobs{3};
+    CHECK_THROWS(jobs.ParallelFor(0, 1000, [](std::size_t first, std::size_t) {
+        if (first == 500)
+            throw std::logic_error("range failed");
+    }, 100), std::logic_error);
+    std::atomic<int> count{};
+    jobs.ParallelFor(0, 1000, [&](std::size_t first, std::size_t last) { count += static_cast<int>(last - first); }, 100);
+    CHECK_EQ(count.load(), 1000);
+}
+
+TEST(GlobalUpdateRunsUnsafeObjectsOnTheCallingThread) {
+    JobSystem jobs{3};
+    for (int i = 0; i < 5000; ++i)
+        Global::Create<Mover>(i % 5 != 0);
+    Global::Update<Mover>(jobs);
+    bool once = true, unsafe_here = true;
+    for (auto & mover : Global::list<Mover>()) {
+        once = once && mover->updates == 1;
+        if (!mover->thread_safe)
+            unsafe_here = unsafe_here && mover->thread == std::this_thread::get_id();
+    }
+    CHECK(once);
+    CHECK(unsafe_here);
+    Global::list<Mover>().clear();
+}
+
+TEST(PrepareDrawListKeepsListOrder) {
+    JobSystem jobs{3};
+    for (int i = 0; i < 5000; ++i)
+        Global::Create<Mover>()->SetX(i);
+    std::vector<const Mover *> drawables;
+    Global::PrepareDrawList<Mover>(jobs, drawables, [](const Mover & mover) { return static_cast<int>(mover.GetX()) % 3 == 0; });
+    bool ordered = drawables.size() == 1667;
+    for (std::size_t i = 0; ordered && i < drawables.size(); ++i)
+        ordered = drawables[i]->GetX() == static_cast<double>(i * 3);
+    CHECK(ordered);
+    Global::list<Mover>().clear();
+}
+
+TEST(ThreadDrawCommandBuffersMergeEveryThread) {
+    JobSystem jobs{3};
+    Headless::RegisterImage("sprite.png", 8, 8);
+    std::vector<Graph> graphs(4000, Graph{"sprite.png"});
+    ThreadDrawCommandBuffers buffers{jobs};
+    jobs.ParallelFor(0, graphs.size(), [&](std::size_t first, std::size_t last) {
+        DrawCommandBuffer & buffer = buffers.GetLocal();
+        for (std::size_t i = first; i < last; ++i)
+            graphs[i].Submit(buffer);
+    }, 100);
+    CHECK_EQ(buffers.GetSize(), graphs.size());
+    buffers.Flush();
+    CHECK_EQ(buffers.GetStats().commands, graphs.size());
+    CHECK_EQ(buffers.GetSize(), std::size_t{0});
+    CHECK_EQ(Headless::GetCommands().size(), graphs.size());
+    ClearDrawScreen();
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
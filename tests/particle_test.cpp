@@ -0,0 +1,83 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+
+using namespace DxLibPp;
+
+namespace {
+
+ParticleEmitter make_emitter() {
+    ParticleEmitter emitter;
+    emitter.life_min = 0.5;
+    emitter.life_max = 1.0;
+    emitter.speed_min = 10.0;
+    emitter.speed_max = 50.0;
+    emitter.spread = 3.14159265358979323846;
+    return emitter;
+}
+
+TEST(EmptyPoolUpdatesAndDraws) {
+    ParticleSystem particles{0};
+    ParticleEmitter emitter = make_emitter();
+    emitter.rate = 100.0;
+    particles.AddEmitter(emitter);
+    CHECK_EQ(particles.Emit(emitter, 10), std::size_t{0});
+    particles.Update(1.0 / 60.0);
+    particles.Draw();
+    CHECK_EQ(particles.GetCount(), std::size_t{0});
+    CHECK(particles.GetDroppedCount() > 0);
+}
+
+TEST(EmitStopsAtCapacity) {
+    ParticleSystem particles{100};
+    CHECK_EQ(particles.Emit(make_emitter(), 150), std::size_t{100});
+    CHECK_EQ(particles.GetCount(), std::size_t{100});
+    CHECK_EQ(particles.GetDroppedCount(), std::uint64_t{50});
+}
+
+TEST(ParticlesRetireAfterTheirLife) {
+    ParticleSystem particles{ParticleSystem::CHUNK_SIZE * 3};
+    particles.Emit(make_emitter(), ParticleSystem::CHUNK_SIZE * 2 + 100);
+    particles.Update(0.75);
+    std::size_t midway = particles.GetCount();
+    CHECK(midway > 0 && midway < ParticleSystem::CHUNK_SIZE * 2 + 100);
+    particles.Update(0.3);
+    CHECK_EQ(particles.GetCount(), std::size_t{0});
+    particles.Update(0.1);
+}
+
+TEST(ResultsDoNotDependOnTheThreadCount) {
+    std::size_t counts[2]{};
+    const std::size_t threads[] = {1, 3};
+    for (int i = 0; i < 2; ++i) {
+        ParticleSystem particles{ParticleSystem::CHUNK_SIZE * 4, threads[i]};
+        particles.SetSeed(42);
+        particles.Emit(make_emitter(), ParticleSystem::CHUNK_SIZE * 3);
+        for (int step = 0; step < 50; ++step)
+            particles.Update(1.0 / 60.0);
+        counts[i] = particles.GetCount();
+    }
+    CHECK_EQ(counts[0], counts[1]);
+}
+
+TEST(JobSystemResultsMatchOneThread) {
+    JobSystem jobs{3};
+    ParticleSystem shared{ParticleSystem::CHUNK_SIZE * 4, jobs}, single{ParticleSystem::CHUNK_SIZE * 4};
+    CHECK_EQ(shared.GetThreadCount(), std::size_t{4});
+    for (ParticleSystem * particles : {&shared, &single}) {
+        particles->SetSeed(42);
+        particles->Emit(make_emitter(), ParticleSystem::CHUNK_SIZE * 3);
+        for (int step = 0; step < 50; ++step)
+            particles->Update(1.0 / 60.0);
+    }
+    CHECK_EQ(shared.GetCount(), single.GetCount());
+    ClearDrawScreen();
+    shared.Draw();
+    CHECK_EQ(Headless::GetCommands().size(), std::size_t{1});
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,189 @@
+#include "DxLibPp.hpp"
+#include "Headless.hpp"
+#include "test.hpp"
+#include <cmath>
+#include <random>
+
+using namespace DxLibPp;
+
+namespace {
+
+CollisionGrid make_grid(int size, double density, unsigned seed) {
+    CollisionGrid grid{size, size};
+    std::mt19937 random{seed};
+    std::bernoulli_distribution solid{density};
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            grid.SetSolid(x, y, solid(random));
+    return grid;
+}
+
+// A repaired field must match a freshly built one in cost, and each direction must step to a walkable
+// neighbour whose cost is lower by exactly the step length.
+bool matches_fresh_field(const CollisionGrid & grid, const FlowField & field) {
+    PathFinder fresh_finder{grid};
+    const FlowField & fresh = fresh_finder.GetFlowField(field.GetTarget());
+    for (int y = 0; y < grid.GetHeight(); ++y) {
+        for (int x = 0; x < grid.GetWidth(); ++x) {
+            Cell cell{x, y};
+            if (field.IsReachable(cell) != fresh.IsReachable(cell))
+                return false;
+            if (!field.IsReachable(cell))
+                continue;
+            if (std::abs(field.GetCost(cell) - fresh.GetCost(cell)) > 1e-3f)
+                return false;
+            if (cell == field.GetTarget())
+                continue;
+            Cell next = field.GetNext(cell);
+            float step = next.x != x && next.y != y ? 1.41421356f : 1.0f;
+            if (grid.IsSolid(next.x, next.y) || (next.x != x && next.y != y && (grid.IsSolid(next.x, y) || grid.IsSolid(x, next.y))))
+                return false;
+            if (std::abs(field.GetCost(next) + step - field.GetCost(cell)) > 1e-3f)
+                return false;
+        }
+    }
+    return true;
+}
+
+Cell open_cell(const CollisionGrid & grid, std::mt19937 & random) {
+    std::uniform_int_distribution<int> column{0, grid.GetWidth() - 1}, row{0, grid.GetHeight() - 1};
+    Cell cell;
+    do cell = Cell{column(random), row(random)}; while (grid.IsSolid(cell.x, cell.y));
+    return cell;
+}
+
+TEST(FlowFieldIsRepairedAfterFlips) {
+    CollisionGrid grid = make_grid(48, 0.25, 1);
+    std::mt19937 random{2};
+    PathFinder finder{grid};
+    Cell target = open_cell(grid, random);
+    finder.GetFlowField(target);
+    std::uniform_int_distribution<int> cell{0, 47}, flips{1, 8};
+    for (int round = 0; round < 200; ++round) {
+        for (int i = flips(random); i > 0; --i) {
+            int x = cell(random), y = cell(random);
+            if (Cell{x, y} != target)
+                grid.SetSolid(x, y, !grid.IsSolid(x, y));
+        }
+        const FlowField & field = finder.GetFlowField(target);
+        CHECK_EQ(field.GetRevision(), grid.GetRevision());
+        CHECK(matches_fresh_field(grid, field));
+    }
+}
+
+TEST(FlowFieldIsRebuiltWhenTheTargetFlips) {
+    CollisionGrid grid = make_grid(32, 0.2, 3);
+    std::mt19937 random{4};
+    PathFinder finder{grid};
+    Cell target = open_cell(grid, random);
+    finder.GetFlowField(target);
+    grid.SetSolid(target.x, target.y, true);
+    CHECK(!finder.GetFlowField(target).IsReachable(target));
+    CHECK(matches_fresh_field(grid, finder.GetFlowField(target)));
+    grid.SetSolid(target.x, target.y, false);
+    CHECK_EQ(finder.GetFlowField(target).GetCost(target), 0.0f);
+    CHECK(matches_fresh_field(grid, finder.GetFlowField(target)));
+}
+
+TEST(FlowFieldIsRebuiltWhenTheChangeLogOverflows) {
+    CollisionGrid grid = make_grid(64, 0.2, 5);
+    std::mt19937 random{6};
+    PathFinder finder{grid};
+    Cell target = open_cell(grid, random);
+    finder.GetFlowField(target);
+    std::uniform_int_distribution<int> cell{0, 63};
+    for (std::size_t i = 0; i < CollisionGrid::CHANGE_LOG_SIZE + 1; ++i) {
+        int x = cell(random), y = cell(random);
+        if (Cell{x, y} != target)
+            grid.SetSolid(x, y, !grid.IsSolid(x, y));
+    }
+    CHECK(matches_fresh_field(grid, finder.GetFlowField(target)));
+}
+
+TEST(FlowFieldIsRebuiltAfterResize) {
+    CollisionGrid grid = make_grid(16, 0.0, 7);
+    PathFinder finder{grid};
+    finder.GetFlowField(Cell{0, 0});
+    grid.Resize(24, 24);
+    const FlowField & field = finder.GetFlowField(Cell{0, 0});
+    CHECK_EQ(field.GetCost(Cell{23, 0}), 23.0f);
+    CHECK(matches_fresh_field(grid, field));
+}
+
+// A walkable 8-connected route from start to goal that never cuts a solid corner; returns its length, or -1.
+float path_cost(const CollisionGrid & grid, const std::vector<Cell> & path, Cell start, Cell goal) {
+    if (path.empty() || path.front() != start || path.back() != goal)
+        return -1.0f;
+    float cost = 0.0f;
+    for (std::size_t i = 1; i < path.size(); ++i) {
+        Cell a = path[i - 1], b = path[i];
+        int dx = b.x - a.x, dy = b.y - a.y;
+        if (std::abs(dx) > 1 || std::abs(dy) > 1 || (dx == 0 && dy == 0) || grid.IsSolid(b.x, b.y))
+            return -1.0f;
+        if (dx != 0 && dy != 0 && (grid.IsSolid(a.x + dx, a.y) || grid.IsSolid(a.x, a.y + dy)))
+            return -1.0f;
+        cost += dx != 0 && dy != 0 ? 1.41421356f : 1.0f;
+    }
+    return cost;
+}
+
+// After flips, a finder that repaired its clusters must answer like one built from scratch on the new grid.
+TEST(HierarchicalPathFinderRepairMatchesAFreshFinder) {
+    CollisionGrid grid = make_grid(64, 0.25, 8);
+    std::mt19937 random{9};
+    HierarchicalPathFinder repaired{grid, 8};
+    PathFinder flat{grid};
+    std::vector<Cell> path, fresh_path, flat_path;
+    std::uniform_int_distribution<int> cell{0, 63}, flips{1, 12};
+    for (int round = 0; round < 60; ++round) {
+        for (int i = flips(random); i > 0; --i) {
+            int x = cell(random), y = cell(random);
+            grid.SetSolid(x, y, !grid.IsSolid(x, y));
+        }
+        HierarchicalPathFinder fresh{grid, 8};
+        for (int query = 0; query < 8; ++query) {
+            Cell start = open_cell(grid, random), goal = open_cell(grid, random);
+            bool found = repaired.FindPath(start, goal, path);
+            CHECK_EQ(found, fresh.FindPath(start, goal, fresh_path));
+            CHECK_EQ(found, flat.FindPath(start, goal, flat_path));
+            if (!found)
+                continue;
+            float cost = path_cost(grid, path, start, goal);
+            CHECK(cost >= 0.0f);
+            CHECK(std::abs(cost - path_cost(grid, fresh_path, start, goal)) < 1e-3f);
+            CHECK(cost + 1e-3f >= path_cost(grid, flat_path, start, goal));
+        }
+        CHECK_EQ(repaired.GetAbstractNodeCount(), fresh.GetAbstractNodeCount());
+        CHECK_EQ(repaired.GetAbstractEdgeCount(), fresh.GetAbstractEdgeCount());
+    }
+    CHECK(repaired.GetRepairedClusterCount() > 0);
+}
+
+TEST(PathQueryServiceOnJobsMatchesItsOwnThreads) {
+    CollisionGrid grid = make_grid(64, 0.25, 10);
+    JobSystem jobs{2};
+    PathQueryService shared{grid, jobs}, owned{grid, 2};
+    std::mt19937 random{11};
+    for (int query = 0; query < 64; ++query) {
+        Cell start = open_cell(grid, random), goal = open_cell(grid, random);
+        shared.Submit(start, goal);
+        owned.Submit(start, goal);
+    }
+    shared.Dispatch();
+    owned.Dispatch();
+    const std::vector<PathResult> & shared_results = shared.Collect();
+    const std::vector<PathResult> & owned_results = owned.Collect();
+    CHECK_EQ(shared_results.size(), std::size_t{64});
+    CHECK_EQ(owned_results.size(), std::size_t{64});
+    for (std::size_t i = 0; i < shared_results.size() && i < owned_results.size(); ++i) {
+        CHECK_EQ(shared_results[i].ticket, owned_results[i].ticket);
+        CHECK_EQ(shared_results[i].found, owned_results[i].found);
+        CHECK(shared_results[i].path == owned_results[i].path);
+    }
+}
+
+}
+
+int main() {
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+#ifndef DXLIBPP_TEST_HPP
+#define DXLIBPP_TEST_HPP
+
+// A minimal test harness, so that the tests build wherever the library does, sanitizers included. Each test
+// executable defines its cases with TEST() and runs them all from main() with RUN_ALL_TESTS().
+
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <vector>
+
+namespace dxlibpp_test {
+
+struct Case {
+    const char * name;
+    std::function<void()> body;
+};
+
+inline std::vector<Case> & cases() { static std::vector<Case> list; return list; }
+inline int & failures() { static int count = 0; return count; }
+
+struct Registrar {
+    Registrar(const char * name, std::function<void()> body) { cases().push_back(Case{name, std::move(body)}); }
+};
+
+inline void fail(const char * file, int line, const char * expression) {
+    std::printf("%s:%d: check failed: %s\n", file, line, expression);
+    ++failures();
+}
+
+inline int run_all() {
+    int failed_cases = 0;
+    for (const Case & c : cases()) {
+        int before = failures();
+        try {
+            c.body();
+        } catch (const std::exception & e) {
+            std::printf("uncaught exception: %s\n", e.what());
+            ++failures();
+        }
+        bool passed = failures() == before;
+        failed_cases += passed ? 0 : 1;
+        std::printf("[%s] %s\n", passed ? "  OK  " : "FAILED", c.name);
+    }
+    std::printf("%zu cases, %d failed\n", cases().size(), failed_cases);
+    return failed_cases == 0 ? 0 : 1;
+}
+
+}
+
+#define DXLIBPP_TEST_CONCAT2(a, b) a##b
+#define DXLIBPP_TEST_CONCAT(a, b) DXLIBPP_TEST_CONCAT2(a, b)
+
+#define TEST(name) \
+    static void name(); \
+    static ::dxlibpp_test::Registrar DXLIBPP_TEST_CONCAT(name, _registrar){#name, &name}; \
+    static void name()
+
+#define CHECK(expression) \
+    do { if (!(expression)) ::dxlibpp_test::fail(__FILE__, __LINE__, #expression); } while (false)
+
+#define CHECK_EQ(actual, expected) \
+    do { if (!((actual) == (expected))) ::dxlibpp_test::fail(__FILE__, __LINE__, #actual " == " #expected); } while (false)
+
+#define CHECK_THROWS(expression, type) \
+    do { \
+        bool thrown = false; \
+        try { expression; } catch (const type &) { thrown = true; } \
+        if (!thrown) ::dxlibpp_test::fail(__FILE__, __LINE__, #expression " throws " #type); \
+    } while (false)
+
+#define RUN_ALL_TESTS() ::dxlibpp_test::run_all()
+
+#endif